@@ -1,12 +1,22 @@
+#include <tasks.h>
+
+TaskScheduler scheduler;
+
+// the LED task runs once a second, on the second, without holding up
+// anything else loop() has to do
+void toggleLed(task_entry *task) {
+  digitalWrite(13, !digitalRead(13));   // turn the LED on or off
+}
+
+task_entry led = { toggleLed };
+
 void setup() {
   // initialize digital pin 13 as an output.
   pinMode(13, OUTPUT);
+  scheduler.every(led, 1000);
 }
 
 // the loop function runs over and over again forever
 void loop() {
-  digitalWrite(13, HIGH);   // turn the LED on (HIGH is the voltage level)
-  delay(1000);              // wait for a second
-  digitalWrite(13, LOW);    // turn the LED off by making the voltage LOW
-  delay(1000);              // wait for a second
+  scheduler.poll();
 }
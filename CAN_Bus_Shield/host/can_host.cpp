@@ -0,0 +1,843 @@
+// Runs the MCP2515 driver and the CAN libraries built on it against two
+// device models on a virtual bus, then the send_Blink sketch itself.
+// Reports throughput and bus use along the way. Exits non-zero if any
+// check fails.
+//
+//   ./can_host           # simulated bus only
+//   ./can_host vcan0     # also bridge the bus to a SocketCAN interface
+
+#include <stdio.h>
+#include <Arduino.h>
+#include "mcp2515.h"
+#include "cantxscheduler.h"
+#include "canreceiver.h"
+#include "candiagnostics.h"
+#include "isotp.h"
+#include "cantelemetry.h"
+#include "slcan.h"
+#include "bringup.h"
+#include "mcp2515_model.h"
+#include "telemetry_layout.h"
+
+// Shield wiring: CS on D9, INT on D2. The second node uses D10 and D3.
+#define CS_A 9
+#define INT_A 2
+#define CS_B 10
+#define INT_B 3
+
+static int failures;
+static const char *bridgeInterface;
+
+#define CHECK(cond) \
+  do { \
+    if (!(cond)) { \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      failures++; \
+    } \
+  } while (0)
+
+// The sketch, built as its own translation unit
+void setup();
+void loop();
+
+static void bridge(CANBusModel &bus) {
+  if (bridgeInterface && !bus.bridge(bridgeInterface)) {
+    fprintf(stderr, "can't open %s, running without the bridge\n", bridgeInterface);
+  }
+}
+
+static void report(const char *what, CANBusModel &bus) {
+  const canbus_stats &s = bus.stats();
+  printf("%s: %u frames, %u errors, %u arbitrations, bus %.1f%% busy, "
+         "longest wait %llu us\n",
+         what, s.frames, s.errors, s.arbitrations, bus.utilization() * 100,
+         (unsigned long long)(s.maxWaitNs / 1000));
+}
+
+static void start(void) {
+  sim_reset();
+}
+
+static void bringUp(void) {
+  start();
+  MCP2515Model model(CS_A, INT_A);
+  sim_attach(&model);
+
+  MCP2515 wrongPin(CS_B);
+  CHECK(!wrongPin.begin(CAN_500KBPS));
+
+  MCP2515 can(CS_A);
+  CHECK(can.begin(CAN_500KBPS));
+  CHECK(can.bitrate() == 500000);
+  CHECK(model.mode() == MCP2515_MODE_NORMAL);
+  // 16 MHz, 500 kbps: BRP 0, 16 TQ per bit
+  CHECK(model.reg(MCP2515_CNF1) == 0x00);
+  CHECK(model.reg(MCP2515_CNF2) != 0);
+  CHECK(can.setMode(MCP2515_MODE_LOOPBACK));
+  CHECK(can.readRegister(MCP2515_CANSTAT) == MCP2515_MODE_LOOPBACK);
+
+  // Loopback: the frame comes straight back into RXB0
+  can_msg out = { 0x123, 3, { 1, 2, 3 } };
+  CHECK(can.send(out));
+  delay(1);
+  CHECK(can.readStatus() & MCP2515_STAT_RX0IF);
+  can_msg in;
+  can.readRx(0, in);
+  CHECK(in.id == 0x123 && in.len == 3 && in.data[2] == 3);
+  CHECK(!(can.readStatus() & MCP2515_STAT_RX0IF));
+
+  can_msg ext = { 0x18FEF100 | CAN_MSG_EXT, 8, { 0, 1, 2, 3, 4, 5, 6, 7 } };
+  CHECK(can.send(ext));
+  delay(1);
+  can.readRx(0, in);
+  CHECK(in.id == ext.id && in.len == 8 && in.data[7] == 7);
+  CHECK(model.violations == 0);
+}
+
+static uint8_t counterPayload(const can_tx_entry *entry, uint8_t *data) {
+  data[0] = entry->sent;
+  data[1] = entry->sent >> 8;
+  return 2;
+}
+
+static void schedulerAndFilters(void) {
+  start();
+  CANBusModel bus(500000);
+  MCP2515Model a(CS_A, INT_A), b(CS_B, INT_B);
+  sim_attach(&a);
+  sim_attach(&b);
+  sim_attach(&bus);
+  bus.attach(a);
+  bus.attach(b);
+  bridge(bus);
+
+  MCP2515 canA(CS_A), canB(CS_B);
+  CHECK(canA.begin(CAN_500KBPS));
+  CHECK(canB.begin(CAN_500KBPS));
+
+  static const uint32_t wanted[] = { 0x100, 0x18DAF110 | CAN_MSG_EXT };
+  CANReceiver rx(canB, INT_B);
+  CHECK(rx.begin(wanted, 2));
+
+  can_tx_entry table[] = {
+    { 0x100, 10, counterPayload },
+    { 0x18DAF110 | CAN_MSG_EXT, 20, counterPayload },
+    { 0x101, 5, counterPayload },
+    { 0x200, 1, counterPayload },
+  };
+  CANTxScheduler scheduler(canA);
+  scheduler.begin(table, 4);
+
+  unsigned long got100 = 0, gotExt = 0, other = 0;
+  unsigned long begin = millis();
+  bus.resetStats();
+  while (millis() - begin < 1000) {
+    scheduler.poll();
+    const can_msg *m;
+    while ((m = rx.peek())) {
+      if (m->id == 0x100) {
+        got100++;
+      } else if (m->id == wanted[1]) {
+        gotExt++;
+      } else {
+        other++;
+      }
+      rx.pop();
+    }
+    delayMicroseconds(100);
+  }
+  report("scheduler, 4 messages", bus);
+
+  for (uint8_t i = 0; i < 4; i++) {
+    CHECK(table[i].missed == 0);
+    printf("  0x%lX: sent %lu, longest latency %lu us\n",
+           (unsigned long)(table[i].id & CAN_MSG_ID_MASK), table[i].sent,
+           table[i].maxLatency);
+  }
+  CHECK(table[0].sent >= 99 && table[0].sent <= 101);
+  CHECK(table[3].sent >= 999);
+  // Four exact filters: nothing else reaches the ring
+  CHECK(got100 + 1 >= table[0].sent && got100 <= table[0].sent);
+  CHECK(gotExt + 1 >= table[1].sent && gotExt <= table[1].sent);
+  CHECK(other == 0);
+  CHECK(rx.discarded() == 0);
+  CHECK(rx.overruns() == 0);
+  CHECK(bus.stats().errors == 0);
+  CHECK(a.violations == 0 && b.violations == 0);
+  rx.end();
+
+  // More identifiers than filters: the masks let extra frames through and
+  // the ISR drops them.
+  static const uint32_t many[] = { 0x300, 0x301, 0x302, 0x308, 0x304, 0x305, 0x306, 0x30F };
+  CHECK(rx.begin(many, 8));
+  for (uint32_t id = 0x300; id < 0x310; id++) {
+    can_msg m = { id, 1, { (uint8_t)id } };
+    while (!canA.send(m)) {
+    }
+  }
+  delay(10);
+  uint8_t got = 0;
+  const can_msg *m;
+  while ((m = rx.peek())) {
+    bool listed = false;
+    for (uint8_t i = 0; i < 8; i++) {
+      listed |= m->id == many[i];
+    }
+    CHECK(listed);
+    got++;
+    rx.pop();
+  }
+  printf("8 identifiers over 6 filters: %u accepted, %u discarded in the ISR\n",
+         got, rx.discarded());
+  CHECK(got == 8);
+  CHECK(rx.discarded() > 0);
+  CHECK(b.overflows == 0);
+  rx.end();
+
+  // Two frames queued while the bus is busy: the lower identifier wins
+  bus.resetStats();
+  can_msg busy = { 0x7FF, 8 };
+  can_msg high = { 0x050, 1 }, low = { 0x051, 1 };
+  CHECK(canA.send(busy));
+  CHECK(canB.send(low));
+  CHECK(canA.send(high));
+  delay(2);
+  CHECK(bus.stats().frames == 3);
+  CHECK(bus.stats().arbitrations == 1);
+  CHECK(b.arbitrationLost == 1);
+  CHECK(a.arbitrationLost == 0);
+  CHECK(!(canB.readRegister(MCP2515_TXBCTRL(0)) & 0x08));
+}
+
+// Node A polls for its flow control frames, node B receives by interrupt.
+static void isotpTransfer(void) {
+  start();
+  CANBusModel bus(500000);
+  MCP2515Model a(CS_A, INT_A), b(CS_B, INT_B);
+  sim_attach(&a);
+  sim_attach(&b);
+  sim_attach(&bus);
+  bus.attach(a);
+  bus.attach(b);
+  bridge(bus);
+
+  MCP2515 canA(CS_A), canB(CS_B);
+  CHECK(canA.begin(CAN_500KBPS));
+  CHECK(canB.begin(CAN_500KBPS));
+  CANReceiver rx(canB, INT_B);
+  static const uint32_t ids[] = { 0x7E0 };
+  CHECK(rx.begin(ids, 1));
+
+  static uint8_t message[4000];
+  static uint8_t bufA[64], bufB[sizeof(message)];
+  for (uint16_t i = 0; i < sizeof(message); i++) {
+    message[i] = i * 7 + (i >> 8);
+  }
+  ISOTP tester(canA, 0x7E0, 0x7E8, bufA, sizeof(bufA));
+  ISOTP ecu(canB, 0x7E8, 0x7E0, bufB, sizeof(bufB));
+  ecu.setFlowControl(0, 0);
+
+  bus.resetStats();
+  unsigned long begin = micros();
+  CHECK(tester.send(message, sizeof(message)));
+  while (tester.sending() && micros() - begin < 2000000) {
+    uint8_t status = canA.readStatus();
+    for (uint8_t n = 0; n < 2; n++) {
+      if (status & (n ? MCP2515_STAT_RX1IF : MCP2515_STAT_RX0IF)) {
+        can_msg m;
+        canA.readRx(n, m);
+        tester.receive(m);
+      }
+    }
+    tester.poll();
+    const can_msg *m;
+    while ((m = rx.peek())) {
+      ecu.receive(*m);
+      rx.pop();
+    }
+    ecu.poll();
+  }
+  unsigned long us = micros() - begin;
+  // The last consecutive frame is still on its way to the ISR
+  delay(1);
+  const can_msg *last;
+  while ((last = rx.peek())) {
+    ecu.receive(*last);
+    rx.pop();
+  }
+
+  CHECK(!tester.sending());
+  CHECK(tester.txStatus() == ISOTP_OK);
+  CHECK(ecu.available() == sizeof(message));
+  CHECK(memcmp(bufB, message, sizeof(message)) == 0);
+  CHECK(rx.overruns() == 0);
+  CHECK(bus.stats().errors == 0);
+  printf("ISO-TP: %u bytes in %lu us, %.1f kbit/s of payload\n",
+         (unsigned)sizeof(message), us, sizeof(message) * 8000.0 / us);
+  report("ISO-TP", bus);
+  rx.end();
+}
+
+// A node alone on the bus gets no ACK: TEC climbs by 8 per attempt until
+// the node is error passive, and then stays there.
+// can_telemetry's layout, as the sketch expands it.
+#define CAN_MESSAGE(name, id, period) { id, period },
+static can_tx_entry telemetryMessages[] = { TELEMETRY_MESSAGES };
+#undef CAN_MESSAGE
+#define CAN_SIGNAL(name, message, start, length, isSigned, scale, offset, deadband, unit) \
+  { MSG_##message, start, length, isSigned, scale, offset, deadband },
+static const can_signal telemetrySignals[] = { TELEMETRY_SIGNALS };
+#undef CAN_SIGNAL
+
+// decode() from decode_telemetry.py: the frame as one little endian
+// number, the signal's bits shifted down and sign extended.
+static double decodeSignal(const can_signal &s, const uint8_t *data, uint8_t len) {
+  uint64_t frame = 0;
+  for (int8_t i = 7; i >= 0; i--) {
+    frame = (frame << 8) | (i < len ? data[i] : 0);
+  }
+  int64_t raw = (frame >> s.start) & ((1ULL << s.length) - 1);
+  if (s.isSigned && (raw & (1LL << (s.length - 1)))) {
+    raw -= 1LL << s.length;
+  }
+  return raw * (double)s.scale + s.offset;
+}
+
+// Raw value decoded back, in counts.
+static int32_t decodeRaw(const can_signal &s, const uint8_t *data, uint8_t len) {
+  return lround((decodeSignal(s, data, len) - s.offset) / s.scale);
+}
+
+// Poll the scheduler for ms, keeping the last frame of each telemetry
+// message node B received and how many there were.
+static void telemetryRun(CANTxScheduler &scheduler, CANReceiver &rx, unsigned long ms,
+                         can_msg *last, uint8_t *received) {
+  unsigned long begin = millis();
+  while (millis() - begin < ms) {
+    scheduler.poll();
+    const can_msg *m;
+    while ((m = rx.peek())) {
+      for (uint8_t i = 0; i < MSG_COUNT; i++) {
+        if (m->id == telemetryMessages[i].id) {
+          last[i] = *m;
+          received[i]++;
+        }
+      }
+      rx.pop();
+    }
+  }
+}
+
+static void telemetry(void) {
+  // Every signal at the ends of its range and either side of zero, with
+  // the other signals of its message all zeros or all ones around it.
+  for (uint8_t i = 0; i < SIG_COUNT; i++) {
+    const can_signal &s = telemetrySignals[i];
+    int32_t lo = s.isSigned ? -(1L << (s.length - 1)) : 0;
+    int32_t hi = s.isSigned ? (1L << (s.length - 1)) - 1 : (1L << s.length) - 1;
+    int32_t values[] = { lo, lo + 1, -1, 0, 1, hi - 1, hi };
+    for (uint8_t v = 0; v < sizeof(values) / sizeof(values[0]); v++) {
+      if (values[v] < lo || values[v] > hi) {
+        continue;
+      }
+      for (uint8_t ones = 0; ones < 2; ones++) {
+        uint8_t data[8];
+        memset(data, ones ? 0xFF : 0, sizeof(data));
+        CANTelemetry::pack(data, s.start, s.length, values[v]);
+        CHECK(decodeRaw(s, data, 8) == values[v]);
+        for (uint8_t j = 0; j < SIG_COUNT; j++) {
+          const can_signal &o = telemetrySignals[j];
+          int32_t around = ones ? (o.isSigned ? -1 : (1L << o.length) - 1) : 0;
+          if (j != i && o.message == s.message) {
+            CHECK(decodeRaw(o, data, 8) == around);
+          }
+        }
+      }
+    }
+  }
+
+  start();
+  CANBusModel bus(500000);
+  MCP2515Model a(CS_A, INT_A), b(CS_B, INT_B);
+  sim_attach(&a);
+  sim_attach(&b);
+  sim_attach(&bus);
+  bus.attach(a);
+  bus.attach(b);
+  bridge(bus);
+
+  MCP2515 canA(CS_A), canB(CS_B);
+  CHECK(canA.begin(CAN_500KBPS));
+  CHECK(canB.begin(CAN_500KBPS));
+  CANReceiver rx(canB, INT_B);
+  CHECK(rx.begin());
+  CANTxScheduler scheduler(canA);
+  can_signal_state state[SIG_COUNT];
+  CANTelemetry telemetry(scheduler, telemetrySignals, state, SIG_COUNT);
+  telemetry.attach(telemetryMessages, MSG_COUNT);
+  scheduler.begin(telemetryMessages, MSG_COUNT);
+
+  can_msg last[MSG_COUNT];
+  uint8_t received[MSG_COUNT] = { 0 };
+  // Both messages go out once at the start of their periods
+  telemetryRun(scheduler, rx, 10, last, received);
+  CHECK(received[MSG_rtd] == 1 && received[MSG_thermocouple] == 1);
+
+  // Negative values: the 14 bit tc_temp crosses into the byte it shares
+  // with tc_status and has to come back sign extended.
+  telemetry.set(SIG_rtd_temp, -12.34);
+  telemetry.setRaw(SIG_rtd_valid, 1);
+  telemetry.set(SIG_tc_temp, -25.0);
+  telemetry.setRaw(SIG_tc_status, 2);
+  telemetryRun(scheduler, rx, 10, last, received);
+  CHECK(received[MSG_rtd] == 2 && received[MSG_thermocouple] == 2);
+  const can_msg &rtd = last[MSG_rtd], &tc = last[MSG_thermocouple];
+  CHECK(fabs(decodeSignal(telemetrySignals[SIG_rtd_temp], rtd.data, rtd.len) + 12.34) < 0.001);
+  CHECK(decodeSignal(telemetrySignals[SIG_rtd_valid], rtd.data, rtd.len) == 1);
+  CHECK(decodeSignal(telemetrySignals[SIG_tc_temp], tc.data, tc.len) == -25.0);
+  CHECK(decodeSignal(telemetrySignals[SIG_tc_status], tc.data, tc.len) == 2);
+  CHECK(rtd.len == 3 && tc.len == 2);
+
+  // Out of range is clamped to the signal's range, not wrapped.
+  telemetry.set(SIG_tc_temp, 5000.0);
+  telemetryRun(scheduler, rx, 10, last, received);
+  CHECK(received[MSG_thermocouple] == 3);
+  CHECK(decodeSignal(telemetrySignals[SIG_tc_temp], tc.data, tc.len) == 2047.75);
+  CHECK(decodeSignal(telemetrySignals[SIG_tc_status], tc.data, tc.len) == 2);
+
+  // A change inside the deadband waits for the period, one at the
+  // deadband goes out at once.
+  int32_t sent = state[SIG_rtd_temp].sent;
+  telemetry.setRaw(SIG_rtd_temp, sent + telemetrySignals[SIG_rtd_temp].deadband - 1);
+  telemetryRun(scheduler, rx, 50, last, received);
+  CHECK(received[MSG_rtd] == 2);
+  telemetry.setRaw(SIG_rtd_temp, sent - telemetrySignals[SIG_rtd_temp].deadband);
+  telemetryRun(scheduler, rx, 10, last, received);
+  CHECK(received[MSG_rtd] == 3);
+  CHECK(decodeRaw(telemetrySignals[SIG_rtd_temp], rtd.data, rtd.len) ==
+        sent - telemetrySignals[SIG_rtd_temp].deadband);
+  CHECK(rx.overruns() == 0);
+  CHECK(a.violations == 0 && b.violations == 0);
+  printf("telemetry: rtd_temp %.2f degC, tc_temp %.2f degC after clamping\n",
+         decodeSignal(telemetrySignals[SIG_rtd_temp], rtd.data, rtd.len),
+         decodeSignal(telemetrySignals[SIG_tc_temp], tc.data, tc.len));
+  rx.end();
+}
+
+// N_As: with nobody to acknowledge it the first frame never leaves the
+// controller. The transfer gives up and takes the frame back.
+static void isotpNoAck(void) {
+  start();
+  CANBusModel bus(500000);
+  MCP2515Model a(CS_A, INT_A);
+  sim_attach(&a);
+  sim_attach(&bus);
+  bus.attach(a);
+
+  MCP2515 can(CS_A);
+  CHECK(can.begin(CAN_500KBPS));
+  static uint8_t message[100], buf[8];
+  ISOTP tester(can, 0x7E0, 0x7E8, buf, sizeof(buf));
+
+  unsigned long begin = millis();
+  CHECK(tester.send(message, sizeof(message)));
+  while (tester.sending() && millis() - begin < 3 * ISOTP_TIMEOUT_MS) {
+    tester.poll();
+    delay(1);
+  }
+  unsigned long took = millis() - begin;
+  CHECK(!tester.sending());
+  CHECK(tester.txStatus() == ISOTP_TIMEOUT);
+  CHECK(took > ISOTP_TIMEOUT_MS && took <= ISOTP_TIMEOUT_MS + 2);
+  CHECK(!(can.readStatus() & (MCP2515_STAT_TXREQ(0) | MCP2515_STAT_TXREQ(1) |
+                              MCP2515_STAT_TXREQ(2))));
+  CHECK(bus.stats().frames == 0);
+  printf("ISO-TP without ACK: gave up after %lu ms\n", took);
+}
+
+static void loneNode(void) {
+  start();
+  CANBusModel bus(500000);
+  MCP2515Model a(CS_A, INT_A);
+  sim_attach(&a);
+  sim_attach(&bus);
+  bus.attach(a);
+
+  MCP2515 can(CS_A);
+  CHECK(can.begin(CAN_500KBPS));
+  CANDiagnostics diagnostics(can);
+  can_msg m = { 0x321, 2, { 1, 2 } };
+  CHECK(can.send(m));
+  unsigned long begin = millis();
+  while (millis() - begin < 2500) {
+    diagnostics.poll();
+    delay(1);
+  }
+  const can_diagnostics &d = diagnostics.read();
+  printf("lone node: TEC %u, REC %u, EFLG 0x%02X, %u frames failed\n",
+         d.tec, d.rec, d.eflg, bus.stats().errors);
+  CHECK(d.tec == 128);
+  CHECK(d.state == CAN_ERROR_PASSIVE);
+  CHECK(d.eflg & MCP2515_EFLG_TXEP);
+  CHECK(d.errorPassive == 1);
+  CHECK(d.busOff == 0);
+  CHECK(d.messageErrors > 0);
+  CHECK(bus.stats().frames == 0);
+}
+
+// A UART with the core's transmit buffer, emptying at baud / 10 bytes a
+// second of simulated time. The test feeds its input and reads what was
+// written. A write with the buffer full would block on the AVR, so it is
+// counted instead.
+class TestPort : public Stream {
+ public:
+  TestPort(unsigned long baud)
+    : blocked(0), written(0), baud(baud), queued(0), idleSince(sim_ns()),
+      inHead(0), inTail(0), outLength(0) {}
+
+  unsigned long blocked;
+  unsigned long written;
+
+  void feed(const void *data, size_t n) {
+    const uint8_t *p = (const uint8_t *)data;
+    while (n--) {
+      in[inHead++ % sizeof(in)] = *p++;
+    }
+  }
+  void feed(const char *s) { feed(s, strlen(s)); }
+  // Output since the last call, NUL terminated
+  const char *output(void) {
+    static char copy[sizeof(out) + 1];
+    memcpy(copy, out, outLength);
+    copy[outLength] = 0;
+    outLength = 0;
+    return copy;
+  }
+
+  int available(void) { return inHead - inTail; }
+  int read(void) { return inHead != inTail ? in[inTail++ % sizeof(in)] : -1; }
+  int availableForWrite(void) {
+    drain();
+    return BUFFER - queued;
+  }
+  size_t write(uint8_t c) {
+    drain();
+    if (queued >= BUFFER) {
+      blocked++;
+    } else {
+      queued++;
+    }
+    written++;
+    if (outLength < sizeof(out)) {
+      out[outLength++] = c;
+    }
+    return 1;
+  }
+
+ private:
+  // SERIAL_TX_BUFFER_SIZE less the slot that tells full from empty
+  static const unsigned BUFFER = 63;
+
+  void drain(void) {
+    uint64_t now = sim_ns();
+    uint64_t bytes = (now - idleSince) * baud / 10 / 1000000000ULL;
+    if (bytes >= queued) {
+      queued = 0;
+      idleSince = now;
+    } else if (bytes) {
+      queued -= bytes;
+      idleSince += bytes * 10 * 1000000000ULL / baud;
+    }
+  }
+
+  unsigned long baud;
+  unsigned queued;
+  uint64_t idleSince;
+  uint8_t in[256];
+  unsigned inHead, inTail;
+  char out[512];
+  unsigned outLength;
+};
+
+// Read one frame from either receive buffer of a polled controller
+static bool readAny(MCP2515 &can, can_msg &m) {
+  uint8_t status = can.readStatus();
+  for (uint8_t n = 0; n < 2; n++) {
+    if (status & (n ? MCP2515_STAT_RX1IF : MCP2515_STAT_RX0IF)) {
+      can.readRx(n, m);
+      return true;
+    }
+  }
+  return false;
+}
+
+static void pollFor(SLCANGateway &gateway, unsigned long us) {
+  unsigned long begin = micros();
+  while (micros() - begin < us) {
+    gateway.poll();
+  }
+}
+
+// Poll the gateway until node B has received count frames, or 10 ms
+static uint8_t collect(SLCANGateway &gateway, MCP2515 &canB, can_msg *in, uint8_t count) {
+  uint8_t got = 0;
+  unsigned long begin = micros();
+  while (got < count && micros() - begin < 10000) {
+    gateway.poll();
+    if (readAny(canB, in[got])) {
+      got++;
+    }
+  }
+  return got;
+}
+
+// Node B floods 8 byte frames at rate per second for a second while the
+// gateway on A forwards them. Returns the frames that reached the port.
+static unsigned long flood(SLCANGateway &gateway, CANReceiver &rx, MCP2515 &canB,
+                           unsigned long rate, unsigned long &longestPoll) {
+  unsigned long forwarded = gateway.toHost();
+  unsigned long interval = 1000000UL / rate;
+  unsigned long begin = micros(), next = begin;
+  can_msg m = { 0x2A0, 8, { 1, 2, 3, 4, 5, 6, 7, 8 } };
+  longestPoll = 0;
+  while (micros() - begin < 1000000UL) {
+    if ((long)(micros() - next) >= 0 && canB.send(m)) {
+      next += interval;
+      m.data[0]++;
+    }
+    unsigned long t = micros();
+    gateway.poll();
+    t = micros() - t;
+    if (t > longestPoll) {
+      longestPoll = t;
+    }
+  }
+  pollFor(gateway, 100000);
+  return gateway.toHost() - forwarded;
+}
+
+static void slcanGateway(void) {
+  start();
+  CANBusModel bus(500000);
+  MCP2515Model a(CS_A, INT_A), b(CS_B, INT_B);
+  sim_attach(&a);
+  sim_attach(&b);
+  sim_attach(&bus);
+  bus.attach(a);
+  bus.attach(b);
+  bridge(bus);
+
+  MCP2515 canA(CS_A), canB(CS_B);
+  CHECK(canA.begin(CAN_500KBPS, MCP2515_MODE_CONFIG));
+  CHECK(canB.begin(CAN_500KBPS));
+  CANReceiver rx(canA, INT_A);
+  TestPort port(115200);
+  SLCANGateway gateway(canA, rx, port);
+  gateway.begin();
+
+  // What slcand sends when it attaches
+  port.feed("\r\r\rC\rS6\rO\r");
+  pollFor(gateway, 2000);
+  CHECK(strcmp(port.output(), "\r\r\r") == 0);
+  CHECK(gateway.isOpen());
+
+  can_msg std = { 0x123, 2, { 0xDE, 0xAD } };
+  can_msg rtr = { 0x18DAF110 | CAN_MSG_EXT | CAN_MSG_RTR, 0 };
+  CHECK(canB.send(std));
+  pollFor(gateway, 1000);
+  CHECK(canB.send(rtr));
+  pollFor(gateway, 2000);
+  CHECK(strcmp(port.output(), "t1232DEAD\rR18DAF1100\r") == 0);
+
+  port.feed("t4560\rT18DAF11021122\rr7FF8\r");
+  can_msg in[3];
+  CHECK(collect(gateway, canB, in, 3) == 3);
+  CHECK(strcmp(port.output(), "z\rZ\rz\r") == 0);
+  CHECK(in[0].id == 0x456 && in[0].len == 0);
+  CHECK(in[1].id == (0x18DAF110 | CAN_MSG_EXT) && in[1].len == 2 && in[1].data[1] == 0x22);
+  CHECK(in[2].id == (0x7FF | CAN_MSG_RTR) && in[2].len == 8);
+
+  // Malformed frame, S while open, F, timestamps
+  port.feed("t12\rt1239\rS6\rF\rZ1\r");
+  pollFor(gateway, 2000);
+  CHECK(strcmp(port.output(), "\a\a\aF00\r\r") == 0);
+  CHECK(canB.send(std));
+  pollFor(gateway, 2000);
+  const char *line = port.output();
+  CHECK(strlen(line) == 14 && strncmp(line, "t1232DEAD", 9) == 0);
+  port.feed("Z0\r");
+  pollFor(gateway, 1000);
+  CHECK(strcmp(port.output(), "\r") == 0);
+
+  // 800 frames a second at 115200 baud: too many for the text lines
+  unsigned long longest;
+  uint16_t overruns = rx.overruns();
+  unsigned long text = flood(gateway, rx, canB, 800, longest);
+  uint16_t textOverruns = rx.overruns() - overruns;
+  printf("SLCAN text at 115200 baud: %lu of 800 frames/s forwarded, longest poll() %lu us\n",
+         text, longest);
+  CHECK(text < 700 && textOverruns > 0);
+  CHECK(longest < 1000);
+  port.output();
+
+  // and few enough for the binary framing
+  port.feed("B1\r");
+  pollFor(gateway, 1000);
+  CHECK(strcmp(port.output(), "\r") == 0);
+  overruns = rx.overruns();
+  unsigned long binary = flood(gateway, rx, canB, 800, longest);
+  printf("SLCAN binary at 115200 baud: %lu of 800 frames/s forwarded, longest poll() %lu us\n",
+         binary, longest);
+  CHECK(binary >= 799 && rx.overruns() == overruns);
+  CHECK(longest < 1000);
+  port.output();
+
+  // Binary frames to send, then back to text
+  static const uint8_t frames[] = {
+    SLCAN_BINARY_SYNC, 0x03, 0x21, 0x03, 9, 8, 7,
+    SLCAN_BINARY_SYNC, 0x81, 0x10, 0xF1, 0xDA, 0x18, 0x55,
+    SLCAN_BINARY_SYNC, 0xFF,
+  };
+  while (readAny(canB, in[0])) {
+  }
+  port.feed(frames, sizeof(frames));
+  CHECK(collect(gateway, canB, in, 2) == 2);
+  CHECK(in[0].id == 0x321 && in[0].len == 3 && in[0].data[2] == 7);
+  CHECK(in[1].id == (0x18DAF110 | CAN_MSG_EXT) && in[1].len == 1 && in[1].data[0] == 0x55);
+  port.feed("C\r");
+  pollFor(gateway, 1000);
+  CHECK(strcmp(port.output(), "\r") == 0);
+  CHECK(!gateway.isOpen());
+
+  CHECK(port.blocked == 0);
+  CHECK(gateway.dropped() == 0);
+  CHECK(a.violations == 0 && b.violations == 0);
+}
+
+static bool canStep(const bringup_entry *e) {
+  return ((MCP2515 *)e->context)->beginStep(CAN_500KBPS);
+}
+
+// A device that is ready at the millis() in its context
+static bool slowStep(const bringup_entry *e) {
+  return millis() >= *(unsigned long *)e->context;
+}
+
+// beginStep() on a controller that answers only after a while, and a
+// bring-up table that waits for the slowest device and gives up on one
+// that never comes up, without any step blocking the loop.
+static void nonBlockingBringUp(void) {
+  start();
+  MCP2515Model model(CS_A, INT_A);
+  MCP2515 can(CS_A);
+
+  // Nothing on the bus yet: reset, find nothing, wait to retry
+  for (uint8_t i = 0; i < 10; i++) {
+    CHECK(!can.beginStep(CAN_500KBPS));
+    delayMicroseconds(100);
+  }
+  CHECK(!can.ready());
+  sim_attach(&model);
+
+  unsigned long slowReady = millis() + 300;
+  unsigned long never = (unsigned long)-1;
+  bringup_entry devices[] = {
+    { "CAN", canStep, 1000, &can },
+    { "slow", slowStep, 1000, &slowReady },
+    { "missing", slowStep, 200, &never },
+  };
+  BringUp bringUp(devices, 3);
+  unsigned long longest = 0;
+  unsigned long polls = 0;
+  for (;;) {
+    unsigned long t = micros();
+    bool done = bringUp.poll();
+    t = micros() - t;
+    if (t > longest) {
+      longest = t;
+    }
+    polls++;
+    if (done) {
+      break;
+    }
+    delayMicroseconds(100);
+  }
+  printf("bring-up: CAN after %lu ms, slow %lu ms, missing failed at %lu ms, "
+         "up in %lu ms, %lu polls, longest %lu us\n",
+         devices[0].time, devices[1].time, devices[2].time, bringUp.bootTime(),
+         polls, longest);
+  CHECK(bringUp.ready(0) && bringUp.ready(1) && !bringUp.ready(2));
+  CHECK(devices[2].state == BRINGUP_FAILED);
+  CHECK(!bringUp.ok());
+  CHECK(devices[0].time <= MCP2515_RETRY_MS + 2);
+  CHECK(bringUp.bootTime() >= 300 && bringUp.bootTime() <= 302);
+  CHECK(longest < 200);
+  CHECK(can.ready());
+  CHECK(model.mode() == MCP2515_MODE_NORMAL);
+  CHECK(can.bitrate() == 500000);
+  CHECK(model.violations == 0);
+}
+
+// send_Blink.ino with a second node listening to everything
+static void sketch(void) {
+  start();
+  CANBusModel bus(500000);
+  MCP2515Model a(CS_A, INT_A), b(CS_B, INT_B);
+  sim_attach(&a);
+  sim_attach(&b);
+  sim_attach(&bus);
+  bus.attach(a);
+  bus.attach(b);
+  bridge(bus);
+
+  MCP2515 canB(CS_B);
+  CHECK(canB.begin(CAN_500KBPS));
+  CANReceiver rx(canB, INT_B);
+  CHECK(rx.begin());
+
+  setup();
+  unsigned long begin = millis();
+  unsigned long blink = 0, uptime = 0, diag = 0;
+  bus.resetStats();
+  while (millis() - begin < 3000) {
+    loop();
+    const can_msg *m;
+    while ((m = rx.peek())) {
+      blink += m->id == 0x70;
+      uptime += m->id == 0x71;
+      diag += m->id == 0x7F0;
+      rx.pop();
+    }
+  }
+  printf("send_Blink: 0x70 x%lu, 0x71 x%lu, 0x7F0 x%lu\n", blink, uptime, diag);
+  report("send_Blink", bus);
+  CHECK(blink >= 3 && blink <= 4);
+  CHECK(uptime >= 29 && uptime <= 31);
+  CHECK(diag >= 3 && diag <= 4);
+  CHECK(rx.overruns() == 0);
+  CHECK(a.violations == 0 && b.violations == 0);
+  rx.end();
+}
+
+int main(int argc, char **argv) {
+  if (argc > 1) {
+    bridgeInterface = argv[1];
+  }
+
+  bringUp();
+  nonBlockingBringUp();
+  schedulerAndFilters();
+  isotpTransfer();
+  isotpNoAck();
+  telemetry();
+  loneNode();
+  slcanGateway();
+  sketch();
+
+  if (failures) {
+    fprintf(stderr, "%d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("all checks passed\n");
+  return 0;
+}
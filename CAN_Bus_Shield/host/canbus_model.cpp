@@ -0,0 +1,343 @@
+// Virtual CAN bus for the host build.
+
+#include <stdio.h>
+#include <Arduino.h>
+#include "canbus_model.h"
+#include "mcp2515_model.h"
+
+#ifdef __linux__
+#include <errno.h>
+#include <fcntl.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#endif
+
+// Read the bridge at most this often, in simulated time
+#define BRIDGE_POLL_NS 1000000ULL
+
+// After the ACK slot of a frame nobody acknowledged: error flag, error
+// delimiter and intermission.
+#define ERROR_FRAME_BITS (6 + 8 + 3)
+
+// The frame from SOF to the end of the CRC, before stuffing
+struct can_bits {
+  uint8_t bit[128];
+  uint8_t n;
+
+  void put(uint32_t value, uint8_t count) {
+    while (count--) {
+      bit[n++] = (value >> count) & 1;
+    }
+  }
+};
+
+CANBusModel::CANBusModel(unsigned long bitrate)
+  : bps(bitrate), nnodes(0), extHead(0), extTail(0), busy(false), sender(NULL),
+    senderBuffer(-1), acked(false), idleSince(sim_ns()), busyUntil(0),
+    lastPoll(0), running(false), socketFd(-1) {
+  resetStats();
+}
+
+CANBusModel::~CANBusModel() {
+#ifdef __linux__
+  if (socketFd >= 0) {
+    close(socketFd);
+  }
+#endif
+}
+
+void CANBusModel::attach(MCP2515Model &node) {
+  if (nnodes < CANBUS_MAX_NODES) {
+    nodes[nnodes++] = &node;
+    node.setBus(this);
+  }
+}
+
+bool CANBusModel::bridge(const char *interface) {
+#ifdef __linux__
+  int fd = socket(PF_CAN, SOCK_RAW | SOCK_NONBLOCK, CAN_RAW);
+  if (fd < 0) {
+    return false;
+  }
+  struct ifreq ifr;
+  memset(&ifr, 0, sizeof(ifr));
+  strncpy(ifr.ifr_name, interface, sizeof(ifr.ifr_name) - 1);
+  struct sockaddr_can addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.can_family = AF_CAN;
+  if (ioctl(fd, SIOCGIFINDEX, &ifr) < 0 ||
+      (addr.can_ifindex = ifr.ifr_ifindex,
+       bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)) {
+    close(fd);
+    return false;
+  }
+  if (socketFd >= 0) {
+    close(socketFd);
+  }
+  socketFd = fd;
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool CANBusModel::inject(const canbus_frame &frame) {
+  uint8_t next = (extTail + 1) % CANBUS_EXTERNAL_QUEUE;
+  if (next == extHead) {
+    return false;
+  }
+  external[extTail].frame = frame;
+  external[extTail].requested = sim_ns();
+  extTail = next;
+  return true;
+}
+
+void CANBusModel::resetStats(void) {
+  memset(&stat, 0, sizeof(stat));
+  statsSince = sim_ns();
+}
+
+double CANBusModel::utilization(void) {
+  uint64_t elapsed = sim_ns() - statsSince;
+  if (!elapsed) {
+    return 0;
+  }
+  // A frame still on the bus was counted whole when it started
+  double u = (double)stat.busyNs / elapsed;
+  return u > 1 ? 1 : u;
+}
+
+uint16_t CANBusModel::stuffedBits(const canbus_frame &frame) {
+  can_bits b;
+  uint8_t len = frame.len > 8 ? 8 : frame.len;
+
+  b.n = 0;
+  b.put(0, 1);                                  // SOF
+  if (frame.ext) {
+    b.put(frame.id >> 18, 11);
+    b.put(3, 2);                                // SRR, IDE
+    b.put(frame.id & 0x3FFFF, 18);
+    b.put(frame.rtr, 1);
+    b.put(0, 2);                                // r1, r0
+  } else {
+    b.put(frame.id, 11);
+    b.put(frame.rtr, 1);
+    b.put(0, 2);                                // IDE, r0
+  }
+  b.put(frame.len, 4);
+  if (!frame.rtr) {
+    for (uint8_t i = 0; i < len; i++) {
+      b.put(frame.data[i], 8);
+    }
+  }
+
+  uint16_t crc = 0;
+  for (uint8_t i = 0; i < b.n; i++) {
+    bool next = b.bit[i] ^ ((crc >> 14) & 1);
+    crc = (crc << 1) & 0x7FFF;
+    if (next) {
+      crc ^= 0x4599;
+    }
+  }
+  b.put(crc, 15);
+
+  // A stuff bit follows every five equal bits, and starts the next run
+  uint16_t bits = b.n;
+  uint8_t run = 1;
+  uint8_t last = b.bit[0];
+  for (uint8_t i = 1; i < b.n; i++) {
+    if (b.bit[i] == last) {
+      if (++run == 5) {
+        bits++;
+        last = !last;
+        run = 1;
+      }
+    } else {
+      last = b.bit[i];
+      run = 1;
+    }
+  }
+  return bits;
+}
+
+uint16_t CANBusModel::frameBits(const canbus_frame &frame) {
+  // CRC delimiter, ACK slot, ACK delimiter, EOF and interframe space
+  return stuffedBits(frame) + 1 + 2 + 7 + 3;
+}
+
+// Lower wins: SID, then SRR or RTR, IDE, EID and the extended RTR, in the
+// order they go on the wire with dominant as 0.
+static uint32_t arbitrationKey(const canbus_frame &frame) {
+  if (frame.ext) {
+    return ((frame.id >> 18) << 21) | (1UL << 20) | (1UL << 19) |
+           ((frame.id & 0x3FFFF) << 1) | frame.rtr;
+  }
+  return (frame.id << 21) | ((uint32_t)frame.rtr << 20);
+}
+
+void CANBusModel::advance(void) {
+  // Nodes don't call back into simulated time, but guard against it
+  if (running) {
+    return;
+  }
+  running = true;
+  run(sim_ns());
+  running = false;
+}
+
+void CANBusModel::run(uint64_t now) {
+  if (socketFd >= 0 && now - lastPoll >= BRIDGE_POLL_NS) {
+    lastPoll = now;
+    pollBridge();
+  }
+
+  for (;;) {
+    if (busy) {
+      if (now < busyUntil) {
+        return;
+      }
+      finish();
+      continue;
+    }
+
+    // Everything pending by the time the first request came in after the
+    // bus went idle takes part in arbitration.
+    canbus_frame offers[CANBUS_MAX_NODES + 1];
+    uint64_t requested[CANBUS_MAX_NODES + 1];
+    int8_t buffers[CANBUS_MAX_NODES + 1];
+    uint8_t n = 0;
+    uint64_t first = UINT64_MAX;
+
+    for (uint8_t i = 0; i < nnodes; i++) {
+      buffers[i] = nodes[i]->offer(offers[i], requested[i]);
+      if (buffers[i] >= 0 && requested[i] < first) {
+        first = requested[i];
+      }
+    }
+    n = nnodes;
+    if (extHead != extTail) {
+      offers[n] = external[extHead].frame;
+      requested[n] = external[extHead].requested;
+      buffers[n] = 0;
+      if (requested[n] < first) {
+        first = requested[n];
+      }
+      n++;
+    } else {
+      buffers[n] = -1;
+    }
+    if (first == UINT64_MAX) {
+      return;
+    }
+
+    uint64_t start = first > idleSince ? first : idleSince;
+    int8_t winner = -1;
+    uint8_t contenders = 0;
+    for (uint8_t i = 0; i < n; i++) {
+      if (buffers[i] < 0 || requested[i] > start) {
+        continue;
+      }
+      contenders++;
+      if (winner < 0 || arbitrationKey(offers[i]) < arbitrationKey(offers[winner])) {
+        winner = i;
+      }
+    }
+    if (contenders > 1) {
+      stat.arbitrations++;
+      for (uint8_t i = 0; i < nnodes; i++) {
+        if (i != winner && buffers[i] >= 0 && requested[i] <= start) {
+          nodes[i]->lostArbitration(buffers[i]);
+          stat.arbitrationLost++;
+        }
+      }
+      if (winner != nnodes && buffers[nnodes] >= 0 && requested[nnodes] <= start) {
+        stat.arbitrationLost++;
+      }
+    }
+    if (start - requested[winner] > stat.maxWaitNs) {
+      stat.maxWaitNs = start - requested[winner];
+    }
+
+    frame = offers[winner];
+    sender = winner < nnodes ? nodes[winner] : NULL;
+    senderBuffer = buffers[winner];
+    // Any other node in normal mode, or whatever is on the far side of the
+    // bridge, acknowledges.
+    acked = !sender || socketFd >= 0;
+    for (uint8_t i = 0; i < nnodes && !acked; i++) {
+      acked = nodes[i] != sender && nodes[i]->acknowledges();
+    }
+
+    uint16_t bits = acked ? frameBits(frame) : stuffedBits(frame) + 2 + ERROR_FRAME_BITS;
+    uint64_t duration = (uint64_t)bits * 1000000000ULL / bps;
+    busy = true;
+    busyUntil = start + duration;
+    stat.bits += bits;
+    stat.busyNs += duration;
+  }
+}
+
+void CANBusModel::finish(void) {
+  busy = false;
+  idleSince = busyUntil;
+
+  if (!acked) {
+    stat.errors++;
+    sender->transmitted(senderBuffer, false);
+    return;
+  }
+
+  stat.frames++;
+  for (uint8_t i = 0; i < nnodes; i++) {
+    if (nodes[i] != sender && nodes[i]->listening()) {
+      nodes[i]->received(frame);
+    }
+  }
+  if (sender) {
+    sender->transmitted(senderBuffer, true);
+    writeBridge(frame);
+  } else {
+    extHead = (extHead + 1) % CANBUS_EXTERNAL_QUEUE;
+  }
+}
+
+void CANBusModel::pollBridge(void) {
+#ifdef __linux__
+  struct can_frame cf;
+  while (read(socketFd, &cf, sizeof(cf)) == sizeof(cf)) {
+    if (cf.can_id & CAN_ERR_FLAG) {
+      continue;
+    }
+    canbus_frame f;
+    f.ext = cf.can_id & CAN_EFF_FLAG;
+    f.rtr = cf.can_id & CAN_RTR_FLAG;
+    f.id = cf.can_id & (f.ext ? CAN_EFF_MASK : CAN_SFF_MASK);
+    f.len = cf.can_dlc > 8 ? 8 : cf.can_dlc;
+    memcpy(f.data, cf.data, 8);
+    if (!inject(f)) {
+      fprintf(stderr, "CAN bus model: bridge queue full, frame 0x%X dropped\n",
+              (unsigned)f.id);
+    }
+  }
+#endif
+}
+
+void CANBusModel::writeBridge(const canbus_frame &frame) {
+#ifdef __linux__
+  if (socketFd < 0) {
+    return;
+  }
+  struct can_frame cf;
+  memset(&cf, 0, sizeof(cf));
+  cf.can_id = frame.id | (frame.ext ? CAN_EFF_FLAG : 0) | (frame.rtr ? CAN_RTR_FLAG : 0);
+  cf.can_dlc = frame.len > 8 ? 8 : frame.len;
+  memcpy(cf.data, frame.data, cf.can_dlc);
+  if (write(socketFd, &cf, sizeof(cf)) < 0 && errno != EAGAIN) {
+    perror("CAN bus model: bridge write");
+  }
+#endif
+}
@@ -0,0 +1,107 @@
+// Virtual CAN bus for the host build.
+//
+// MCP2515 models attached to the bus offer their highest priority pending
+// transmit buffer. Whenever the bus goes idle, the offers made by then
+// arbitrate bit by bit on their identifiers, and the winner holds the
+// bus for its exact length: stuff bits, CRC, ACK, EOF and interframe
+// space included. At the end of the frame every other node in normal or
+// listen only mode receives it. A frame no node acknowledges is an error
+// for the sender, as on a real bus with one node.
+//
+// The bus runs on simulated time, from SimDevice::advance(), so attach it
+// with sim_attach() along with the models.
+//
+// On Linux the bus can also be bridged to a SocketCAN interface such as
+// vcan0: frames won on the virtual bus are written to it, and frames read
+// from it join the next arbitration. Simulated time usually runs faster
+// than real time, so this is for exchanging traffic with tools such as
+// candump or isotpsend, not for timing.
+
+#ifndef _CANBUS_MODEL_H_INCLUDED
+#define _CANBUS_MODEL_H_INCLUDED
+
+#include "sim.h"
+
+#define CANBUS_MAX_NODES 8
+#define CANBUS_EXTERNAL_QUEUE 16
+
+struct canbus_frame {
+  uint32_t id;      // 11 or 29 bits
+  bool ext;
+  bool rtr;
+  uint8_t len;
+  uint8_t data[8];
+};
+
+struct canbus_stats {
+  uint32_t frames;          // Frames that completed
+  uint32_t errors;          // Frames nobody acknowledged
+  uint32_t arbitrations;    // Frames that started with another one pending
+  uint32_t arbitrationLost; // Offers that lost arbitration
+  uint64_t bits;            // Bit times on the bus, stuffing included
+  uint64_t busyNs;
+  uint64_t maxWaitNs;       // Longest time from transmit request to start of frame
+};
+
+class MCP2515Model;
+
+class CANBusModel : public SimDevice {
+ public:
+  CANBusModel(unsigned long bitrate);
+  ~CANBusModel();
+
+  void attach(MCP2515Model &node);
+  // Bridge to a SocketCAN interface. Returns false if it can't be opened.
+  bool bridge(const char *interface);
+
+  // Queue a frame from a node outside the simulation. It always gets acknowledged.
+  bool inject(const canbus_frame &frame);
+
+  // Statistics since construction or the last reset.
+  const canbus_stats &stats(void) { return stat; }
+  void resetStats(void);
+  // Share of the time since resetStats() the bus was busy, 0-1
+  double utilization(void);
+
+  unsigned long bitrate(void) { return bps; }
+  // Bit times frame takes on the wire, from SOF to the end of the
+  // interframe space.
+  static uint16_t frameBits(const canbus_frame &frame);
+  // From SOF to the end of the CRC, the part that gets stuff bits
+  static uint16_t stuffedBits(const canbus_frame &frame);
+
+  void advance(void);
+
+ private:
+  void run(uint64_t now);
+  void finish(void);
+  void pollBridge(void);
+  void writeBridge(const canbus_frame &frame);
+
+  unsigned long bps;
+  MCP2515Model *nodes[CANBUS_MAX_NODES];
+  uint8_t nnodes;
+
+  struct {
+    canbus_frame frame;
+    uint64_t requested;
+  } external[CANBUS_EXTERNAL_QUEUE];
+  uint8_t extHead, extTail;
+
+  // The frame on the bus, if any
+  bool busy;
+  canbus_frame frame;
+  MCP2515Model *sender;   // Or NULL for an external frame
+  int8_t senderBuffer;
+  bool acked;
+  uint64_t idleSince;
+  uint64_t busyUntil;
+
+  uint64_t lastPoll;
+  bool running;
+  int socketFd;
+  canbus_stats stat;
+  uint64_t statsSince;
+};
+
+#endif
@@ -0,0 +1,541 @@
+// MCP2515 device model for the host build.
+
+#include <stdio.h>
+#include <Arduino.h>
+#include "mcp2515_model.h"
+
+// Register addresses and bits from the datasheet, kept apart from the
+// driver's own definitions so that a mistake there can't hide here.
+#define CANSTAT 0x0E
+#define CANCTRL 0x0F
+#define TEC 0x1C
+#define REC 0x1D
+#define CANINTE 0x2B
+#define CANINTF 0x2C
+#define EFLG 0x2D
+#define TXB(n) (0x30 + ((n) << 4))
+#define RXB(n) (0x60 + ((n) << 4))
+
+#define MODE_NORMAL 0x00
+#define MODE_SLEEP 0x20
+#define MODE_LOOPBACK 0x40
+#define MODE_LISTEN 0x60
+#define MODE_CONFIG 0x80
+
+#define CANCTRL_ABAT 0x10
+#define CANCTRL_OSM 0x08
+
+#define TXB_ABTF 0x40
+#define TXB_MLOA 0x20
+#define TXB_TXERR 0x10
+#define TXB_TXREQ 0x08
+#define TXB_TXP 0x03
+
+#define RXB_RXM 0x60
+#define RXB_RXRTR 0x08
+#define RXB0_BUKT 0x04
+#define RXB0_BUKT1 0x02
+
+#define SIDL_SRR 0x10
+#define SIDL_IDE 0x08
+#define DLC_RTR 0x40
+
+#define INT_RX0 0x01
+#define INT_RX1 0x02
+#define INT_TX(n) (0x04 << (n))
+#define INT_ERR 0x20
+#define INT_MERR 0x80
+
+#define EFLG_RX1OVR 0x80
+#define EFLG_RX0OVR 0x40
+#define EFLG_TXBO 0x20
+#define EFLG_TXEP 0x10
+#define EFLG_RXEP 0x08
+#define EFLG_TXWAR 0x04
+#define EFLG_RXWAR 0x02
+#define EFLG_EWARN 0x01
+
+#define INSTR_NONE 0x00
+
+MCP2515Model::MCP2515Model(uint8_t cs, uint8_t intPin)
+  : spiCommands(0), txFrames(0), rxFrames(0), overflows(0),
+    arbitrationLost(0), violations(0), cs(cs), intPin(intPin), bus(NULL),
+    intLevel(HIGH), selected(false), instruction(INSTR_NONE), count(0),
+    address(0), mask(0) {
+  reset();
+}
+
+void MCP2515Model::violation(const char *what) {
+  violations++;
+  fprintf(stderr, "MCP2515 model (CS %u): %s at %llu ns\n", cs, what,
+          (unsigned long long)sim_ns());
+}
+
+void MCP2515Model::reset(void) {
+  memset(regs, 0, sizeof(regs));
+  memset(requested, 0, sizeof(requested));
+  regs[CANSTAT] = MODE_CONFIG;
+  regs[CANCTRL] = 0x87;
+  busOff = false;
+  busOffUntil = 0;
+  updateInt();
+}
+
+uint8_t MCP2515Model::reg(uint8_t address) {
+  return read(address);
+}
+
+uint8_t MCP2515Model::read(uint8_t address) {
+  address &= 0x7F;
+  // CANSTAT and CANCTRL appear at the end of every row
+  if ((address & 0x0F) == CANSTAT) {
+    // ICOD: the highest priority enabled interrupt
+    static const uint8_t codes[8] = { 6, 7, 3, 4, 5, 1, 2, 0 };
+    static const uint8_t order[8] = { 5, 6, 2, 3, 4, 0, 1, 7 };
+    uint8_t pending = regs[CANINTE] & regs[CANINTF];
+    uint8_t icod = 0;
+    for (uint8_t i = 0; i < 7; i++) {
+      if (pending & (1 << order[i])) {
+        icod = codes[order[i]];
+        break;
+      }
+    }
+    return (regs[CANSTAT] & 0xF1) | (icod << 1);
+  }
+  if ((address & 0x0F) == CANCTRL) {
+    return regs[CANCTRL];
+  }
+  return regs[address];
+}
+
+void MCP2515Model::write(uint8_t address, uint8_t value) {
+  address &= 0x7F;
+  uint8_t low = address & 0x0F;
+  bool config = mode() == MODE_CONFIG;
+
+  if (low == CANSTAT) {
+    return;
+  }
+  if (low == CANCTRL) {
+    regs[CANCTRL] = value;
+    if (value & CANCTRL_ABAT) {
+      for (uint8_t n = 0; n < 3; n++) {
+        if (regs[TXB(n)] & TXB_TXREQ) {
+          regs[TXB(n)] = (regs[TXB(n)] & ~TXB_TXREQ) | TXB_ABTF;
+        }
+      }
+    }
+    // The real chip waits for the bus to go idle first
+    regs[CANSTAT] = (regs[CANSTAT] & 0x1F) | (value & 0xE0);
+    return;
+  }
+
+  if (address < 0x0C || (address >= 0x10 && address < 0x1C) ||
+      (address >= 0x20 && address <= 0x2A)) {
+    // Filters, masks and bit timing
+    if (!config) {
+      violation("configuration register written outside configuration mode");
+      return;
+    }
+    regs[address] = value;
+  } else if (address == TEC || address == REC) {
+    violation("write to a read only error counter");
+  } else if (address == EFLG) {
+    regs[EFLG] = (regs[EFLG] & 0x3F) | (value & 0xC0);
+  } else if (address == TXB(0) || address == TXB(1) || address == TXB(2)) {
+    uint8_t n = (address - TXB(0)) >> 4;
+    uint8_t old = regs[address];
+    regs[address] = (old & ~(TXB_TXREQ | TXB_TXP)) | (value & (TXB_TXREQ | TXB_TXP));
+    if ((value & TXB_TXREQ) && !(old & TXB_TXREQ)) {
+      regs[address] &= ~(TXB_ABTF | TXB_MLOA | TXB_TXERR);
+      requested[n] = sim_ns();
+    }
+  } else if (address > TXB(0) && address < RXB(0) && (low < 0x0E)) {
+    uint8_t n = (address - TXB(0)) >> 4;
+    if (regs[TXB(n)] & TXB_TXREQ) {
+      violation("transmit buffer written with TXREQ set");
+      return;
+    }
+    regs[address] = value;
+  } else if (address == RXB(0)) {
+    regs[address] = (regs[address] & ~(RXB_RXM | RXB0_BUKT | RXB0_BUKT1)) |
+                    (value & (RXB_RXM | RXB0_BUKT)) |
+                    ((value & RXB0_BUKT) ? RXB0_BUKT1 : 0);
+  } else if (address == RXB(1)) {
+    regs[address] = (regs[address] & ~RXB_RXM) | (value & RXB_RXM);
+  } else if (address > RXB(0)) {
+    // Receive buffers are read only
+  } else {
+    regs[address] = value;
+  }
+  updateInt();
+}
+
+uint8_t MCP2515Model::readStatus(void) {
+  uint8_t intf = regs[CANINTF];
+  uint8_t status = intf & (INT_RX0 | INT_RX1);
+  for (uint8_t n = 0; n < 3; n++) {
+    if (regs[TXB(n)] & TXB_TXREQ) {
+      status |= 0x04 << (n << 1);
+    }
+    if (intf & INT_TX(n)) {
+      status |= 0x08 << (n << 1);
+    }
+  }
+  return status;
+}
+
+uint8_t MCP2515Model::rxStatus(void) {
+  uint8_t intf = regs[CANINTF];
+  uint8_t status = (intf & (INT_RX0 | INT_RX1)) << 6;
+  // Type and filter of the frame in RXB0, or in RXB1 if RXB0 is empty
+  int8_t n = (intf & INT_RX0) ? 0 : (intf & INT_RX1) ? 1 : -1;
+  if (n >= 0) {
+    uint8_t base = RXB(n);
+    bool ext = regs[base + 2] & SIDL_IDE;
+    bool rtr = regs[base] & RXB_RXRTR;
+    status |= (ext ? 0x10 : 0) | (rtr ? 0x08 : 0);
+    status |= n == 0 ? regs[base] & 0x01 : regs[base] & 0x07;
+  }
+  return status;
+}
+
+void MCP2515Model::pinChanged(uint8_t pin, uint8_t level) {
+  if (pin != cs) {
+    return;
+  }
+  if (!level && !selected) {
+    selected = true;
+    instruction = INSTR_NONE;
+    count = 0;
+  } else if (level && selected) {
+    selected = false;
+    endCommand();
+  }
+}
+
+void MCP2515Model::endCommand(void) {
+  // READ RX BUFFER clears the buffer's flag when CS goes high
+  if ((instruction & 0xF9) == 0x90 && count > 1) {
+    regs[CANINTF] &= (instruction & 0x04) ? ~INT_RX1 : ~INT_RX0;
+    updateInt();
+  } else if (instruction == 0x05 && count > 1 && count < 4) {
+    violation("BIT MODIFY cut short");
+  }
+  instruction = INSTR_NONE;
+}
+
+int8_t MCP2515Model::pinLevel(uint8_t pin) {
+  return pin == intPin ? intLevel : -1;
+}
+
+int16_t MCP2515Model::spiTransfer(uint8_t mosi) {
+  if (!selected) {
+    return -1;
+  }
+  count++;
+  if (count == 1) {
+    instruction = mosi;
+    spiCommands++;
+    if (mosi == 0xC0) {
+      reset();
+    } else if ((mosi & 0xF9) == 0x90) {
+      // RXBnSIDH or RXBnD0
+      address = RXB(mosi >> 2 & 1) + ((mosi & 0x02) ? 6 : 1);
+    } else if (mosi >= 0x40 && mosi <= 0x45) {
+      address = TXB(mosi >> 1 & 3) + ((mosi & 0x01) ? 6 : 1);
+    } else if ((mosi & 0xF8) == 0x80) {
+      for (uint8_t n = 0; n < 3; n++) {
+        if (mosi & (1 << n)) {
+          write(TXB(n), regs[TXB(n)] | TXB_TXREQ);
+        }
+      }
+    } else if (mosi != 0x03 && mosi != 0x02 && mosi != 0x05 && mosi != 0xA0 &&
+               mosi != 0xB0) {
+      violation("unknown instruction");
+    }
+    return 0xFF;
+  }
+
+  switch (instruction) {
+  case 0x03:
+    if (count == 2) {
+      address = mosi;
+      return 0xFF;
+    }
+    return read(address++);
+  case 0x02:
+    if (count == 2) {
+      address = mosi;
+    } else {
+      write(address++, mosi);
+    }
+    return 0xFF;
+  case 0x05:
+    if (count == 2) {
+      address = mosi;
+    } else if (count == 3) {
+      mask = mosi;
+    } else if (count == 4) {
+      write(address, (read(address) & ~mask) | (mosi & mask));
+    }
+    return 0xFF;
+  case 0xA0:
+    return readStatus();
+  case 0xB0:
+    return rxStatus();
+  default:
+    if ((instruction & 0xF9) == 0x90) {
+      return read(address++);
+    }
+    if (instruction >= 0x40 && instruction <= 0x45) {
+      write(address++, mosi);
+    }
+    return 0xFF;
+  }
+}
+
+void MCP2515Model::load(uint8_t n, canbus_frame &frame) {
+  const uint8_t *r = &regs[TXB(n) + 1];
+  uint16_t sid = (r[0] << 3) | (r[1] >> 5);
+  frame.ext = r[1] & SIDL_IDE;
+  if (frame.ext) {
+    frame.id = ((uint32_t)sid << 18) | ((uint32_t)(r[1] & 0x03) << 16) | (r[2] << 8) | r[3];
+  } else {
+    frame.id = sid;
+  }
+  frame.rtr = r[4] & DLC_RTR;
+  // A DLC above 8 is sent as is but carries 8 bytes
+  frame.len = r[4] & 0x0F;
+  memcpy(frame.data, &r[5], 8);
+}
+
+int8_t MCP2515Model::offer(canbus_frame &frame, uint64_t &when) {
+  if (mode() != MODE_NORMAL || busOff) {
+    return -1;
+  }
+  int8_t best = -1;
+  for (int8_t n = 2; n >= 0; n--) {
+    uint8_t ctrl = regs[TXB(n)];
+    if ((ctrl & TXB_TXREQ) &&
+        (best < 0 || (ctrl & TXB_TXP) > (regs[TXB(best)] & TXB_TXP))) {
+      best = n;
+    }
+  }
+  if (best >= 0) {
+    load(best, frame);
+    when = requested[best];
+  }
+  return best;
+}
+
+void MCP2515Model::lostArbitration(uint8_t n) {
+  regs[TXB(n)] |= TXB_MLOA;
+  arbitrationLost++;
+}
+
+void MCP2515Model::transmitted(uint8_t n, bool acknowledged) {
+  uint8_t &ctrl = regs[TXB(n)];
+
+  if (acknowledged) {
+    ctrl &= ~(TXB_TXREQ | TXB_TXERR | TXB_MLOA);
+    regs[CANINTF] |= INT_TX(n);
+    if (regs[TEC]) {
+      regs[TEC]--;
+    }
+    txFrames++;
+  } else {
+    ctrl |= TXB_TXERR;
+    regs[CANINTF] |= INT_MERR;
+    // An error passive transmitter that sees no ACK doesn't count it, so a
+    // node alone on the bus stays error passive instead of going bus off.
+    if (!(regs[EFLG] & EFLG_TXEP)) {
+      if (regs[TEC] > 255 - 8) {
+        regs[TEC] = 255;
+        busOff = true;
+        busOffUntil = sim_ns() + 128ULL * 11 * 1000000000ULL / bus->bitrate();
+      } else {
+        regs[TEC] += 8;
+      }
+    }
+    if (regs[CANCTRL] & CANCTRL_OSM) {
+      ctrl = (ctrl & ~TXB_TXREQ) | TXB_ABTF;
+    }
+  }
+  updateErrors();
+  updateInt();
+}
+
+bool MCP2515Model::matches(uint8_t filter, uint8_t maskAddress, const canbus_frame &frame) {
+  const uint8_t *f = &regs[filter];
+  const uint8_t *m = &regs[maskAddress];
+  // Filters only match the frame format their EXIDE bit selects
+  if (!(f[1] & SIDL_IDE) != !frame.ext) {
+    return false;
+  }
+  uint32_t fv = ((uint32_t)f[0] << 21) | ((uint32_t)(f[1] & 0xE0) << 13) |
+                ((uint32_t)(f[1] & 0x03) << 16) | (f[2] << 8) | f[3];
+  uint32_t mv = ((uint32_t)m[0] << 21) | ((uint32_t)(m[1] & 0xE0) << 13) |
+                ((uint32_t)(m[1] & 0x03) << 16) | (m[2] << 8) | m[3];
+  uint32_t id;
+  if (frame.ext) {
+    id = frame.id;
+  } else {
+    // For standard frames the EID bits of EID8 and EID0 filter on the first
+    // two data bytes.
+    id = frame.id << 18;
+    id |= (uint32_t)(frame.len > 0 && !frame.rtr ? frame.data[0] : 0) << 8;
+    id |= frame.len > 1 && !frame.rtr ? frame.data[1] : 0;
+  }
+  return ((id ^ fv) & mv) == 0;
+}
+
+int8_t MCP2515Model::hit(uint8_t first, uint8_t n, uint8_t maskAddress,
+                         const canbus_frame &frame) {
+  for (uint8_t i = first; i < first + n; i++) {
+    uint8_t filter = ((i + (i >= 3)) << 2);
+    if (matches(filter, maskAddress, frame)) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+void MCP2515Model::store(uint8_t buffer, uint8_t filter, const canbus_frame &frame) {
+  uint8_t *r = &regs[RXB(buffer)];
+  if (frame.ext) {
+    uint16_t sid = frame.id >> 18;
+    r[1] = sid >> 3;
+    r[2] = ((sid & 0x07) << 5) | SIDL_IDE | ((frame.id >> 16) & 0x03);
+    r[3] = frame.id >> 8;
+    r[4] = frame.id;
+    r[5] = (frame.rtr ? DLC_RTR : 0) | frame.len;
+  } else {
+    r[1] = frame.id >> 3;
+    r[2] = ((frame.id & 0x07) << 5) | (frame.rtr ? SIDL_SRR : 0);
+    r[3] = 0;
+    r[4] = 0;
+    r[5] = frame.len;
+  }
+  memset(&r[6], 0, 8);
+  if (!frame.rtr) {
+    memcpy(&r[6], frame.data, frame.len > 8 ? 8 : frame.len);
+  }
+  if (buffer == 0) {
+    r[0] = (r[0] & ~(RXB_RXRTR | 0x01)) | (frame.rtr ? RXB_RXRTR : 0) | (filter & 0x01);
+  } else {
+    r[0] = (r[0] & ~(RXB_RXRTR | 0x07)) | (frame.rtr ? RXB_RXRTR : 0) | filter;
+  }
+  regs[CANINTF] |= buffer == 0 ? INT_RX0 : INT_RX1;
+  rxFrames++;
+}
+
+void MCP2515Model::received(const canbus_frame &frame) {
+  uint8_t m = mode();
+  if (m != MODE_NORMAL && m != MODE_LISTEN && m != MODE_LOOPBACK) {
+    return;
+  }
+  if (regs[REC] > 127) {
+    regs[REC] = 120;
+  } else if (regs[REC]) {
+    regs[REC]--;
+  }
+
+  uint8_t intf = regs[CANINTF];
+  int8_t filter = (regs[RXB(0)] & RXB_RXM) == RXB_RXM ? 0 : hit(0, 2, 0x20, frame);
+  if (filter >= 0) {
+    if (!(intf & INT_RX0)) {
+      store(0, filter, frame);
+    } else if (regs[RXB(0)] & RXB0_BUKT) {
+      // Rolled over: FILHIT in RXB1 still names the RXB0 filter
+      if (!(intf & INT_RX1)) {
+        store(1, filter, frame);
+      } else {
+        regs[EFLG] |= EFLG_RX1OVR;
+        regs[CANINTF] |= INT_ERR;
+        overflows++;
+      }
+    } else {
+      regs[EFLG] |= EFLG_RX0OVR;
+      regs[CANINTF] |= INT_ERR;
+      overflows++;
+    }
+  } else {
+    filter = (regs[RXB(1)] & RXB_RXM) == RXB_RXM ? 2 : hit(2, 4, 0x24, frame);
+    if (filter >= 0) {
+      if (!(intf & INT_RX1)) {
+        store(1, filter, frame);
+      } else {
+        regs[EFLG] |= EFLG_RX1OVR;
+        regs[CANINTF] |= INT_ERR;
+        overflows++;
+      }
+    }
+  }
+  updateErrors();
+  updateInt();
+}
+
+bool MCP2515Model::acknowledges(void) {
+  return mode() == MODE_NORMAL && !busOff;
+}
+
+bool MCP2515Model::listening(void) {
+  return (mode() == MODE_NORMAL || mode() == MODE_LISTEN) && !busOff;
+}
+
+void MCP2515Model::advance(void) {
+  if (busOff && sim_ns() >= busOffUntil) {
+    busOff = false;
+    regs[TEC] = 0;
+    regs[REC] = 0;
+    updateErrors();
+    updateInt();
+  }
+  if (mode() != MODE_LOOPBACK) {
+    return;
+  }
+  // Loopback frames go straight to the receive buffers
+  for (int8_t n = 2; n >= 0; n--) {
+    if (regs[TXB(n)] & TXB_TXREQ) {
+      canbus_frame frame;
+      load(n, frame);
+      received(frame);
+      transmitted(n, true);
+    }
+  }
+}
+
+void MCP2515Model::updateErrors(void) {
+  uint8_t tec = regs[TEC];
+  uint8_t rec = regs[REC];
+  uint8_t flags = 0;
+
+  if (tec >= 96) {
+    flags |= EFLG_TXWAR | EFLG_EWARN;
+  }
+  if (rec >= 96) {
+    flags |= EFLG_RXWAR | EFLG_EWARN;
+  }
+  if (tec >= 128) {
+    flags |= EFLG_TXEP;
+  }
+  if (rec >= 128) {
+    flags |= EFLG_RXEP;
+  }
+  if (busOff) {
+    flags |= EFLG_TXBO;
+  }
+  if ((regs[EFLG] & 0x3F) != flags) {
+    regs[CANINTF] |= INT_ERR;
+  }
+  regs[EFLG] = (regs[EFLG] & 0xC0) | flags;
+}
+
+void MCP2515Model::updateInt(void) {
+  uint8_t level = (regs[CANINTE] & regs[CANINTF]) ? LOW : HIGH;
+  if (level != intLevel) {
+    intLevel = level;
+    sim_input_changed(intPin, level);
+  }
+}
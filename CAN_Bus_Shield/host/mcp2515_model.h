@@ -0,0 +1,82 @@
+// MCP2515 device model for the host build.
+//
+// Registers and the SPI instruction set: RESET, READ, WRITE, READ RX
+// BUFFER, LOAD TX BUFFER, RTS, READ STATUS, RX STATUS and BIT MODIFY.
+// Transmit requests are offered to a CANBusModel by TXP and buffer
+// number; received frames go through the masks and filters into the two
+// receive buffers, with RXB0 rolling over into RXB1 when BUKT is set.
+// INT is driven low while an enabled interrupt flag is set. The error
+// counters follow ISO 11898 for the one error the bus produces, a frame
+// nobody acknowledges.
+//
+// Mode changes take effect at once. Configuration registers written
+// outside configuration mode are ignored, as on the chip, and counted in
+// violations.
+
+#ifndef _MCP2515_MODEL_H_INCLUDED
+#define _MCP2515_MODEL_H_INCLUDED
+
+#include "canbus_model.h"
+
+class MCP2515Model : public SimDevice {
+ public:
+  MCP2515Model(uint8_t cs, uint8_t intPin);
+
+  uint8_t reg(uint8_t address);
+  uint8_t mode(void) { return regs[0x0E] & 0xE0; }
+
+  uint32_t spiCommands;   // Instructions received
+  uint32_t txFrames;      // Frames sent
+  uint32_t rxFrames;      // Frames accepted into a receive buffer
+  uint32_t overflows;     // Accepted frames lost for lack of a free buffer
+  uint32_t arbitrationLost;
+  uint32_t violations;
+
+  void pinChanged(uint8_t pin, uint8_t level);
+  int8_t pinLevel(uint8_t pin);
+  int16_t spiTransfer(uint8_t mosi);
+  // Bus off recovery, and loopback mode transmissions
+  void advance(void);
+
+  // For CANBusModel
+  void setBus(CANBusModel *bus) { this->bus = bus; }
+  // The buffer to send next, its frame and when it was requested, or -1
+  int8_t offer(canbus_frame &frame, uint64_t &requested);
+  void lostArbitration(uint8_t n);
+  void transmitted(uint8_t n, bool acknowledged);
+  void received(const canbus_frame &frame);
+  // Normal mode and not bus off: takes part in acknowledging frames
+  bool acknowledges(void);
+  bool listening(void);
+
+ private:
+  void violation(const char *what);
+  void reset(void);
+  uint8_t read(uint8_t address);
+  void write(uint8_t address, uint8_t value);
+  void endCommand(void);
+  uint8_t readStatus(void);
+  uint8_t rxStatus(void);
+  bool matches(uint8_t filter, uint8_t mask, const canbus_frame &frame);
+  int8_t hit(uint8_t first, uint8_t count, uint8_t mask, const canbus_frame &frame);
+  void store(uint8_t buffer, uint8_t filter, const canbus_frame &frame);
+  void load(uint8_t n, canbus_frame &frame);
+  void updateErrors(void);
+  void updateInt(void);
+
+  uint8_t cs, intPin;
+  CANBusModel *bus;
+  uint8_t regs[128];
+  uint64_t requested[3];    // sim_ns() of each buffer's transmit request
+  bool busOff;
+  uint64_t busOffUntil;     // sim_ns() when 128 x 11 recessive bits have passed
+  uint8_t intLevel;
+
+  bool selected;
+  uint8_t instruction;
+  uint8_t count;            // Bytes since CS fell
+  uint8_t address;
+  uint8_t mask;             // BIT MODIFY
+};
+
+#endif
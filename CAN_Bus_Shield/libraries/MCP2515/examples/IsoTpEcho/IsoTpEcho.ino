@@ -0,0 +1,62 @@
+/*
+  ISO-TP Echo
+
+  Answers every ISO-TP message received on 0x7E0 by sending it back on
+  0x7E8, up to 512 bytes at a time. With can-utils on a Linux host:
+
+    isotpsend -s 7E0 -d 7E8 can0 < request
+    isotprecv -s 7E0 -d 7E8 can0
+
+ The circuit:
+  * CAN-BUS Shield: CS on D9, INT on D2
+  * 500 kbps bus
+
+*/
+
+#include <SPI.h>
+#include <mcp2515.h>
+#include <canreceiver.h>
+#include <isotp.h>
+
+MCP2515 CAN(9);
+CANReceiver receiver(CAN, 2);
+
+const uint32_t ids[] = { 0x7E0 };
+
+// One buffer: a message is echoed from where it was received, and the
+// next is not accepted until the echo has gone out.
+uint8_t buffer[512];
+ISOTP link(CAN, 0x7E8, 0x7E0, buffer, sizeof(buffer));
+
+void setup() {
+  Serial.begin(115200);
+  while (!CAN.begin(CAN_500KBPS)) {
+    Serial.println("CAN init failed");
+    delay(100);
+  }
+  receiver.begin(ids, 1);
+}
+
+void loop() {
+  static bool echoing;
+  const can_msg *msg;
+
+  while ((msg = receiver.peek())) {
+    link.receive(*msg);
+    receiver.pop();
+  }
+  link.poll();
+
+  if (echoing && !link.sending()) {
+    echoing = false;
+    link.release();
+    if (link.txStatus() != ISOTP_OK) {
+      Serial.print("send failed: ");
+      Serial.println(link.txStatus());
+    }
+  }
+  uint16_t length = link.available();
+  if (length && !echoing) {
+    echoing = link.send(buffer, length);
+  }
+}
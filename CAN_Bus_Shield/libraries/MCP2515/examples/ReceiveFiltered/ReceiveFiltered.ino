@@ -0,0 +1,50 @@
+/*
+  Receive Filtered
+
+  Receives the frames listed in wanted[] from the MCP2515 interrupt and
+  prints them, one line per frame: identifier, length and data in hex.
+  Everything else on the bus is rejected by the controller's filters.
+
+ The circuit:
+  * CAN-BUS Shield: CS on D9, INT on D2
+  * 500 kbps bus
+
+*/
+
+#include <SPI.h>
+#include <mcp2515.h>
+#include <canreceiver.h>
+
+MCP2515 CAN(9);
+CANReceiver receiver(CAN, 2);
+
+const uint32_t wanted[] = {
+  0x70,
+  0x71,
+  0x18FEF100 | CAN_MSG_EXT,
+};
+
+void setup() {
+  Serial.begin(115200);
+  while (!CAN.begin(CAN_500KBPS)) {
+    Serial.println("CAN init failed");
+    delay(100);
+  }
+  receiver.begin(wanted, sizeof(wanted) / sizeof(wanted[0]));
+}
+
+void loop() {
+  const can_msg *msg;
+  while ((msg = receiver.peek())) {
+    Serial.print(msg->id & CAN_MSG_ID_MASK, HEX);
+    Serial.print(msg->id & CAN_MSG_EXT ? "x [" : " [");
+    Serial.print(msg->len);
+    Serial.print(']');
+    for (uint8_t i = 0; i < msg->len; i++) {
+      Serial.print(' ');
+      Serial.print(msg->data[i], HEX);
+    }
+    Serial.println();
+    receiver.pop();
+  }
+}
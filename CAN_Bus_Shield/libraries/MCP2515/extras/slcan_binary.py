@@ -0,0 +1,132 @@
+#!/usr/bin/env python3
+"""Bridge an SLCAN gateway in binary framing mode to a SocketCAN interface.
+
+slcand only speaks the text protocol. This opens the gateway's serial port,
+sets the bit rate, opens the channel, switches it to the binary framing
+described in src/slcan.h and then copies frames both ways between the port
+and a SocketCAN interface, typically a vcan:
+
+    ip link add dev vcan0 type vcan && ip link set vcan0 up
+    ./slcan_binary.py /dev/ttyACM0 vcan0
+    candump vcan0
+"""
+
+import argparse
+import os
+import select
+import socket
+import struct
+import sys
+import termios
+import time
+import tty
+
+SYNC = 0xAA
+BIN_EXT = 0x80
+BIN_RTR = 0x40
+TO_TEXT = 0xFF
+
+CAN_EFF_FLAG = 0x80000000
+CAN_RTR_FLAG = 0x40000000
+CAN_ERR_FLAG = 0x20000000
+CAN_FRAME = struct.Struct("=IB3x8s")
+
+BAUDS = {115200: termios.B115200, 500000: termios.B500000, 1000000: termios.B1000000,
+         2000000: termios.B2000000}
+RATES = {"50k": 2, "100k": 3, "125k": 4, "250k": 5, "500k": 6, "1M": 8}
+
+
+def open_port(path, baud):
+    fd = os.open(path, os.O_RDWR | os.O_NOCTTY)
+    tty.setraw(fd)
+    attrs = termios.tcgetattr(fd)
+    attrs[4] = attrs[5] = BAUDS[baud]
+    termios.tcsetattr(fd, termios.TCSANOW, attrs)
+    # The board resets when the port opens
+    time.sleep(2)
+    termios.tcflush(fd, termios.TCIOFLUSH)
+    return fd
+
+
+def encode(can_id, data):
+    """SocketCAN frame -> binary framing"""
+    ext = bool(can_id & CAN_EFF_FLAG)
+    rtr = bool(can_id & CAN_RTR_FLAG)
+    flags = (BIN_EXT if ext else 0) | (BIN_RTR if rtr else 0) | len(data)
+    ident = can_id & (0x1FFFFFFF if ext else 0x7FF)
+    out = bytes([SYNC, flags]) + ident.to_bytes(4 if ext else 2, "little")
+    return out if rtr else out + data
+
+
+class Decoder:
+    """Binary framing from the port -> (can_id, dlc, data)"""
+
+    def __init__(self):
+        self.buf = bytearray()
+
+    def feed(self, data):
+        self.buf += data
+        frames = []
+        while True:
+            start = self.buf.find(SYNC)
+            if start < 0:
+                self.buf.clear()
+                return frames
+            del self.buf[:start]
+            if len(self.buf) < 2:
+                return frames
+            flags = self.buf[1]
+            dlc = flags & 0x0F
+            if flags & 0x30 or dlc > 8:
+                del self.buf[:1]
+                continue
+            ext = bool(flags & BIN_EXT)
+            rtr = bool(flags & BIN_RTR)
+            id_len = 4 if ext else 2
+            size = 2 + id_len + (0 if rtr else dlc)
+            if len(self.buf) < size:
+                return frames
+            can_id = int.from_bytes(self.buf[2:2 + id_len], "little")
+            data = bytes(self.buf[2 + id_len:size])
+            if ext:
+                can_id |= CAN_EFF_FLAG
+            if rtr:
+                can_id |= CAN_RTR_FLAG
+            frames.append((can_id, dlc, data))
+            del self.buf[:size]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("port", help="serial port of the gateway")
+    parser.add_argument("interface", help="SocketCAN interface, e.g. vcan0")
+    parser.add_argument("--baud", type=int, default=1000000, choices=sorted(BAUDS))
+    parser.add_argument("--rate", default="500k", choices=list(RATES), help="CAN bit rate")
+    args = parser.parse_args()
+
+    sock = socket.socket(socket.AF_CAN, socket.SOCK_RAW, socket.CAN_RAW)
+    sock.bind((args.interface,))
+    fd = open_port(args.port, args.baud)
+    os.write(fd, b"\r\rC\rS%d\rO\rB1\r" % RATES[args.rate])
+
+    decoder = Decoder()
+    try:
+        while True:
+            ready, _, _ = select.select([fd, sock], [], [])
+            if fd in ready:
+                for can_id, dlc, data in decoder.feed(os.read(fd, 4096)):
+                    sock.send(CAN_FRAME.pack(can_id, dlc, data.ljust(8, b"\0")))
+            if sock in ready:
+                can_id, dlc, data = CAN_FRAME.unpack(sock.recv(CAN_FRAME.size))
+                if not can_id & CAN_ERR_FLAG:
+                    os.write(fd, encode(can_id, data[:dlc]))
+    except KeyboardInterrupt:
+        pass
+    finally:
+        os.write(fd, bytes([SYNC, TO_TEXT]) + b"C\r")
+        os.close(fd)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
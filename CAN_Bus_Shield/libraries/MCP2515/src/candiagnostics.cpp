@@ -0,0 +1,86 @@
+// Bus load and error counter instrumentation for the MCP2515.
+
+#include "candiagnostics.h"
+
+CANDiagnostics::CANDiagnostics(MCP2515 &can) : can(can) {
+  memset(&diag, 0, sizeof(diag));
+  last = millis();
+  lastTxFrames = lastRxFrames = lastBits = 0;
+}
+
+bool CANDiagnostics::poll(void) {
+  unsigned long now = millis();
+  if (now - last < CAN_DIAG_PERIOD_MS) {
+    return false;
+  }
+  unsigned long elapsed = now - last;
+  last += CAN_DIAG_PERIOD_MS;
+  if (now - last >= CAN_DIAG_PERIOD_MS) {
+    // Not polled for a while: start over from now
+    last = now;
+  }
+
+  // TEC and REC are consecutive
+  uint8_t counters[2];
+  can.readRegisters(MCP2515_TEC, counters, 2);
+  diag.tec = counters[0];
+  diag.rec = counters[1];
+  diag.eflg = can.readRegister(MCP2515_EFLG);
+
+  // The overflow flags and MERRF stay set until cleared
+  if (diag.eflg & (MCP2515_EFLG_RX0OVR | MCP2515_EFLG_RX1OVR)) {
+    diag.rxOverflows++;
+    can.modifyRegister(MCP2515_EFLG, MCP2515_EFLG_RX0OVR | MCP2515_EFLG_RX1OVR, 0);
+  }
+  if (can.readRegister(MCP2515_CANINTF) & MCP2515_INT_MERR) {
+    diag.messageErrors++;
+    can.modifyRegister(MCP2515_CANINTF, MCP2515_INT_MERR, 0);
+  }
+
+  uint8_t state = CAN_ERROR_ACTIVE;
+  if (diag.eflg & MCP2515_EFLG_TXBO) {
+    state = CAN_BUS_OFF;
+  } else if (diag.eflg & (MCP2515_EFLG_TXEP | MCP2515_EFLG_RXEP)) {
+    state = CAN_ERROR_PASSIVE;
+  }
+  if (state > diag.state) {
+    if (state == CAN_BUS_OFF) {
+      diag.busOff++;
+    } else {
+      diag.errorPassive++;
+    }
+  }
+  diag.state = state;
+
+  mcp2515_counters &t = diag.traffic;
+  can.counters(t);
+  unsigned long bits = t.txBits + t.rxBits;
+  diag.txFramesPerSecond = (t.txFrames - lastTxFrames) * 1000UL / elapsed;
+  diag.rxFramesPerSecond = (t.rxFrames - lastRxFrames) * 1000UL / elapsed;
+  // Bit times in one permille of the elapsed time
+  unsigned long perMille = can.bitrate() / 1000 * elapsed / 1000;
+  diag.busLoad = perMille ? (bits - lastBits) / perMille : 0;
+  lastTxFrames = t.txFrames;
+  lastRxFrames = t.rxFrames;
+  lastBits = bits;
+  return true;
+}
+
+void CANDiagnostics::attach(can_tx_entry &entry) {
+  entry.payload = payload;
+  entry.context = this;
+}
+
+uint8_t CANDiagnostics::payload(const can_tx_entry *entry, uint8_t *data) {
+  const can_diagnostics &d = ((CANDiagnostics *)entry->context)->diag;
+  uint16_t load = d.busLoad / 5;
+  data[0] = d.tec;
+  data[1] = d.rec;
+  data[2] = d.eflg;
+  data[3] = load > 255 ? 255 : load;
+  data[4] = d.txFramesPerSecond;
+  data[5] = d.txFramesPerSecond >> 8;
+  data[6] = d.rxFramesPerSecond;
+  data[7] = d.rxFramesPerSecond >> 8;
+  return 8;
+}
@@ -0,0 +1,66 @@
+// Bus load and error counter instrumentation for the MCP2515.
+//
+// poll() takes a sample once a second: the transmit and receive error
+// counters, EFLG, and the driver's traffic counters, from which it works
+// out frame rates and bus utilization over that second. The results are
+// in a can_diagnostics struct, and can also go out as a diagnostic frame
+// in a CANTxScheduler table, see attach().
+//
+// Utilization counts the frames this node sends and the frames its
+// filters accept, at their unstuffed length, so it is a lower bound for
+// the bus as a whole unless the filters accept everything.
+
+#ifndef _CANDIAGNOSTICS_H_INCLUDED
+#define _CANDIAGNOSTICS_H_INCLUDED
+
+#include "cantxscheduler.h"
+
+#define CAN_DIAG_PERIOD_MS 1000
+
+enum can_error_state {
+  CAN_ERROR_ACTIVE = 0,
+  CAN_ERROR_PASSIVE,  // TEC or REC above 127
+  CAN_BUS_OFF         // TEC above 255, the controller stopped sending
+};
+
+struct can_diagnostics {
+  uint8_t tec;
+  uint8_t rec;
+  uint8_t eflg;
+  uint8_t state;              // can_error_state
+  uint16_t busLoad;           // Permille of the last second
+  uint16_t txFramesPerSecond;
+  uint16_t rxFramesPerSecond;
+  uint16_t errorPassive;      // Times the controller went error passive
+  uint16_t busOff;            // Times it went bus off
+  uint16_t rxOverflows;       // Samples with a frame lost for lack of a receive buffer
+  uint16_t messageErrors;     // Samples with a frame that failed on the bus
+  mcp2515_counters traffic;   // Totals since MCP2515::begin()
+};
+
+class CANDiagnostics {
+ public:
+  CANDiagnostics(MCP2515 &can);
+
+  // Take a sample if a period is up. Returns true if it did.
+  bool poll(void);
+  const can_diagnostics &read(void) { return diag; }
+
+  // Make entry the diagnostic frame: TEC, REC, EFLG, bus load in 0.5%
+  // steps, then transmitted and received frames per second as 16 bit
+  // little endian values. Call before CANTxScheduler::begin().
+  void attach(can_tx_entry &entry);
+
+  // can_tx_payload for the attached entry
+  static uint8_t payload(const can_tx_entry *entry, uint8_t *data);
+
+ private:
+  MCP2515 &can;
+  can_diagnostics diag;
+  unsigned long last;
+  unsigned long lastTxFrames;
+  unsigned long lastRxFrames;
+  unsigned long lastBits;
+};
+
+#endif
@@ -0,0 +1,188 @@
+// Interrupt driven CAN reception into a ring of frames.
+
+#include "canreceiver.h"
+
+static_assert(CAN_RX_DEPTH <= 128 && !(CAN_RX_DEPTH & (CAN_RX_DEPTH - 1)),
+              "CAN_RX_DEPTH must be a power of two up to 128");
+
+// Which identifiers a filter group takes
+#define IDS_ANY 0
+#define IDS_STD 1
+#define IDS_EXT 2
+
+CANReceiver *CANReceiver::active = 0;
+
+CANReceiver::CANReceiver(MCP2515 &can, uint8_t intPin) : can(can), intPin(intPin) {
+  ids = 0;
+  count = 0;
+  checkIds = false;
+  head = tail = 0;
+  dropped = unwanted = 0;
+}
+
+bool CANReceiver::begin(const uint32_t *ids, uint8_t count) {
+  this->ids = ids;
+  this->count = count;
+  checkIds = false;
+
+  uint8_t mode = can.readRegister(MCP2515_CANSTAT) & MCP2515_MODE_MASK;
+  if (!can.setMode(MCP2515_MODE_CONFIG)) {
+    return false;
+  }
+
+  if (count) {
+    // RXB0 has mask 0 and filters 0-1, RXB1 mask 1 and filters 2-5. With
+    // rollover, a frame either buffer accepts lands in whichever is free.
+    bool std = false;
+    bool ext = false;
+    for (uint8_t i = 0; i < count; i++) {
+      if (ids[i] & CAN_MSG_EXT) {
+        ext = true;
+      } else {
+        std = true;
+      }
+    }
+    bool exact;
+    if (count <= 6) {
+      // A single identifier leaves group 1 empty, program() repeats it there
+      exact = program(0, 0, count < 2 ? count : 2, IDS_ANY);
+      exact &= program(1, 2, count, IDS_ANY);
+    } else if (std && ext) {
+      exact = program(0, 0, count, IDS_STD);
+      exact &= program(1, 0, count, IDS_EXT);
+    } else {
+      exact = program(0, 0, count / 2, IDS_ANY);
+      exact &= program(1, count / 2, count, IDS_ANY);
+    }
+    checkIds = !exact;
+    can.writeRegister(MCP2515_RXBCTRL(0), MCP2515_RXB_FILTERED | MCP2515_RXB_BUKT);
+    can.writeRegister(MCP2515_RXBCTRL(1), MCP2515_RXB_FILTERED);
+  } else {
+    can.writeRegister(MCP2515_RXBCTRL(0), MCP2515_RXB_ANY | MCP2515_RXB_BUKT);
+    can.writeRegister(MCP2515_RXBCTRL(1), MCP2515_RXB_ANY);
+  }
+  can.modifyRegister(MCP2515_CANINTE, MCP2515_INT_RX0 | MCP2515_INT_RX1,
+                     MCP2515_INT_RX0 | MCP2515_INT_RX1);
+  if (!can.setMode(mode)) {
+    return false;
+  }
+
+  uint8_t interrupt = digitalPinToInterrupt(intPin);
+  pinMode(intPin, INPUT);
+  SPI.usingInterrupt(interrupt);
+  uint8_t oldSREG = SREG;
+  cli();
+  active = this;
+  attachInterrupt(interrupt, isr, FALLING);
+  // INT may already be low, in which case there will be no falling edge
+  drain();
+  SREG = oldSREG;
+  return true;
+}
+
+void CANReceiver::end(void) {
+  uint8_t interrupt = digitalPinToInterrupt(intPin);
+  detachInterrupt(interrupt);
+  SPI.notUsingInterrupt(interrupt);
+  can.modifyRegister(MCP2515_CANINTE, MCP2515_INT_RX0 | MCP2515_INT_RX1, 0);
+  active = 0;
+}
+
+// Program mask group and its filters for the identifiers in ids[from..to)
+// of the given type. Returns true if the hardware accepts exactly those.
+bool CANReceiver::program(uint8_t group, uint8_t from, uint8_t to, uint8_t type) {
+  uint8_t slots = group ? 4 : 2;
+  uint8_t first = group ? 2 : 0;
+  uint8_t filters[4][4];
+  uint8_t mask[4] = { 0xFF, 0xE3, 0xFF, 0xFF };
+  uint8_t members = 0;
+  bool std = false;
+  bool ext = false;
+
+  for (uint8_t i = from; i < to; i++) {
+    bool isExt = ids[i] & CAN_MSG_EXT;
+    if ((type == IDS_STD && isExt) || (type == IDS_EXT && !isExt)) {
+      continue;
+    }
+    uint8_t regs[4];
+    MCP2515::encodeId(ids[i], regs);
+    if (members < slots) {
+      memcpy(filters[members], regs, 4);
+    }
+    // Clear the bits this identifier disagrees with the first on
+    for (uint8_t k = 0; k < 4; k++) {
+      mask[k] &= ~(regs[k] ^ filters[0][k]);
+    }
+    members++;
+    if (isExt) {
+      ext = true;
+    } else {
+      std = true;
+    }
+  }
+  if (!members) {
+    // Nothing for this group: repeat an identifier the other one takes
+    MCP2515::encodeId(ids[0], filters[0]);
+    members = 1;
+  }
+
+  bool exact = members <= slots && !(std && ext);
+  if (members <= slots) {
+    mask[0] = 0xFF;
+    mask[1] = 0xE3;
+    mask[2] = mask[3] = 0xFF;
+  }
+  if (std) {
+    // Standard frames match the EID bits against their first two data bytes
+    mask[2] = mask[3] = 0;
+    if (!ext) {
+      mask[1] &= 0xE0;
+    }
+  }
+
+  can.writeRegisters(MCP2515_RXM(group), mask, 4);
+  for (uint8_t i = 0; i < slots; i++) {
+    can.writeRegisters(MCP2515_RXF(first + i), filters[i < members ? i : 0], 4);
+  }
+  return exact;
+}
+
+bool CANReceiver::wanted(uint32_t id) {
+  id &= ~CAN_MSG_RTR;
+  for (uint8_t i = 0; i < count; i++) {
+    if (ids[i] == id) {
+      return true;
+    }
+  }
+  return false;
+}
+
+void CANReceiver::drain(void) {
+  uint8_t status;
+  while ((status = can.readStatus() & (MCP2515_STAT_RX0IF | MCP2515_STAT_RX1IF))) {
+    // With rollover RXB0 holds the older frame
+    for (uint8_t n = 0; n < 2; n++) {
+      if (!(status & (1 << n))) {
+        continue;
+      }
+      uint8_t h = head;
+      bool full = (uint8_t)(h - tail) >= CAN_RX_DEPTH;
+      can_msg &slot = full ? scratch : ring[h & (CAN_RX_DEPTH - 1)];
+      can.readRx(n, slot);
+      if (full) {
+        dropped++;
+      } else if (checkIds && !wanted(slot.id)) {
+        unwanted++;
+      } else {
+        head = h + 1;
+      }
+    }
+  }
+}
+
+void CANReceiver::isr(void) {
+  CANReceiver *r = active;
+  if (r) {
+    r->drain();
+  }
+}
@@ -0,0 +1,77 @@
+// Interrupt driven CAN reception into a ring of frames.
+//
+// The MCP2515 INT pin triggers the drain: one READ STATUS, then each full
+// receive buffer is read with a single READ RX BUFFER burst straight into
+// the next free ring slot, until both buffers are empty. loop() looks at
+// frames where they lie with peek() and releases them with pop().
+//
+// begin() turns the list of wanted identifiers into acceptance masks and
+// filters. Up to six identifiers get a filter each; longer lists share
+// the two masks, the bits all their identifiers agree on, and whatever
+// the hardware lets through is checked against the list in the ISR.
+//
+// The ISR uses SPI, so the bus is registered with SPI.usingInterrupt()
+// and other SPI users must use transactions.
+
+#ifndef _CANRECEIVER_H_INCLUDED
+#define _CANRECEIVER_H_INCLUDED
+
+#include "mcp2515.h"
+
+// Ring size in frames, a power of two. Each frame takes 13 bytes.
+#ifndef CAN_RX_DEPTH
+#define CAN_RX_DEPTH 16
+#endif
+
+class CANReceiver {
+ public:
+  // intPin must be an external interrupt pin; the shield uses D2.
+  CANReceiver(MCP2515 &can, uint8_t intPin);
+
+  // Start receiving the frames whose id is in ids, with CAN_MSG_EXT set
+  // for extended identifiers, or every frame if count is 0. The list is
+  // not copied. The controller must have been started; it is briefly put
+  // back in configuration mode. Returns false if it won't change modes.
+  bool begin(const uint32_t *ids = 0, uint8_t count = 0);
+  void end(void);
+
+  // The oldest frame, left in the ring until pop(), or 0 if there is none.
+  const can_msg *peek(void) {
+    return head != tail ? &ring[tail & (CAN_RX_DEPTH - 1)] : 0;
+  }
+  void pop(void) {
+    if (head != tail) {
+      tail++;
+    }
+  }
+  uint8_t available(void) { return head - tail; }
+
+  // Frames lost because the ring was full.
+  uint16_t overruns(void) { return dropped; }
+  // Frames the filters let through that aren't in the list.
+  uint16_t discarded(void) { return unwanted; }
+
+  // Called from the INT pin interrupt.
+  static void isr(void);
+
+ private:
+  bool program(uint8_t group, uint8_t from, uint8_t to, uint8_t type);
+  bool wanted(uint32_t id);
+  void drain(void);
+
+  MCP2515 &can;
+  uint8_t intPin;
+  const uint32_t *ids;
+  uint8_t count;
+  bool checkIds;
+
+  can_msg ring[CAN_RX_DEPTH];
+  can_msg scratch;          // Frames read while the ring is full
+  volatile uint8_t head;    // Advanced by the ISR
+  volatile uint8_t tail;    // Advanced by pop()
+  volatile uint16_t dropped;
+  volatile uint16_t unwanted;
+  static CANReceiver *active;
+};
+
+#endif
@@ -0,0 +1,80 @@
+// Fixed point signals packed into CAN frames, DBC style.
+
+#include "cantelemetry.h"
+
+CANTelemetry::CANTelemetry(CANTxScheduler &scheduler, const can_signal *signals,
+                           can_signal_state *state, uint8_t count)
+  : scheduler(scheduler), signals(signals), state(state), count(count) {
+  messages = 0;
+  memset(state, 0, count * sizeof(*state));
+}
+
+void CANTelemetry::attach(can_tx_entry *messages, uint8_t count) {
+  this->messages = messages;
+  for (uint8_t i = 0; i < count; i++) {
+    messages[i].payload = payload;
+    messages[i].context = this;
+  }
+}
+
+void CANTelemetry::set(uint8_t signal, float value) {
+  const can_signal &s = signals[signal];
+  float raw = (value - s.offset) / s.scale;
+  if (raw != raw) {
+    return;
+  }
+
+  float lo = s.isSigned ? -(float)(1UL << (s.length - 1)) : 0;
+  float hi = s.isSigned ? (float)((1UL << (s.length - 1)) - 1) : (float)(0xFFFFFFFFUL >> (32 - s.length));
+  if (raw < lo) {
+    raw = lo;
+  } else if (raw > hi) {
+    raw = hi;
+  }
+  setRaw(signal, lround(raw));
+}
+
+void CANTelemetry::setRaw(uint8_t signal, int32_t raw) {
+  can_signal_state &st = state[signal];
+  st.raw = raw;
+  uint16_t deadband = signals[signal].deadband;
+  if (deadband && labs(raw - st.sent) >= deadband) {
+    scheduler.trigger(signals[signal].message);
+  }
+}
+
+void CANTelemetry::pack(uint8_t *data, uint8_t start, uint8_t length, uint32_t raw) {
+  while (length) {
+    uint8_t shift = start & 7;
+    uint8_t bits = 8 - shift < length ? 8 - shift : length;
+    uint8_t mask = (uint8_t)(0xFF >> (8 - bits)) << shift;
+    uint8_t *byte = &data[start >> 3];
+    *byte = (*byte & ~mask) | ((uint8_t)(raw << shift) & mask);
+    raw >>= bits;
+    start += bits;
+    length -= bits;
+  }
+}
+
+uint8_t CANTelemetry::fill(uint8_t message, uint8_t *data) {
+  uint8_t len = 0;
+  memset(data, 0, 8);
+  for (uint8_t i = 0; i < count; i++) {
+    const can_signal &s = signals[i];
+    if (s.message != message) {
+      continue;
+    }
+    pack(data, s.start, s.length, state[i].raw);
+    state[i].sent = state[i].raw;
+    uint8_t end = (s.start + s.length + 7) >> 3;
+    if (end > len) {
+      len = end;
+    }
+  }
+  return len;
+}
+
+uint8_t CANTelemetry::payload(const can_tx_entry *entry, uint8_t *data) {
+  CANTelemetry *t = (CANTelemetry *)entry->context;
+  return t->fill(entry - t->messages, data);
+}
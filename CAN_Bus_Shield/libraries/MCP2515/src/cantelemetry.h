@@ -0,0 +1,66 @@
+// Fixed point signals packed into CAN frames, DBC style.
+//
+// Each signal sits in one of the messages of a CANTxScheduler table, at a
+// start bit and length in Intel (little endian) order, with
+// physical = raw * scale + offset. The layout is a const table, normally
+// expanded from an X-macro list so that a host side decoder can read the
+// same definition.
+//
+// set() only stores the value. Messages go out on their scheduler period
+// with whatever the signals hold when the frame is loaded. A signal with a
+// deadband also sends its message at the next poll() once its raw value
+// has moved by at least that many counts since it was last sent, so a
+// message with period 0 is sent on change only.
+
+#ifndef _CANTELEMETRY_H_INCLUDED
+#define _CANTELEMETRY_H_INCLUDED
+
+#include "cantxscheduler.h"
+
+struct can_signal {
+  uint8_t message;    // Index in the scheduler table
+  uint8_t start;      // Least significant bit, Intel bit numbering
+  uint8_t length;     // 1-32 bits, up to 31 for set()
+  bool isSigned;
+  float scale;
+  float offset;
+  uint16_t deadband;  // Raw change that sends at once, 0 for never
+};
+
+// Last value set and last value sent, one per signal.
+struct can_signal_state {
+  int32_t raw;
+  int32_t sent;
+};
+
+class CANTelemetry {
+ public:
+  CANTelemetry(CANTxScheduler &scheduler, const can_signal *signals,
+               can_signal_state *state, uint8_t count);
+
+  // Make the telemetry the payload of messages[0..count), the table given
+  // to the scheduler. Call before CANTxScheduler::begin().
+  void attach(can_tx_entry *messages, uint8_t count);
+
+  // Store an engineering value, rounded and clamped to the signal's range.
+  // NaN leaves the signal as it was; carry validity in a signal of its own.
+  void set(uint8_t signal, float value);
+  void setRaw(uint8_t signal, int32_t raw);
+
+  // Insert the low length bits of raw into data at start.
+  static void pack(uint8_t *data, uint8_t start, uint8_t length, uint32_t raw);
+
+  // can_tx_payload for the attached messages
+  static uint8_t payload(const can_tx_entry *entry, uint8_t *data);
+
+ private:
+  uint8_t fill(uint8_t message, uint8_t *data);
+
+  CANTxScheduler &scheduler;
+  const can_signal *signals;
+  can_signal_state *state;
+  uint8_t count;
+  can_tx_entry *messages;
+};
+
+#endif
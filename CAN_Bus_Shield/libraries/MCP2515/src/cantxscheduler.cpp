@@ -0,0 +1,102 @@
+// Periodic CAN transmission from a table of messages.
+
+#include "cantxscheduler.h"
+
+CANTxScheduler::CANTxScheduler(MCP2515 &can) : can(can) {
+  table = 0;
+  count = 0;
+}
+
+void CANTxScheduler::begin(can_tx_entry *table, uint8_t count) {
+  unsigned long now = micros();
+  this->table = table;
+  this->count = count;
+  for (uint8_t i = 0; i < count; i++) {
+    table[i].due = now;
+    table[i].armed = table[i].period != 0;
+  }
+  resetStats();
+}
+
+uint8_t CANTxScheduler::poll(void) {
+  unsigned long now = micros();
+
+  // The up to three most overdue entries, earliest deadline first
+  can_tx_entry *next[MCP2515_TX_BUFFERS];
+  uint8_t found = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    can_tx_entry *e = &table[i];
+    if (!e->armed || (long)(now - e->due) < 0) {
+      continue;
+    }
+    uint8_t j = found < MCP2515_TX_BUFFERS ? found++ : MCP2515_TX_BUFFERS;
+    while (j && (long)(next[j - 1]->due - e->due) > 0) {
+      if (j < MCP2515_TX_BUFFERS) {
+        next[j] = next[j - 1];
+      }
+      j--;
+    }
+    if (j < MCP2515_TX_BUFFERS) {
+      next[j] = e;
+    }
+  }
+  if (!found) {
+    return 0;
+  }
+
+  uint8_t status = can.readStatus();
+  uint8_t started = 0;
+  uint8_t loaded = 0;
+  for (uint8_t n = 0; n < MCP2515_TX_BUFFERS && loaded < found; n++) {
+    if (status & MCP2515_STAT_TXREQ(n)) {
+      continue;
+    }
+    can_tx_entry *e = next[loaded];
+
+    can_msg msg;
+    msg.id = e->id;
+    msg.len = e->payload ? e->payload(e, msg.data) : 0;
+    // Earliest deadline gets the highest transmit priority
+    can.loadTx(n, msg, 3 - loaded);
+    started |= 1 << n;
+    loaded++;
+
+    unsigned long late = now - e->due;
+    if (late > e->maxLatency) {
+      e->maxLatency = late;
+    }
+    e->sent++;
+
+    if (e->period) {
+      unsigned long period = e->period * 1000UL;
+      e->due += period;
+      if ((long)(now - e->due) >= 0) {
+        unsigned long skipped = (now - e->due) / period + 1;
+        e->due += skipped * period;
+        e->missed += skipped;
+      }
+    } else {
+      e->armed = 0;
+    }
+  }
+
+  if (started) {
+    can.requestToSend(started);
+  }
+  return loaded;
+}
+
+void CANTxScheduler::trigger(uint8_t index) {
+  if (index < count) {
+    table[index].due = micros();
+    table[index].armed = 1;
+  }
+}
+
+void CANTxScheduler::resetStats(void) {
+  for (uint8_t i = 0; i < count; i++) {
+    table[i].sent = 0;
+    table[i].missed = 0;
+    table[i].maxLatency = 0;
+  }
+}
@@ -0,0 +1,67 @@
+// Periodic CAN transmission from a table of messages.
+//
+// Each entry names an identifier, a period and a function that fills in
+// the payload at the moment the frame is loaded. poll() hands the most
+// overdue entries to whichever of the three MCP2515 transmit buffers are
+// free, highest priority to the earliest deadline, and starts them all
+// with a single RTS.
+//
+// Deadlines advance by exactly one period from the previous deadline, not
+// from when poll() got round to them, so a slow loop() only adds jitter
+// and never shifts or stretches the schedule. An entry that falls a whole
+// period behind skips the lost periods and counts them as missed.
+//
+//   uint8_t speed(const can_tx_entry *e, uint8_t *data) { ... return 2; }
+//   can_tx_entry table[] = { { 0x101, 10, speed }, { 0x200, 1000, status } };
+//   scheduler.begin(table, 2);
+//   // in loop()
+//   scheduler.poll();
+
+#ifndef _CANTXSCHEDULER_H_INCLUDED
+#define _CANTXSCHEDULER_H_INCLUDED
+
+#include "mcp2515.h"
+
+struct can_tx_entry;
+
+// Write up to 8 bytes of payload to data and return the length.
+typedef uint8_t (*can_tx_payload)(const can_tx_entry *entry, uint8_t *data);
+
+struct can_tx_entry {
+  uint32_t id;            // With CAN_MSG_EXT for 29 bit identifiers
+  uint16_t period;        // ms, or 0 to send only on trigger()
+  can_tx_payload payload;
+  void *context;          // For the payload function
+
+  // Kept by CANTxScheduler
+  unsigned long due;        // micros() deadline of the next frame
+  unsigned long sent;       // Frames loaded for transmission
+  unsigned long missed;     // Periods skipped because the buffers were busy
+  unsigned long maxLatency; // Longest wait in us from deadline to loading
+  uint8_t armed;
+};
+
+class CANTxScheduler {
+ public:
+  CANTxScheduler(MCP2515 &can);
+
+  // Start the schedule. Every periodic entry is first due now.
+  void begin(can_tx_entry *table, uint8_t count);
+
+  // Load due entries into free transmit buffers. Returns the number of
+  // frames started. Only touches the bus when something is due.
+  uint8_t poll(void);
+
+  // Send entry index at the next poll(). A periodic entry restarts its
+  // period from there.
+  void trigger(uint8_t index);
+
+  void resetStats(void);
+
+ private:
+  MCP2515 &can;
+  can_tx_entry *table;
+  uint8_t count;
+};
+
+#endif
@@ -0,0 +1,316 @@
+// ISO 15765-2 (ISO-TP) transport for messages longer than one CAN frame.
+
+#include "isotp.h"
+
+// Protocol control information, the high nibble of the first byte
+#define PCI_SINGLE      0x00
+#define PCI_FIRST       0x10
+#define PCI_CONSECUTIVE 0x20
+#define PCI_FLOW        0x30
+
+// Flow status
+#define FC_CTS      0
+#define FC_WAIT     1
+#define FC_OVERFLOW 2
+#define FC_NONE     0xFF
+
+ISOTP::ISOTP(MCP2515 &can, uint32_t txId, uint32_t rxId, uint8_t *rxBuf, uint16_t rxSize)
+  : can(can), txId(txId), rxId(rxId), rxBuf(rxBuf), rxSize(rxSize) {
+  txState = TX_IDLE;
+  txInFlight = -1;
+  txResult = ISOTP_OK;
+  rxState = RX_IDLE;
+  rxBlockSize = 0;
+  rxStMin = 0;
+  fcPending = FC_NONE;
+  rxResult = ISOTP_OK;
+}
+
+void ISOTP::setFlowControl(uint8_t blockSize, uint8_t stMin) {
+  rxBlockSize = blockSize;
+  rxStMin = stMin;
+}
+
+bool ISOTP::send(const void *buf, uint16_t len) {
+  if (txState != TX_IDLE) {
+    return false;
+  }
+  txBuf = (const uint8_t *)buf;
+  txLength = len;
+  txOffset = 0;
+  txResult = ISOTP_OK;
+  txState = TX_FIRST;
+  poll();
+  return true;
+}
+
+void ISOTP::release(void) {
+  if (rxState == RX_DONE) {
+    rxState = RX_IDLE;
+  }
+}
+
+// Load msg into a free transmit buffer, padded to 8 bytes. Returns false
+// if none is free.
+bool ISOTP::load(can_msg &msg) {
+  uint8_t status = can.readStatus();
+  for (uint8_t n = 0; n < MCP2515_TX_BUFFERS; n++) {
+    if (!(status & MCP2515_STAT_TXREQ(n))) {
+      memset(msg.data + msg.len, ISOTP_PADDING, 8 - msg.len);
+      msg.id = txId;
+      msg.len = 8;
+      can.loadTx(n, msg, 0);
+      can.requestToSend(1 << n);
+      txInFlight = n;
+      txLoaded = millis();
+      return true;
+    }
+  }
+  return false;
+}
+
+void ISOTP::flowControl(uint8_t status) {
+  can_msg msg;
+  msg.data[0] = PCI_FLOW | status;
+  msg.data[1] = rxBlockSize;
+  msg.data[2] = rxStMin;
+  msg.len = 3;
+  // Leave txInFlight to the transfer going the other way
+  int8_t inFlight = txInFlight;
+  unsigned long loaded = txLoaded;
+  fcPending = load(msg) ? FC_NONE : status;
+  txInFlight = inFlight;
+  txLoaded = loaded;
+}
+
+void ISOTP::finishTx(isotp_status status) {
+  txResult = status;
+  txState = TX_IDLE;
+}
+
+unsigned long ISOTP::stMinMicros(uint8_t stMin) {
+  if (stMin <= 0x7F) {
+    return stMin * 1000UL;
+  }
+  if (stMin >= 0xF1 && stMin <= 0xF9) {
+    return (stMin - 0xF0) * 100UL;
+  }
+  // Reserved values mean the longest time
+  return 127000UL;
+}
+
+bool ISOTP::receive(const can_msg &msg) {
+  if (msg.id != rxId || !msg.len) {
+    return false;
+  }
+  const uint8_t *d = msg.data;
+
+  switch (d[0] & 0xF0) {
+  case PCI_SINGLE: {
+    uint8_t len = d[0] & 0x0F;
+    if (!len || len > msg.len - 1) {
+      break;
+    }
+    if (rxState == RX_CONSECUTIVE) {
+      rxResult = ISOTP_ABORTED;
+    }
+    if (rxState == RX_DONE || len > rxSize) {
+      rxResult = ISOTP_OVERFLOW;
+      break;
+    }
+    memcpy(rxBuf, d + 1, len);
+    rxLength = len;
+    rxState = RX_DONE;
+    break;
+  }
+
+  case PCI_FIRST: {
+    if (msg.len < 8) {
+      break;
+    }
+    uint32_t len = ((uint16_t)(d[0] & 0x0F) << 8) | d[1];
+    uint8_t offset = 2;
+    if (!len) {
+      len = ((uint32_t)d[2] << 24) | ((uint32_t)d[3] << 16) | ((uint16_t)d[4] << 8) | d[5];
+      offset = 6;
+    }
+    if (len < 8) {
+      break;
+    }
+    if (rxState == RX_CONSECUTIVE) {
+      rxResult = ISOTP_ABORTED;
+    }
+    if (rxState == RX_DONE || len > rxSize) {
+      if (rxState != RX_DONE) {
+        rxState = RX_IDLE;
+      }
+      rxResult = ISOTP_OVERFLOW;
+      flowControl(FC_OVERFLOW);
+      break;
+    }
+    rxLength = len;
+    rxOffset = 8 - offset;
+    memcpy(rxBuf, d + offset, rxOffset);
+    rxSeq = 1;
+    rxBlock = rxBlockSize;
+    rxState = RX_CONSECUTIVE;
+    rxTime = millis();
+    flowControl(FC_CTS);
+    break;
+  }
+
+  case PCI_CONSECUTIVE: {
+    if (rxState != RX_CONSECUTIVE) {
+      break;
+    }
+    if ((d[0] & 0x0F) != rxSeq) {
+      rxResult = ISOTP_SEQUENCE;
+      rxState = RX_IDLE;
+      break;
+    }
+    uint16_t n = rxLength - rxOffset;
+    if (n > 7) {
+      n = 7;
+    }
+    if (n > msg.len - 1) {
+      n = msg.len - 1;
+    }
+    memcpy(rxBuf + rxOffset, d + 1, n);
+    rxOffset += n;
+    rxSeq = (rxSeq + 1) & 0x0F;
+    rxTime = millis();
+    if (rxOffset >= rxLength) {
+      rxState = RX_DONE;
+    } else if (rxBlock && !--rxBlock) {
+      rxBlock = rxBlockSize;
+      flowControl(FC_CTS);
+    }
+    break;
+  }
+
+  case PCI_FLOW:
+    if (txState != TX_WAIT_FC || msg.len < 3) {
+      break;
+    }
+    switch (d[0] & 0x0F) {
+    case FC_CTS:
+      txBlockSize = d[1];
+      txBlock = d[1];
+      txGap = stMinMicros(d[2]);
+      txState = TX_CONSECUTIVE;
+      // The first consecutive frame may go right away
+      txTime = micros() - txGap;
+      poll();
+      break;
+    case FC_WAIT:
+      txTime = millis();
+      break;
+    default:
+      finishTx(ISOTP_OVERFLOW);
+      break;
+    }
+    break;
+  }
+  return true;
+}
+
+void ISOTP::poll(void) {
+  if (fcPending != FC_NONE) {
+    flowControl(fcPending);
+  }
+  if (rxState == RX_CONSECUTIVE && millis() - rxTime > ISOTP_TIMEOUT_MS) {
+    rxResult = ISOTP_TIMEOUT;
+    rxState = RX_IDLE;
+  }
+
+  if (txState == TX_IDLE) {
+    return;
+  }
+
+  // Wait for the previous frame to leave the controller. N_As: one that
+  // can't get onto the bus, with nobody to acknowledge it or the bus
+  // saturated, is taken back and the transfer given up.
+  if (txInFlight >= 0) {
+    if (can.readStatus() & MCP2515_STAT_TXREQ(txInFlight)) {
+      if (millis() - txLoaded > ISOTP_TIMEOUT_MS) {
+        can.modifyRegister(MCP2515_TXBCTRL(txInFlight), MCP2515_TXB_TXREQ, 0);
+        txInFlight = -1;
+        finishTx(ISOTP_TIMEOUT);
+      }
+      return;
+    }
+    txInFlight = -1;
+  }
+
+  if (txState == TX_WAIT_FC) {
+    if (millis() - txTime > ISOTP_TIMEOUT_MS) {
+      finishTx(ISOTP_TIMEOUT);
+    }
+    return;
+  }
+
+  can_msg msg;
+  switch (txState) {
+  case TX_FIRST:
+    if (txLength <= 7) {
+      msg.data[0] = PCI_SINGLE | txLength;
+      memcpy(msg.data + 1, txBuf, txLength);
+      msg.len = 1 + txLength;
+      if (load(msg)) {
+        txState = TX_LAST;
+      }
+      break;
+    }
+    msg.data[0] = PCI_FIRST | (txLength > 0xFFF ? 0 : txLength >> 8);
+    if (txLength > 0xFFF) {
+      msg.data[1] = 0;
+      msg.data[2] = 0;
+      msg.data[3] = 0;
+      msg.data[4] = txLength >> 8;
+      msg.data[5] = txLength;
+      txOffset = 2;
+    } else {
+      msg.data[1] = txLength;
+      txOffset = 6;
+    }
+    memcpy(msg.data + 8 - txOffset, txBuf, txOffset);
+    msg.len = 8;
+    if (load(msg)) {
+      txSeq = 1;
+      txState = TX_WAIT_FC;
+      txTime = millis();
+    }
+    break;
+
+  case TX_CONSECUTIVE: {
+    if (micros() - txTime < txGap) {
+      break;
+    }
+    uint16_t n = txLength - txOffset;
+    if (n > 7) {
+      n = 7;
+    }
+    msg.data[0] = PCI_CONSECUTIVE | txSeq;
+    memcpy(msg.data + 1, txBuf + txOffset, n);
+    msg.len = 1 + n;
+    if (!load(msg)) {
+      break;
+    }
+    txTime = micros();
+    txOffset += n;
+    txSeq = (txSeq + 1) & 0x0F;
+    if (txOffset >= txLength) {
+      txState = TX_LAST;
+    } else if (txBlock && !--txBlock) {
+      txState = TX_WAIT_FC;
+      txTime = millis();
+    }
+    break;
+  }
+
+  case TX_LAST:
+    // The last frame has left the controller
+    finishTx(ISOTP_OK);
+    break;
+  }
+}
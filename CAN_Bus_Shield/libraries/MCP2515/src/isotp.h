@@ -0,0 +1,112 @@
+// ISO 15765-2 (ISO-TP) transport for messages longer than one CAN frame.
+//
+// One ISOTP object is one link: frames go out on txId and come in on
+// rxId, the usual request/response pair such as 0x7E0/0x7E8. Messages up
+// to 4095 bytes use the classic first frame, longer ones the 32 bit
+// length escape, limited here to 65535 bytes.
+//
+// Nothing blocks. send() only queues the message; poll() loads the next
+// frame whenever the previous one has left the controller and separation
+// time allows, and runs the timeouts. Received frames come in through
+// receive(), typically straight from CANReceiver::peek(), and are
+// reassembled into the caller's buffer, which holds the message until
+// release(). The message passed to send() is read in place and must stay
+// untouched until sending() is false.
+//
+// Only one frame of a transfer is in the controller at a time, which
+// keeps consecutive frames in order whichever transmit buffer they get.
+// How close a transfer gets to line rate depends on how often poll()
+// runs: at 500 kbps a frame takes about 230 us on the wire. Frames go out
+// at transmit priority 0, so CANTxScheduler traffic overtakes them.
+
+#ifndef _ISOTP_H_INCLUDED
+#define _ISOTP_H_INCLUDED
+
+#include "mcp2515.h"
+
+// N_As, N_Bs and N_Cr: how long a frame may sit in the controller, and how
+// long to wait for a flow control or the next consecutive frame.
+#ifndef ISOTP_TIMEOUT_MS
+#define ISOTP_TIMEOUT_MS 1000
+#endif
+
+// Unused bytes of a frame are sent as this, and frames always as 8 bytes.
+#ifndef ISOTP_PADDING
+#define ISOTP_PADDING 0xCC
+#endif
+
+enum isotp_status {
+  ISOTP_OK = 0,
+  ISOTP_TIMEOUT,    // Frame not sent, or no flow control or consecutive frame, in time
+  ISOTP_OVERFLOW,   // Message larger than the receiving buffer
+  ISOTP_SEQUENCE,   // Consecutive frame out of order
+  ISOTP_ABORTED     // Transfer replaced by a new one
+};
+
+class ISOTP {
+ public:
+  ISOTP(MCP2515 &can, uint32_t txId, uint32_t rxId, uint8_t *rxBuf, uint16_t rxSize);
+
+  // Flow control asked of the sender when receiving: consecutive frames
+  // per block (0 for no limit) and STmin as coded on the wire, 0-127 ms
+  // or 0xF1-0xF9 for 100-900 us.
+  void setFlowControl(uint8_t blockSize, uint8_t stMin);
+
+  // Start sending len bytes. Returns false while a transfer is running.
+  bool send(const void *buf, uint16_t len);
+  bool sending(void) { return txState != TX_IDLE; }
+  // Outcome of the last transfer, once sending() is false
+  isotp_status txStatus(void) { return txResult; }
+
+  // Offer a received frame. Returns true if it belongs to this link.
+  bool receive(const can_msg &msg);
+  // Length of the complete message in the receive buffer, or 0
+  uint16_t available(void) { return rxState == RX_DONE ? rxLength : 0; }
+  // Free the receive buffer for the next message
+  void release(void);
+  // Why the last incoming message was dropped, ISOTP_OK if none was
+  isotp_status rxStatus(void) { return rxResult; }
+
+  void poll(void);
+
+ private:
+  enum { TX_IDLE, TX_FIRST, TX_WAIT_FC, TX_CONSECUTIVE, TX_LAST };
+  enum { RX_IDLE, RX_CONSECUTIVE, RX_DONE };
+
+  bool load(can_msg &msg);
+  void flowControl(uint8_t status);
+  void finishTx(isotp_status status);
+  static unsigned long stMinMicros(uint8_t stMin);
+
+  MCP2515 &can;
+  uint32_t txId;
+  uint32_t rxId;
+
+  const uint8_t *txBuf;
+  uint16_t txLength;
+  uint16_t txOffset;
+  uint8_t txState;
+  uint8_t txSeq;
+  uint8_t txBlock;          // Consecutive frames left in this block, 0 for no limit
+  uint8_t txBlockSize;
+  unsigned long txGap;      // Separation time in us
+  unsigned long txTime;     // micros() of the last frame, millis() while waiting for FC
+  int8_t txInFlight;        // Transmit buffer holding our last frame, or -1
+  unsigned long txLoaded;   // millis() when that frame was loaded
+  isotp_status txResult;
+
+  uint8_t *rxBuf;
+  uint16_t rxSize;
+  uint16_t rxLength;
+  uint16_t rxOffset;
+  uint8_t rxState;
+  uint8_t rxSeq;
+  uint8_t rxBlock;
+  uint8_t rxBlockSize;
+  uint8_t rxStMin;
+  uint8_t fcPending;        // Flow control still to send, 0xFF for none
+  unsigned long rxTime;
+  isotp_status rxResult;
+};
+
+#endif
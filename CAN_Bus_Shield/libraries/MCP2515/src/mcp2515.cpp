@@ -0,0 +1,271 @@
+// MCP2515 stand-alone CAN controller, as fitted to the CAN-BUS Shield.
+
+#include "mcp2515.h"
+
+// Mode changes take effect at the end of the frame on the bus, at worst
+// about 130 bit times, 2.6 ms at 50 kbps.
+#define MCP2515_MODE_TRIES 100
+#define MCP2515_MODE_US (MCP2515_MODE_TRIES * 50UL)
+// The oscillator start-up timer holds the device for 128 clocks after reset
+#define MCP2515_OST_US 20
+
+// beginStep() states
+enum {
+  STEP_START,
+  STEP_RESET,
+  STEP_OST,       // Waiting for the oscillator start-up timer
+  STEP_MODE,      // Waiting for the requested mode
+  STEP_RETRY,     // Nothing answered, waiting to reset again
+  STEP_READY
+};
+
+MCP2515::MCP2515(uint8_t csPin, uint32_t spiClock)
+  : dev(csPin, SPISettings(spiClock, MSBFIRST, SPI_MODE0)) {
+  bps = 0;
+  step = STEP_START;
+}
+
+bool MCP2515::begin(mcp2515_bitrate rate, uint8_t mode) {
+  dev.begin();
+  reset();
+  delayMicroseconds(MCP2515_OST_US);
+  if (!configure(rate) || !setMode(mode)) {
+    step = STEP_RESET;
+    return false;
+  }
+  step = STEP_READY;
+  return true;
+}
+
+bool MCP2515::beginStep(mcp2515_bitrate rate, uint8_t mode) {
+  unsigned long now = micros();
+
+  switch (step) {
+  case STEP_START:
+    dev.begin();
+    // fall through
+  case STEP_RESET:
+    reset();
+    stepTime = now;
+    step = STEP_OST;
+    break;
+  case STEP_OST:
+    if (now - stepTime < MCP2515_OST_US) {
+      break;
+    }
+    stepTime = now;
+    if (configure(rate)) {
+      modifyRegister(MCP2515_CANCTRL, MCP2515_MODE_MASK, mode);
+      step = STEP_MODE;
+    } else {
+      step = STEP_RETRY;
+    }
+    break;
+  case STEP_MODE:
+    if ((readRegister(MCP2515_CANSTAT) & MCP2515_MODE_MASK) == mode) {
+      step = STEP_READY;
+    } else if (now - stepTime > MCP2515_MODE_US) {
+      stepTime = now;
+      step = STEP_RETRY;
+    }
+    break;
+  case STEP_RETRY:
+    if (now - stepTime >= MCP2515_RETRY_MS * 1000UL) {
+      step = STEP_RESET;
+    }
+    break;
+  }
+  return step == STEP_READY;
+}
+
+bool MCP2515::ready(void) {
+  return step == STEP_READY;
+}
+
+void MCP2515::reset(void) {
+  dev.select();
+  SPI.transfer(MCP2515_RESET);
+  dev.deselect();
+}
+
+bool MCP2515::configure(mcp2515_bitrate rate) {
+  // CNF3, CNF2, CNF1 for a 16 MHz crystal, sample point near 75%
+  static const uint8_t timings[][3] = {
+    { 0x87, 0xFA, 0x07 },  // 50k
+    { 0x87, 0xFA, 0x03 },  // 100k
+    { 0x86, 0xF0, 0x03 },  // 125k
+    { 0x87, 0xFA, 0x01 },  // 200k
+    { 0x85, 0xF1, 0x41 },  // 250k
+    { 0x86, 0xF0, 0x00 },  // 500k
+    { 0x82, 0xD0, 0x00 },  // 1000k
+  };
+  static const uint16_t kbps[] = { 50, 100, 125, 200, 250, 500, 1000 };
+
+  // After reset the controller is in configuration mode. A missing shield
+  // reads back as all zeros or all ones.
+  if ((readRegister(MCP2515_CANSTAT) & MCP2515_MODE_MASK) != MCP2515_MODE_CONFIG) {
+    return false;
+  }
+
+  // CNF3, CNF2, CNF1 and CANINTE are consecutive
+  uint8_t config[4] = { timings[rate][0], timings[rate][1], timings[rate][2], 0 };
+  writeRegisters(MCP2515_CNF3, config, sizeof(config));
+  bps = kbps[rate] * 1000UL;
+
+  uint8_t oldSREG = SREG;
+  cli();
+  memset((void *)&traffic, 0, sizeof(traffic));
+  SREG = oldSREG;
+
+  // Filters off, and let RXB0 roll over into RXB1 so back to back frames
+  // aren't lost while the first is still being read
+  writeRegister(MCP2515_RXBCTRL(0), MCP2515_RXB_ANY | MCP2515_RXB_BUKT);
+  writeRegister(MCP2515_RXBCTRL(1), MCP2515_RXB_ANY);
+  writeRegister(MCP2515_CANINTF, 0);
+  return true;
+}
+
+bool MCP2515::setMode(uint8_t mode) {
+  modifyRegister(MCP2515_CANCTRL, MCP2515_MODE_MASK, mode);
+  for (uint8_t i = 0; i < MCP2515_MODE_TRIES; i++) {
+    if ((readRegister(MCP2515_CANSTAT) & MCP2515_MODE_MASK) == mode) {
+      return true;
+    }
+    delayMicroseconds(50);
+  }
+  return false;
+}
+
+uint8_t MCP2515::readRegister(uint8_t address) {
+  uint8_t value;
+  readRegisters(address, &value, 1);
+  return value;
+}
+
+void MCP2515::readRegisters(uint8_t address, void *buf, uint8_t count) {
+  dev.select();
+  SPI.transfer(MCP2515_READ);
+  SPI.transfer(address);
+  SPI.read(buf, count, 0);
+  dev.deselect();
+}
+
+void MCP2515::writeRegister(uint8_t address, uint8_t value) {
+  writeRegisters(address, &value, 1);
+}
+
+void MCP2515::writeRegisters(uint8_t address, const void *buf, uint8_t count) {
+  dev.select();
+  SPI.transfer(MCP2515_WRITE);
+  SPI.transfer(address);
+  SPI.write(buf, count);
+  dev.deselect();
+}
+
+void MCP2515::modifyRegister(uint8_t address, uint8_t mask, uint8_t value) {
+  uint8_t cmd[4] = { MCP2515_BIT_MODIFY, address, mask, value };
+  dev.select();
+  SPI.write(cmd, sizeof(cmd));
+  dev.deselect();
+}
+
+void MCP2515::loadTx(uint8_t n, const can_msg &msg, uint8_t priority) {
+  // TXBnCTRL followed by the identifier, DLC and data, all in one WRITE.
+  // TXREQ stays clear so the buffer isn't sent half written.
+  uint8_t buf[14];
+  uint8_t len = msg.len > 8 ? 8 : msg.len;
+
+  buf[0] = priority & 0x03;
+  encodeId(msg.id, buf + 1);
+  buf[5] = len | (msg.id & CAN_MSG_RTR ? 0x40 : 0);
+  memcpy(buf + 6, msg.data, len);
+
+  writeRegisters(MCP2515_TXBCTRL(n), buf, 6 + len);
+
+  traffic.txFrames++;
+  traffic.txBytes += len;
+  traffic.txBits += frameBits(msg);
+}
+
+void MCP2515::requestToSend(uint8_t mask) {
+  dev.select();
+  SPI.transfer(MCP2515_RTS | (mask & 0x07));
+  dev.deselect();
+}
+
+bool MCP2515::send(const can_msg &msg) {
+  uint8_t status = readStatus();
+  for (uint8_t n = 0; n < MCP2515_TX_BUFFERS; n++) {
+    if (!(status & MCP2515_STAT_TXREQ(n))) {
+      loadTx(n, msg);
+      requestToSend(1 << n);
+      return true;
+    }
+  }
+  return false;
+}
+
+void MCP2515::readRx(uint8_t n, can_msg &msg) {
+  // SIDH, SIDL, EID8, EID0 and DLC, then only as many data bytes as the
+  // frame has, all under one chip select
+  uint8_t head[5];
+  dev.select();
+  SPI.transfer(MCP2515_READ_RX | (n << 2));
+  SPI.read(head, sizeof(head), 0);
+
+  uint32_t id = ((uint16_t)head[0] << 3) | (head[1] >> 5);
+  if (head[1] & 0x08) {
+    id = (id << 18) | ((uint32_t)(head[1] & 0x03) << 16) | ((uint16_t)head[2] << 8) | head[3];
+    id |= CAN_MSG_EXT;
+    if (head[4] & 0x40) {
+      id |= CAN_MSG_RTR;
+    }
+  } else if (head[1] & 0x10) {
+    id |= CAN_MSG_RTR;
+  }
+  msg.id = id;
+  msg.len = head[4] & 0x0F;
+  if (msg.len > 8) {
+    msg.len = 8;
+  }
+
+  SPI.read(msg.data, msg.len, 0);
+  dev.deselect();
+
+  traffic.rxFrames++;
+  traffic.rxBytes += msg.len;
+  traffic.rxBits += frameBits(msg);
+}
+
+void MCP2515::counters(mcp2515_counters &c) {
+  uint8_t oldSREG = SREG;
+  cli();
+  memcpy(&c, (const void *)&traffic, sizeof(c));
+  SREG = oldSREG;
+}
+
+// SOF to interframe space: 47 bits for a standard frame, 67 for an
+// extended one, plus the data unless it is a remote request.
+uint8_t MCP2515::frameBits(const can_msg &msg) {
+  uint8_t bits = msg.id & CAN_MSG_EXT ? 67 : 47;
+  if (!(msg.id & CAN_MSG_RTR)) {
+    bits += (msg.len > 8 ? 8 : msg.len) << 3;
+  }
+  return bits;
+}
+
+void MCP2515::encodeId(uint32_t id, uint8_t *regs) {
+  if (id & CAN_MSG_EXT) {
+    uint16_t sid = (id & CAN_MSG_ID_MASK) >> 18;
+    regs[0] = sid >> 3;
+    regs[1] = (sid << 5) | 0x08 | ((id >> 16) & 0x03);
+    regs[2] = id >> 8;
+    regs[3] = id;
+  } else {
+    uint16_t sid = id & 0x7FF;
+    regs[0] = sid >> 3;
+    regs[1] = sid << 5;
+    regs[2] = 0;
+    regs[3] = 0;
+  }
+}
@@ -0,0 +1,181 @@
+// MCP2515 stand-alone CAN controller, as fitted to the CAN-BUS Shield.
+//
+// Register level access over SPIDevice: whole transmit buffers are written
+// in one burst and received frames are read with READ RX BUFFER, which
+// needs no address byte and clears the buffer's interrupt flag itself.
+// Bit timings assume the shield's 16 MHz crystal.
+
+#ifndef _MCP2515_H_INCLUDED
+#define _MCP2515_H_INCLUDED
+
+#include <Arduino.h>
+#include <SPIDevice.h>
+
+// SPI instructions
+#define MCP2515_RESET       0xC0
+#define MCP2515_READ        0x03
+#define MCP2515_READ_RX     0x90  // | buffer << 2, starts at RXBnSIDH
+#define MCP2515_WRITE       0x02
+#define MCP2515_LOAD_TX     0x40  // | buffer << 1, starts at TXBnSIDH
+#define MCP2515_RTS         0x80  // | mask of buffers
+#define MCP2515_READ_STATUS 0xA0
+#define MCP2515_RX_STATUS   0xB0
+#define MCP2515_BIT_MODIFY  0x05
+
+// Registers
+#define MCP2515_RXF(n)  (((n) + ((n) >= 3)) << 2)  // 0x00-0x08, 0x10-0x18
+#define MCP2515_RXM(n)  (0x20 + ((n) << 2))
+#define MCP2515_CANSTAT 0x0E
+#define MCP2515_CANCTRL 0x0F
+#define MCP2515_TEC     0x1C
+#define MCP2515_REC     0x1D
+#define MCP2515_CNF3    0x28
+#define MCP2515_CNF2    0x29
+#define MCP2515_CNF1    0x2A
+#define MCP2515_CANINTE 0x2B
+#define MCP2515_CANINTF 0x2C
+#define MCP2515_EFLG    0x2D
+#define MCP2515_TXBCTRL(n) (0x30 + ((n) << 4))
+#define MCP2515_RXBCTRL(n) (0x60 + ((n) << 4))
+
+// TXBnCTRL bits
+#define MCP2515_TXB_TXREQ 0x08
+
+// READ STATUS bits
+#define MCP2515_STAT_RX0IF  0x01
+#define MCP2515_STAT_RX1IF  0x02
+#define MCP2515_STAT_TXREQ(n) (0x04 << ((n) << 1))
+
+// CANINTE/CANINTF bits
+#define MCP2515_INT_RX0 0x01
+#define MCP2515_INT_RX1 0x02
+
+// RXBnCTRL: filters on or off, and RXB0 rolling over into RXB1
+#define MCP2515_RXB_FILTERED 0x00
+#define MCP2515_RXB_ANY      0x60
+#define MCP2515_RXB_BUKT     0x04
+
+// EFLG bits
+#define MCP2515_EFLG_RX0OVR 0x40
+#define MCP2515_EFLG_RX1OVR 0x80
+#define MCP2515_EFLG_TXBO   0x20
+#define MCP2515_EFLG_TXEP   0x10
+#define MCP2515_EFLG_RXEP   0x08
+#define MCP2515_EFLG_EWARN  0x01
+
+// CANINTF message error flag
+#define MCP2515_INT_MERR 0x80
+
+// Operating modes, the REQOP/OPMOD bits of CANCTRL/CANSTAT
+#define MCP2515_MODE_NORMAL   0x00
+#define MCP2515_MODE_LOOPBACK 0x40
+#define MCP2515_MODE_LISTEN   0x60
+#define MCP2515_MODE_CONFIG   0x80
+#define MCP2515_MODE_MASK     0xE0
+
+#define MCP2515_TX_BUFFERS 3
+
+// How long beginStep() waits before trying a controller that didn't answer
+#ifndef MCP2515_RETRY_MS
+#define MCP2515_RETRY_MS 100
+#endif
+
+// A CAN frame. id holds the 11 or 29 bit identifier, with CAN_MSG_EXT set
+// for extended frames and CAN_MSG_RTR for remote requests.
+struct can_msg {
+  uint32_t id;
+  uint8_t len;
+  uint8_t data[8];
+};
+
+#define CAN_MSG_EXT     0x80000000UL
+#define CAN_MSG_RTR     0x40000000UL
+#define CAN_MSG_ID_MASK 0x1FFFFFFFUL
+
+// Traffic through the driver since begin(). Transmitted frames are
+// counted when loaded, bits are the frame lengths without stuffing.
+struct mcp2515_counters {
+  unsigned long txFrames;
+  unsigned long txBytes;
+  unsigned long txBits;
+  unsigned long rxFrames;
+  unsigned long rxBytes;
+  unsigned long rxBits;
+};
+
+enum mcp2515_bitrate {
+  CAN_50KBPS,
+  CAN_100KBPS,
+  CAN_125KBPS,
+  CAN_200KBPS,
+  CAN_250KBPS,
+  CAN_500KBPS,
+  CAN_1000KBPS
+};
+
+class MCP2515 {
+ public:
+  // The MCP2515 takes up to 10 MHz; the shield uses CS on D9 (D10 before v1.1).
+  MCP2515(uint8_t csPin, uint32_t spiClock = 10000000);
+
+  // Reset the controller, set the bit rate, accept every frame into either
+  // receive buffer and switch to mode. Returns false if the controller
+  // doesn't answer or refuses the mode.
+  bool begin(mcp2515_bitrate rate, uint8_t mode = MCP2515_MODE_NORMAL);
+  // The same without waiting: each call takes at most one step of reset,
+  // configuration and mode change and returns ready(). Call it from loop()
+  // until it returns true. A controller that doesn't answer is reset again
+  // every MCP2515_RETRY_MS.
+  bool beginStep(mcp2515_bitrate rate, uint8_t mode = MCP2515_MODE_NORMAL);
+  // True once begin() or beginStep() has succeeded
+  bool ready(void);
+  bool setMode(uint8_t mode);
+
+  uint8_t readRegister(uint8_t address);
+  void readRegisters(uint8_t address, void *buf, uint8_t count);
+  void writeRegister(uint8_t address, uint8_t value);
+  void writeRegisters(uint8_t address, const void *buf, uint8_t count);
+  void modifyRegister(uint8_t address, uint8_t mask, uint8_t value);
+
+  // One byte summaries of the buffer flags, see MCP2515_STAT_*
+  uint8_t readStatus(void) { return dev.readRegister(MCP2515_READ_STATUS); }
+  uint8_t rxStatus(void) { return dev.readRegister(MCP2515_RX_STATUS); }
+
+  // Write msg to transmit buffer n, which must not have TXREQ set, with
+  // transmit priority 0-3. Nothing is sent until requestToSend().
+  void loadTx(uint8_t n, const can_msg &msg, uint8_t priority = 0);
+  // Start transmission of the buffers in mask (bit n for buffer n)
+  void requestToSend(uint8_t mask);
+  // Load msg into the first free transmit buffer and send it. Returns
+  // false if all three are busy.
+  bool send(const can_msg &msg);
+
+  // Read receive buffer n straight into msg. This also clears RXnIF.
+  void readRx(uint8_t n, can_msg &msg);
+
+  // The SIDH, SIDL, EID8 and EID0 register values for id, the layout
+  // shared by transmit buffers, filters and masks.
+  static void encodeId(uint32_t id, uint8_t *regs);
+
+  // Bit rate set by begin(), in bits per second
+  unsigned long bitrate(void) { return bps; }
+
+  // A consistent copy of the traffic counters, which readRx() updates
+  // from interrupt context.
+  void counters(mcp2515_counters &c);
+
+  SPIDevice &device(void) { return dev; }
+
+ private:
+  static uint8_t frameBits(const can_msg &msg);
+  void reset(void);
+  bool configure(mcp2515_bitrate rate);
+
+  SPIDevice dev;
+  unsigned long bps;
+  uint8_t step;             // Of beginStep()
+  unsigned long stepTime;   // micros() when the step started
+  volatile mcp2515_counters traffic;
+};
+
+#endif
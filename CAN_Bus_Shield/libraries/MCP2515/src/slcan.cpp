@@ -0,0 +1,428 @@
+// SLCAN (Lawicel) gateway between the CAN bus and a serial port.
+
+#include "slcan.h"
+
+static_assert(!(SLCAN_TX_DEPTH & (SLCAN_TX_DEPTH - 1)) && SLCAN_TX_DEPTH <= 128,
+              "SLCAN_TX_DEPTH must be a power of two up to 128");
+static_assert(!(SLCAN_OUT_SIZE & (SLCAN_OUT_SIZE - 1)) && SLCAN_OUT_SIZE <= 128 &&
+              SLCAN_OUT_SIZE >= 64, "SLCAN_OUT_SIZE must be a power of two, 64 or 128");
+
+#define REPLY_OK    '\r'
+#define REPLY_ERROR '\a'
+// Longest reply, "V1013\r", and longest frame line, "T" + 8 + 1 + 16 + 4 + "\r"
+#define REPLY_MAX 6
+#define LINE_MAX  31
+
+// Binary header flags
+#define BIN_EXT 0x80
+#define BIN_RTR 0x40
+#define BIN_TEXT 0xFF
+
+// S0-S8: 10, 20, 50, 100, 125, 250, 500, 800 kbps and 1 Mbps
+static const int8_t rates[] = {
+  -1, -1, CAN_50KBPS, CAN_100KBPS, CAN_125KBPS, CAN_250KBPS, CAN_500KBPS, -1, CAN_1000KBPS
+};
+
+static int8_t hexDigit(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  c |= 0x20;
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  return -1;
+}
+
+// digits hex digits from s, or -1 if any isn't one
+static int32_t parseHex(const char *s, uint8_t digits) {
+  int32_t value = 0;
+  while (digits--) {
+    int8_t d = hexDigit(*s++);
+    if (d < 0) {
+      return -1;
+    }
+    value = (value << 4) | d;
+  }
+  return value;
+}
+
+SLCANGateway::SLCANGateway(MCP2515 &can, CANReceiver &rx, Stream &port)
+  : can(can), rx(rx), port(port) {
+  rate = CAN_500KBPS;
+  opened = false;
+  timestamps = false;
+  binaryMode = false;
+  mode = MCP2515_MODE_CONFIG;
+  lineLength = 0;
+  binState = 0;
+  txHead = txTail = 0;
+  txPriority = 0;
+  outHead = outTail = 0;
+  framesToHost = framesFromHost = txDropped = 0;
+  lastOverruns = 0;
+  queueFull = false;
+}
+
+void SLCANGateway::begin(mcp2515_bitrate rate) {
+  close();
+  this->rate = rate;
+  timestamps = false;
+  binaryMode = false;
+  lineLength = 0;
+  binState = 0;
+  outHead = outTail = 0;
+}
+
+bool SLCANGateway::open(uint8_t mode) {
+  if (opened) {
+    return false;
+  }
+  // Reset clears the receive setup, so the receiver starts again on top
+  if (!can.begin(rate, MCP2515_MODE_CONFIG) || !rx.begin() || !can.setMode(mode)) {
+    return false;
+  }
+  this->mode = mode;
+  txHead = txTail = 0;
+  lastOverruns = rx.overruns();
+  opened = true;
+  return true;
+}
+
+void SLCANGateway::close(void) {
+  if (!opened) {
+    return;
+  }
+  opened = false;
+  rx.end();
+  can.setMode(MCP2515_MODE_CONFIG);
+  while (rx.peek()) {
+    rx.pop();
+  }
+  txHead = txTail = 0;
+}
+
+void SLCANGateway::poll(void) {
+  // Only take input while any reply it needs fits
+  while (room() >= REPLY_MAX && port.available() > 0) {
+    uint8_t c = port.read();
+    if (binaryMode) {
+      binary(c);
+    } else if (c == '\r') {
+      command();
+      lineLength = 0;
+    } else if (c != '\n' && lineLength < sizeof(line)) {
+      // A line that doesn't fit stays at sizeof(line) and fails at CR
+      line[lineLength++] = c;
+    }
+  }
+  transmit();
+  forward();
+  flush();
+}
+
+void SLCANGateway::command(void) {
+  uint8_t reply = REPLY_ERROR;
+  char c = lineLength ? line[0] : 0;
+
+  if (!lineLength) {
+    // slcand sends bare CRs to clear the adapter's input
+    return;
+  }
+  if (lineLength >= sizeof(line)) {
+    put(REPLY_ERROR);
+    return;
+  }
+
+  switch (c) {
+  case 't':
+  case 'T':
+  case 'r':
+  case 'R': {
+    can_msg msg;
+    if (opened && mode == MCP2515_MODE_NORMAL && parseFrame(msg) && queue(msg)) {
+      put(c == 't' || c == 'r' ? 'z' : 'Z');
+      reply = REPLY_OK;
+    }
+    break;
+  }
+  case 'O':
+  case 'L':
+    if (lineLength == 1 && open(c == 'O' ? MCP2515_MODE_NORMAL : MCP2515_MODE_LISTEN)) {
+      reply = REPLY_OK;
+    }
+    break;
+  case 'C':
+    if (lineLength == 1) {
+      close();
+      reply = REPLY_OK;
+    }
+    break;
+  case 'S':
+    if (lineLength == 2 && !opened && line[1] >= '0' && line[1] <= '8' &&
+        rates[line[1] - '0'] >= 0) {
+      rate = (mcp2515_bitrate)rates[line[1] - '0'];
+      reply = REPLY_OK;
+    }
+    break;
+  case 'F':
+    if (lineLength == 1) {
+      put('F');
+      putHex(statusFlags(), 2);
+      reply = REPLY_OK;
+    }
+    break;
+  case 'V':
+    put('V');
+    putHex(0x1013, 4);
+    reply = REPLY_OK;
+    break;
+  case 'N':
+    put('N');
+    putHex(0x2515, 4);
+    reply = REPLY_OK;
+    break;
+  case 'Z':
+  case 'B':
+    if (lineLength == 2 && (line[1] == '0' || line[1] == '1')) {
+      if (c == 'Z') {
+        timestamps = line[1] == '1';
+      } else {
+        binaryMode = line[1] == '1';
+        binState = 0;
+      }
+      reply = REPLY_OK;
+    }
+    break;
+  case 'M':
+  case 'm':
+    // Acceptance code and mask of the SJA1000, which has no equivalent here
+    if (lineLength == 9 && parseHex(line + 1, 8) >= 0) {
+      reply = REPLY_OK;
+    }
+    break;
+  }
+  put(reply);
+}
+
+// A t, T, r or R line into msg
+bool SLCANGateway::parseFrame(can_msg &msg) {
+  bool ext = line[0] == 'T' || line[0] == 'R';
+  bool rtr = line[0] == 'r' || line[0] == 'R';
+  uint8_t idDigits = ext ? 8 : 3;
+
+  if (lineLength < 2 + idDigits) {
+    return false;
+  }
+  int32_t id = parseHex(line + 1, idDigits);
+  int8_t len = hexDigit(line[1 + idDigits]);
+  if (id < 0 || id > (ext ? 0x1FFFFFFFL : 0x7FFL) || len < 0 || len > 8 ||
+      lineLength != 2 + idDigits + (rtr ? 0 : 2 * len)) {
+    return false;
+  }
+  msg.id = id | (ext ? CAN_MSG_EXT : 0) | (rtr ? CAN_MSG_RTR : 0);
+  msg.len = len;
+  for (uint8_t i = 0; i < len && !rtr; i++) {
+    int32_t b = parseHex(line + 2 + idDigits + 2 * i, 2);
+    if (b < 0) {
+      return false;
+    }
+    msg.data[i] = b;
+  }
+  return true;
+}
+
+void SLCANGateway::binary(uint8_t c) {
+  if (!binState) {
+    if (c == SLCAN_BINARY_SYNC) {
+      binState = 1;
+    }
+    return;
+  }
+  if (binState == 1) {
+    if (c == BIN_TEXT) {
+      binaryMode = false;
+      binState = 0;
+      return;
+    }
+    if ((c & 0x30) || (c & 0x0F) > 8) {
+      // Not a header: look for the next sync byte
+      binState = 0;
+      return;
+    }
+    binLength = 2 + ((c & BIN_EXT) ? 4 : 2) + ((c & BIN_RTR) ? 0 : (c & 0x0F));
+  }
+  binFrame[binState++] = c;
+  if (binState < binLength) {
+    return;
+  }
+  binState = 0;
+
+  uint8_t flags = binFrame[1];
+  can_msg msg;
+  const uint8_t *p = &binFrame[2];
+  if (flags & BIN_EXT) {
+    msg.id = ((uint32_t)p[3] << 24 | (uint32_t)p[2] << 16 | p[1] << 8 | p[0]) & CAN_MSG_ID_MASK;
+    msg.id |= CAN_MSG_EXT;
+    p += 4;
+  } else {
+    msg.id = (p[1] << 8 | p[0]) & 0x7FF;
+    p += 2;
+  }
+  if (flags & BIN_RTR) {
+    msg.id |= CAN_MSG_RTR;
+  }
+  msg.len = flags & 0x0F;
+  if (!(flags & BIN_RTR)) {
+    memcpy(msg.data, p, msg.len);
+  }
+  // No replies in binary mode; F reports what was dropped
+  if (opened && mode == MCP2515_MODE_NORMAL) {
+    queue(msg);
+  }
+}
+
+bool SLCANGateway::queue(const can_msg &msg) {
+  if ((uint8_t)(txHead - txTail) >= SLCAN_TX_DEPTH) {
+    txDropped++;
+    queueFull = true;
+    return false;
+  }
+  txQueue[txHead++ & (SLCAN_TX_DEPTH - 1)] = msg;
+  return true;
+}
+
+// Frames go out in the order they came in. Each one loaded while others
+// are still waiting gets a lower transmit priority than theirs, since the
+// controller picks by priority, and by buffer number only among equals.
+void SLCANGateway::transmit(void) {
+  if (txHead == txTail) {
+    return;
+  }
+  uint8_t status = can.readStatus();
+  uint8_t pending = 0;
+  for (uint8_t n = 0; n < MCP2515_TX_BUFFERS; n++) {
+    pending |= status & MCP2515_STAT_TXREQ(n);
+  }
+  if (!pending) {
+    txPriority = 4;
+  }
+  uint8_t rts = 0;
+  for (uint8_t n = 0; n < MCP2515_TX_BUFFERS && txHead != txTail && txPriority; n++) {
+    if (status & MCP2515_STAT_TXREQ(n)) {
+      continue;
+    }
+    can.loadTx(n, txQueue[txTail & (SLCAN_TX_DEPTH - 1)], --txPriority);
+    txTail++;
+    rts |= 1 << n;
+    framesFromHost++;
+  }
+  if (rts) {
+    can.requestToSend(rts);
+  }
+}
+
+void SLCANGateway::forward(void) {
+  const can_msg *msg;
+
+  while (opened && room() >= LINE_MAX && (msg = rx.peek())) {
+    bool ext = msg->id & CAN_MSG_EXT;
+    bool rtr = msg->id & CAN_MSG_RTR;
+    uint32_t id = msg->id & CAN_MSG_ID_MASK;
+    uint8_t len = msg->len > 8 ? 8 : msg->len;
+    uint8_t dataLength = rtr ? 0 : len;
+
+    if (binaryMode) {
+      put(SLCAN_BINARY_SYNC);
+      put((ext ? BIN_EXT : 0) | (rtr ? BIN_RTR : 0) | len);
+      put(id);
+      put(id >> 8);
+      if (ext) {
+        put(id >> 16);
+        put(id >> 24);
+      }
+      for (uint8_t i = 0; i < dataLength; i++) {
+        put(msg->data[i]);
+      }
+    } else {
+      put(rtr ? (ext ? 'R' : 'r') : (ext ? 'T' : 't'));
+      putHex(id, ext ? 8 : 3);
+      putHex(len, 1);
+      for (uint8_t i = 0; i < dataLength; i++) {
+        putHex(msg->data[i], 2);
+      }
+    }
+    if (timestamps) {
+      // When the frame is forwarded, which is close enough for SLCAN's
+      // millisecond counter
+      uint16_t ms = millis() % 60000;
+      if (binaryMode) {
+        put(ms);
+        put(ms >> 8);
+      } else {
+        putHex(ms, 4);
+      }
+    }
+    if (!binaryMode) {
+      put('\r');
+    }
+    rx.pop();
+    framesToHost++;
+  }
+}
+
+void SLCANGateway::flush(void) {
+  int space = port.availableForWrite();
+
+  while (space > 0 && outHead != outTail) {
+    uint8_t start = outTail & (SLCAN_OUT_SIZE - 1);
+    uint8_t n = outHead - outTail;
+    if (n > SLCAN_OUT_SIZE - start) {
+      n = SLCAN_OUT_SIZE - start;
+    }
+    if (n > space) {
+      n = space;
+    }
+    port.write(&out[start], n);
+    outTail += n;
+    space -= n;
+  }
+}
+
+void SLCANGateway::putHex(uint32_t value, uint8_t digits) {
+  while (digits--) {
+    uint8_t d = (value >> (digits << 2)) & 0x0F;
+    put(d < 10 ? '0' + d : 'A' + d - 10);
+  }
+}
+
+// The SJA1000 status bits SLCAN reports, from EFLG and the gateway's own
+// queues. Overflow and queue full are cleared by reading them.
+uint8_t SLCANGateway::statusFlags(void) {
+  uint8_t flags = 0;
+  uint16_t overruns = rx.overruns();
+
+  if (overruns != lastOverruns) {
+    flags |= 0x01;
+    lastOverruns = overruns;
+  }
+  if (queueFull) {
+    flags |= 0x02;
+    queueFull = false;
+  }
+  uint8_t eflg = can.readRegister(MCP2515_EFLG);
+  if (eflg & MCP2515_EFLG_EWARN) {
+    flags |= 0x04;
+  }
+  if (eflg & (MCP2515_EFLG_RX0OVR | MCP2515_EFLG_RX1OVR)) {
+    flags |= 0x08;
+    can.modifyRegister(MCP2515_EFLG, MCP2515_EFLG_RX0OVR | MCP2515_EFLG_RX1OVR, 0);
+  }
+  if (eflg & (MCP2515_EFLG_TXEP | MCP2515_EFLG_RXEP)) {
+    flags |= 0x20;
+  }
+  if (eflg & MCP2515_EFLG_TXBO) {
+    flags |= 0x80;
+  }
+  return flags;
+}
@@ -0,0 +1,107 @@
+// SLCAN (Lawicel) gateway between the CAN bus and a serial port.
+//
+// Frames the CANReceiver collects go out on the port as SLCAN lines, and
+// t/T/r/R commands from the port are sent on the bus, so a PC can use the
+// shield as a CAN interface through slcand and the SocketCAN tools:
+//
+//   slcand -o -s6 -S1000000 /dev/ttyACM0 can0
+//
+// Neither side waits for the other. Received frames stay in the
+// CANReceiver ring until the output buffer has room for their line, and
+// the output buffer goes to the port only as fast as availableForWrite()
+// takes it. Commands are read only while there is room for a reply, and
+// frames to send queue for a free transmit buffer. poll() does whatever
+// it can without blocking and returns.
+//
+// "B1" switches both directions to a compact binary framing, 12 bytes for
+// a standard frame with 8 data bytes instead of 22:
+//
+//   0xAA, flags | length, identifier, data, [timestamp]
+//
+// flags: 0x80 extended, 0x40 remote. The identifier is 2 bytes for a
+// standard frame and 4 for an extended one, the timestamp 2 bytes of
+// milliseconds when timestamps are on, all little endian. Frames to send
+// have no timestamp, and 0xAA 0xFF goes back to text.
+//
+// Supported commands: O (open), L (open listen only), C (close), S0-S8
+// (bit rate, where the controller has it), t, T, r, R, F (status flags),
+// V, N, Z0/Z1 (timestamps) and B0/B1. M and m are accepted and ignored.
+
+#ifndef _SLCAN_H_INCLUDED
+#define _SLCAN_H_INCLUDED
+
+#include "canreceiver.h"
+
+// Frames waiting for a transmit buffer, a power of two
+#ifndef SLCAN_TX_DEPTH
+#define SLCAN_TX_DEPTH 8
+#endif
+// Bytes waiting for the port, a power of two
+#ifndef SLCAN_OUT_SIZE
+#define SLCAN_OUT_SIZE 128
+#endif
+
+#define SLCAN_BINARY_SYNC 0xAA
+
+class SLCANGateway {
+ public:
+  SLCANGateway(MCP2515 &can, CANReceiver &rx, Stream &port);
+  // Start with the channel closed, as an adapter does at power up. The
+  // controller must have been started once with MCP2515::begin().
+  void begin(mcp2515_bitrate rate = CAN_500KBPS);
+  // What O and L do: reset the controller at the current bit rate and
+  // start forwarding in mode.
+  bool open(uint8_t mode = MCP2515_MODE_NORMAL);
+  void close(void);
+  bool isOpen(void) { return opened; }
+  void poll(void);
+
+  // Frames forwarded to the port, and sent on behalf of it
+  unsigned long toHost(void) { return framesToHost; }
+  unsigned long fromHost(void) { return framesFromHost; }
+  // Frames to send lost because the queue was full
+  unsigned long dropped(void) { return txDropped; }
+
+ private:
+  void command(void);
+  bool parseFrame(can_msg &msg);
+  void binary(uint8_t c);
+  bool queue(const can_msg &msg);
+  void transmit(void);
+  void forward(void);
+  void flush(void);
+  uint8_t room(void) { return SLCAN_OUT_SIZE - (uint8_t)(outHead - outTail); }
+  void put(uint8_t c) { out[outHead++ & (SLCAN_OUT_SIZE - 1)] = c; }
+  void putHex(uint32_t value, uint8_t digits);
+  uint8_t statusFlags(void);
+
+  MCP2515 &can;
+  CANReceiver &rx;
+  Stream &port;
+  mcp2515_bitrate rate;
+  bool opened;
+  bool timestamps;
+  bool binaryMode;
+  uint8_t mode;
+
+  char line[32];            // Text command being received
+  uint8_t lineLength;
+  uint8_t binState;         // Bytes of the binary frame being received
+  uint8_t binLength;        // Its total length, once the header is in
+  uint8_t binFrame[14];
+
+  can_msg txQueue[SLCAN_TX_DEPTH];
+  uint8_t txHead, txTail;
+  uint8_t txPriority;       // Next transmit priority, counting down
+
+  uint8_t out[SLCAN_OUT_SIZE];
+  uint8_t outHead, outTail;
+
+  unsigned long framesToHost;
+  unsigned long framesFromHost;
+  unsigned long txDropped;
+  uint16_t lastOverruns;    // CANReceiver::overruns() at the last F
+  bool queueFull;           // Since the last F
+};
+
+#endif
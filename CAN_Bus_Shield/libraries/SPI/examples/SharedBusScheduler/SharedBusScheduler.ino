@@ -0,0 +1,96 @@
+/*
+  Shared Bus Scheduler
+
+  An MCP2515 CAN controller and a MAX6675 thermocouple on one SPI bus,
+  serialized by SPIScheduler. The thermocouple is read twice a second at
+  low priority. When the MCP2515 pulls INT low, the interrupt handler
+  submits a high priority READ STATUS request, which goes ahead of any
+  queued thermocouple read, and runs it immediately if the bus is free.
+  (A real driver would go on to read the frame and clear CANINTF.)
+  Latency statistics for both devices are printed every five seconds.
+
+ The circuit:
+  * MCP2515 CS - to digital pin 9, INT - to digital pin 2
+  * MAX6675 CS - to digital pin 10
+  * SCK, MOSI, MISO shared on pins 13, 11 and 12
+
+*/
+
+#include <SPI.h>
+#include <SPIScheduler.h>
+
+const int canCsPin = 9;
+const int canIntPin = 2;
+const int thermoCsPin = 10;
+
+enum { DEV_CAN, DEV_THERMO };
+
+volatile uint8_t canStatusByte;
+
+// MCP2515 READ STATUS: command byte, then the status repeats
+uint8_t canTx[2] = { 0xA0, 0xFF };
+uint8_t canRx[2];
+
+void canStatusDone(SPIRequest *req) {
+  canStatusByte = canRx[1];
+}
+
+SPIRequest canStatus = {
+  SPISettings(10000000, MSBFIRST, SPI_MODE0), canCsPin, canTx, canRx,
+  sizeof(canTx), SPI_PRIORITY_CAN_RX, DEV_CAN, 200, canStatusDone
+};
+
+uint8_t thermoRx[2];
+SPIRequest thermoRead = {
+  SPISettings(4000000, MSBFIRST, SPI_MODE0), thermoCsPin, NULL, thermoRx,
+  sizeof(thermoRx), SPI_PRIORITY_LOW, DEV_THERMO, 0, NULL
+};
+
+void canInterrupt() {
+  SPIScheduler.submit(&canStatus);
+  SPIScheduler.runNext();
+}
+
+void setup() {
+  Serial.begin(9600);
+  pinMode(canCsPin, OUTPUT);
+  digitalWrite(canCsPin, HIGH);
+  pinMode(thermoCsPin, OUTPUT);
+  digitalWrite(thermoCsPin, HIGH);
+  SPI.begin();
+
+  pinMode(canIntPin, INPUT);
+  attachInterrupt(digitalPinToInterrupt(canIntPin), canInterrupt, FALLING);
+}
+
+void printStats(const char *name, uint8_t device) {
+  noInterrupts();
+  SPIDeviceStats s = SPIScheduler.stats(device);
+  interrupts();
+  Serial.print(name);
+  Serial.print(": ");
+  Serial.print(s.transactions);
+  Serial.print(" transactions, max latency ");
+  Serial.print(s.maxLatency);
+  Serial.print(" us, avg ");
+  Serial.print(s.transactions ? s.totalLatency / s.transactions : 0);
+  Serial.print(" us, ");
+  Serial.print(s.missed);
+  Serial.println(" missed");
+}
+
+void loop() {
+  static unsigned long lastRead, lastStats;
+
+  if (millis() - lastRead >= 500) {
+    lastRead = millis();
+    SPIScheduler.submit(&thermoRead);
+  }
+  SPIScheduler.runAll();
+
+  if (millis() - lastStats >= 5000) {
+    lastStats = millis();
+    printStats("can", DEV_CAN);
+    printStats("thermocouple", DEV_THERMO);
+  }
+}
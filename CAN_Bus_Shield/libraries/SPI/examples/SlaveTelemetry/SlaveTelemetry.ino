@@ -0,0 +1,51 @@
+/*
+  Slave Telemetry
+
+  Runs the board as an SPI slave and queues a telemetry block with the
+  six analog inputs every 10 ms for a supervising processor to collect.
+  Each frame the master clocks out starts with the block length, see
+  SPISlave.h. Commands the master sends are echoed to the serial port.
+
+ The circuit:
+  * Master SCK, MOSI, MISO and SS to pins 13, 11, 12 and 10
+  * Master clocks at 4 MHz or less, mode 0, MSB first
+
+*/
+
+#include <SPI.h>
+#include <SPISlave.h>
+
+struct Telemetry {
+  unsigned long time;
+  int analog[6];
+};
+
+void setup() {
+  Serial.begin(115200);
+  SPISlave.begin(SPISettings(4000000, MSBFIRST, SPI_MODE0));
+}
+
+void loop() {
+  static unsigned long lastSample;
+
+  if (millis() - lastSample >= 10) {
+    lastSample += 10;
+    Telemetry t;
+    t.time = millis();
+    for (uint8_t i = 0; i < 6; i++)
+      t.analog[i] = analogRead(A0 + i);
+    if (!SPISlave.write(&t, sizeof(t)))
+      Serial.println("telemetry ring full");
+  }
+
+  uint8_t command[16];
+  uint8_t length = SPISlave.read(command, sizeof(command));
+  if (length) {
+    Serial.print("command:");
+    for (uint8_t i = 0; i < length; i++) {
+      Serial.print(' ');
+      Serial.print(command[i], HEX);
+    }
+    Serial.println();
+  }
+}
@@ -0,0 +1,906 @@
+// Runs the SPI library on the simulated board's SPI peripheral: byte by
+// byte and interrupt driven transferAsync(), the polled completion with
+// interrupts off, the flush in begin/endTransaction(), the blocking bulk
+// and word transfers, recovery from a mode fault, SPIDevice, SPIScheduler,
+// USARTSPI's register setup, SPISlave's framing and, built with
+// SPI_STATISTICS, the statistics. Exits non-zero if any check fails.
+
+#include <stdio.h>
+#include <SPI.h>
+#include <SPIDevice.h>
+#include <SPIScheduler.h>
+#include <SPISlave.h>
+#include <USARTSPI.h>
+
+static int failures;
+
+#define CHECK(cond) \
+  do { \
+    if (!(cond)) { \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      failures++; \
+    } \
+  } while (0)
+
+#define CS 9
+
+// A device on chip select CS. It logs every byte it is sent and answers
+// byte n of each selection with reply(n), so a byte that went missing or
+// ended up in the wrong place shows.
+class Recorder : public SimDevice {
+ public:
+  Recorder() : selected(false), index(0), count(0) {}
+
+  static uint8_t reply(uint8_t n) { return n * 37 + 11; }
+
+  void pinChanged(uint8_t pin, uint8_t level) {
+    if (pin == CS) {
+      selected = !level;
+      index = 0;
+    }
+  }
+  int16_t spiTransfer(uint8_t mosi) {
+    if (!selected) {
+      return -1;
+    }
+    if (count < sizeof(log)) {
+      log[count++] = mosi;
+    }
+    return reply(index++);
+  }
+
+  bool selected;
+  uint8_t index;
+  uint8_t log[64];
+  uint8_t count;
+};
+
+// A fresh board with dev attached, CS deselected and SPI started
+static void start(Recorder &dev) {
+  sim_reset();
+  sim_attach(&dev);
+  digitalWrite(CS, HIGH);
+  pinMode(CS, OUTPUT);
+  SPI.begin();
+}
+
+static void stop(void) {
+  SPI.end();
+}
+
+static bool sent(const Recorder &dev, const uint8_t *tx, uint8_t n) {
+  return dev.count == n && !memcmp(dev.log, tx, n);
+}
+
+static bool replies(const uint8_t *rx, uint8_t n) {
+  for (uint8_t i = 0; i < n; i++) {
+    if (rx[i] != Recorder::reply(i)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static uint8_t callbacks;
+
+static void done(void) {
+  callbacks++;
+}
+
+// F_CPU / 16: 128 CPU cycles per byte
+static SPISettings oneMHz(1000000, MSBFIRST, SPI_MODE0);
+
+// With interrupts on, transferAsync() returns once the first byte is on
+// its way and the SPI interrupt moves the rest.
+static void asyncInterrupt(void) {
+  Recorder dev;
+  uint8_t tx[16], rx[16];
+  for (uint8_t i = 0; i < sizeof(tx); i++) {
+    tx[i] = 0xA0 + i;
+  }
+
+  start(dev);
+  SPI.beginTransaction(oneMHz);
+  digitalWrite(CS, LOW);
+  callbacks = 0;
+  uint32_t interrupts = sim_stat.interrupts;
+  uint64_t begin = sim_cycles();
+  CHECK(SPI.transferAsync(tx, rx, sizeof(tx), done));
+  uint64_t started = sim_cycles() - begin;
+  CHECK(!SPI.asyncDone());
+  CHECK(SPCR & _BV(SPIE));
+  // One at a time
+  CHECK(!SPI.transferAsync(tx, rx, 1));
+  while (!SPI.asyncDone()) {
+    delayMicroseconds(1);
+  }
+  uint64_t took = sim_cycles() - begin;
+  digitalWrite(CS, HIGH);
+  SPI.endTransaction();
+
+  printf("transferAsync: 16 bytes in %llu cycles at F_CPU / 16\n",
+         (unsigned long long)took);
+  CHECK(started < 128);
+  CHECK(took >= 16 * 128 && took < 16 * 128 + 16 * 32);
+  CHECK(callbacks == 1);
+  CHECK(sim_stat.interrupts - interrupts == sizeof(tx));
+  CHECK(!(SPCR & _BV(SPIE)));
+  CHECK(sent(dev, tx, sizeof(tx)));
+  CHECK(replies(rx, sizeof(rx)));
+  stop();
+}
+
+// No tx sends 0xFF, no rx drops what comes back, nothing to send calls
+// the callback straight away.
+static void asyncNoBuffers(void) {
+  Recorder dev;
+  uint8_t ones[8];
+  memset(ones, 0xFF, sizeof(ones));
+
+  start(dev);
+  SPI.beginTransaction(oneMHz);
+  digitalWrite(CS, LOW);
+  callbacks = 0;
+  CHECK(SPI.transferAsync(NULL, NULL, sizeof(ones), done));
+  SPI.asyncFlush();
+  CHECK(SPI.asyncDone());
+  CHECK(sent(dev, ones, sizeof(ones)));
+  CHECK(SPI.transferAsync(NULL, NULL, 0, done));
+  CHECK(SPI.asyncDone());
+  CHECK(callbacks == 2);
+  digitalWrite(CS, HIGH);
+  SPI.endTransaction();
+  stop();
+}
+
+// With interrupts off the interrupt can't run, so transferAsync() does its
+// work by polling SPIF before it returns. Also the case inside a
+// transaction that masks everything, for usingInterrupt(255).
+static void asyncPolled(void) {
+  Recorder dev;
+  uint8_t tx[8], rx[8];
+  for (uint8_t i = 0; i < sizeof(tx); i++) {
+    tx[i] = 0x10 + i;
+  }
+
+  start(dev);
+  SPI.beginTransaction(oneMHz);
+  digitalWrite(CS, LOW);
+  callbacks = 0;
+  uint32_t interrupts = sim_stat.interrupts;
+  noInterrupts();
+  CHECK(SPI.transferAsync(tx, rx, sizeof(tx), done));
+  CHECK(SPI.asyncDone());
+  CHECK(callbacks == 1);
+  CHECK(!(SPCR & _BV(SPIE)));
+  interrupts();
+  digitalWrite(CS, HIGH);
+  SPI.endTransaction();
+  CHECK(sim_stat.interrupts == interrupts);
+  CHECK(sent(dev, tx, sizeof(tx)));
+  CHECK(replies(rx, sizeof(rx)));
+
+  dev.count = 0;
+  SPI.usingInterrupt(255);
+  SPI.beginTransaction(oneMHz);
+  CHECK(!(SREG & 0x80));
+  digitalWrite(CS, LOW);
+  CHECK(SPI.transferAsync(tx, rx, sizeof(tx), done));
+  CHECK(SPI.asyncDone());
+  digitalWrite(CS, HIGH);
+  SPI.endTransaction();
+  CHECK(SREG & 0x80);
+  SPI.notUsingInterrupt(255);
+  CHECK(callbacks == 2);
+  CHECK(sim_stat.interrupts == interrupts);
+  CHECK(sent(dev, tx, sizeof(tx)));
+  CHECK(replies(rx, sizeof(rx)));
+  stop();
+}
+
+// endTransaction() and the next beginTransaction() wait for a running
+// transfer, which keeps the clock it was started with.
+static void asyncFlushOnTransaction(void) {
+  Recorder dev;
+  uint8_t tx[4] = { 1, 2, 3, 4 };
+  uint8_t rx[4];
+
+  start(dev);
+  SPI.beginTransaction(oneMHz);
+  digitalWrite(CS, LOW);
+  CHECK(SPI.transferAsync(tx, rx, sizeof(tx)));
+  SPI.endTransaction();
+  CHECK(SPI.asyncDone());
+  CHECK(sent(dev, tx, sizeof(tx)));
+  CHECK(replies(rx, sizeof(rx)));
+  digitalWrite(CS, HIGH);
+
+  // F_CPU / 128 for the transfer, then F_CPU / 2
+  dev.count = 0;
+  SPI.beginTransaction(SPISettings(125000, MSBFIRST, SPI_MODE0));
+  digitalWrite(CS, LOW);
+  uint64_t begin = sim_cycles();
+  CHECK(SPI.transferAsync(tx, rx, sizeof(tx)));
+  SPI.beginTransaction(SPISettings(8000000, MSBFIRST, SPI_MODE0));
+  CHECK(SPI.asyncDone());
+  CHECK(sim_cycles() - begin >= 4 * 8 * 128);
+  CHECK((SPCR & 3) == 0 && (SPSR & _BV(SPI2X)));
+  CHECK(sent(dev, tx, sizeof(tx)));
+  CHECK(replies(rx, sizeof(rx)));
+  digitalWrite(CS, HIGH);
+  SPI.endTransaction();
+  stop();
+}
+
+// The blocking bulk transfers against transfer(buf, n), which every other
+// one has to match byte for byte on the wire.
+static void bulk(void) {
+  Recorder dev;
+  uint8_t tx[32], rx[32], buf[32], fill[32];
+  for (uint8_t i = 0; i < sizeof(tx); i++) {
+    tx[i] = i * 7 + 1;
+  }
+
+  start(dev);
+  SPI.beginTransaction(oneMHz);
+
+  memcpy(buf, tx, sizeof(buf));
+  digitalWrite(CS, LOW);
+  SPI.transfer(buf, sizeof(buf));
+  digitalWrite(CS, HIGH);
+  CHECK(sent(dev, tx, sizeof(tx)));
+  CHECK(replies(buf, sizeof(buf)));
+
+  dev.count = 0;
+  memset(rx, 0, sizeof(rx));
+  digitalWrite(CS, LOW);
+  SPI.transfer(tx, rx, sizeof(rx));
+  digitalWrite(CS, HIGH);
+  CHECK(sent(dev, tx, sizeof(tx)));
+  CHECK(replies(rx, sizeof(rx)));
+
+  // In place, like transfer(buf, n)
+  dev.count = 0;
+  memcpy(buf, tx, sizeof(buf));
+  digitalWrite(CS, LOW);
+  SPI.transfer(buf, buf, sizeof(buf));
+  digitalWrite(CS, HIGH);
+  CHECK(sent(dev, tx, sizeof(tx)));
+  CHECK(replies(buf, sizeof(buf)));
+
+  // write() leaves SPIF clear for the next transfer
+  dev.count = 0;
+  digitalWrite(CS, LOW);
+  SPI.write(tx, sizeof(tx));
+  CHECK(!(SPSR & _BV(SPIF)));
+  digitalWrite(CS, HIGH);
+  CHECK(sent(dev, tx, sizeof(tx)));
+
+  dev.count = 0;
+  memset(fill, 0xFF, sizeof(fill));
+  digitalWrite(CS, LOW);
+  SPI.read(rx, sizeof(rx));
+  digitalWrite(CS, HIGH);
+  CHECK(sent(dev, fill, sizeof(fill)));
+  CHECK(replies(rx, sizeof(rx)));
+
+  dev.count = 0;
+  memset(fill, 0x5A, sizeof(fill));
+  digitalWrite(CS, LOW);
+  SPI.read(rx, sizeof(rx), 0x5A);
+  digitalWrite(CS, HIGH);
+  CHECK(sent(dev, fill, sizeof(fill)));
+  CHECK(replies(rx, sizeof(rx)));
+
+  // Nothing to move touches nothing
+  dev.count = 0;
+  digitalWrite(CS, LOW);
+  SPI.transfer(tx, rx, 0);
+  SPI.write(tx, 0);
+  SPI.read(rx, 0);
+  digitalWrite(CS, HIGH);
+  CHECK(dev.count == 0);
+
+  CHECK(!(SPSR & _BV(WCOL)));
+  SPI.endTransaction();
+  stop();
+}
+
+// The word transfers in both bit orders: bytes go out most or least
+// significant first, and the replies are put back in the same order.
+static void words(void) {
+  static const uint8_t msb16[] = { 0x12, 0x34 }, lsb16[] = { 0x34, 0x12 };
+  static const uint8_t msb24[] = { 0x56, 0x78, 0x9A }, lsb24[] = { 0x9A, 0x78, 0x56 };
+  static const uint8_t msb32[] = { 0xDE, 0xAD, 0xBE, 0xEF }, lsb32[] = { 0xEF, 0xBE, 0xAD, 0xDE };
+  const uint32_t r0 = Recorder::reply(0), r1 = Recorder::reply(1);
+  const uint32_t r2 = Recorder::reply(2), r3 = Recorder::reply(3);
+  Recorder dev;
+
+  start(dev);
+  SPI.beginTransaction(oneMHz);
+  digitalWrite(CS, LOW);
+  CHECK(SPI.transfer16(0x1234) == (r0 << 8 | r1));
+  digitalWrite(CS, HIGH);
+  CHECK(sent(dev, msb16, sizeof(msb16)));
+
+  dev.count = 0;
+  digitalWrite(CS, LOW);
+  // The top byte is neither sent nor returned
+  CHECK(SPI.transfer24(0xFF56789A) == (r0 << 16 | r1 << 8 | r2));
+  digitalWrite(CS, HIGH);
+  CHECK(sent(dev, msb24, sizeof(msb24)));
+
+  dev.count = 0;
+  digitalWrite(CS, LOW);
+  CHECK(SPI.transfer32(0xDEADBEEF) == (r0 << 24 | r1 << 16 | r2 << 8 | r3));
+  digitalWrite(CS, HIGH);
+  CHECK(sent(dev, msb32, sizeof(msb32)));
+  SPI.endTransaction();
+
+  SPI.beginTransaction(SPISettings(1000000, LSBFIRST, SPI_MODE0));
+  dev.count = 0;
+  digitalWrite(CS, LOW);
+  CHECK(SPI.transfer16(0x1234) == (r1 << 8 | r0));
+  digitalWrite(CS, HIGH);
+  CHECK(sent(dev, lsb16, sizeof(lsb16)));
+
+  dev.count = 0;
+  digitalWrite(CS, LOW);
+  CHECK(SPI.transfer24(0xFF56789A) == (r2 << 16 | r1 << 8 | r0));
+  digitalWrite(CS, HIGH);
+  CHECK(sent(dev, lsb24, sizeof(lsb24)));
+
+  dev.count = 0;
+  digitalWrite(CS, LOW);
+  CHECK(SPI.transfer32(0xDEADBEEF) == (r3 << 24 | r2 << 16 | r1 << 8 | r0));
+  digitalWrite(CS, HIGH);
+  CHECK(sent(dev, lsb32, sizeof(lsb32)));
+  SPI.endTransaction();
+  stop();
+}
+
+// Another master pulling SS low while it is an input knocks the AVR into
+// slave mode. The next beginTransaction() puts MSTR back, even with the
+// same settings as the transaction before.
+class OtherMaster : public SimDevice {
+ public:
+  OtherMaster() : ss(-1) {}
+  int8_t pinLevel(uint8_t pin) { return pin == SS ? ss : -1; }
+  int8_t ss;
+};
+
+static void modeFault(void) {
+  Recorder dev;
+  OtherMaster other;
+  uint8_t tx[2] = { 0x12, 0x34 }, rx[2];
+
+  start(dev);
+  sim_attach(&other);
+  SPI.beginTransaction(oneMHz);
+  SPI.endTransaction();
+  CHECK(SPCR & _BV(MSTR));
+
+  pinMode(SS, INPUT);
+  other.ss = LOW;
+  delayMicroseconds(1);
+  CHECK(!(SPCR & _BV(MSTR)));
+  CHECK(SPSR & _BV(SPIF));
+  (void)SPDR;
+  other.ss = -1;
+  delayMicroseconds(1);
+
+  SPI.beginTransaction(oneMHz);
+  CHECK(SPCR & _BV(MSTR));
+  // As a slave it would wait for SPIF for ever
+  if (SPCR & _BV(MSTR)) {
+    digitalWrite(CS, LOW);
+    SPI.transfer(tx, rx, sizeof(tx));
+    digitalWrite(CS, HIGH);
+    CHECK(sent(dev, tx, sizeof(tx)));
+    CHECK(replies(rx, sizeof(rx)));
+  }
+  SPI.endTransaction();
+  pinMode(SS, OUTPUT);
+  stop();
+}
+
+// SPIDevice, built for the AVR (-D__AVR) in spi_host_avr so chip select
+// goes through the port registers.
+static void device(void) {
+  static const uint8_t values[] = { 0x40, 0xC0, 0xFE, 0xED };
+  static const uint8_t reads[] = { 0x8A, 0x00, 0x00, 0x00 };
+  Recorder dev;
+  uint8_t rx[3];
+
+  // Resolves its pin on the board it is constructed on
+  sim_reset();
+  sim_attach(&dev);
+  SPIDevice pot(CS, SPISettings(4000000, LSBFIRST, SPI_MODE3));
+  pot.begin();
+  CHECK(sim_output(CS) == HIGH);
+  CHECK(SPCR & _BV(SPE));
+
+  pot.select();
+  CHECK(SPCR == (_BV(SPE) | _BV(MSTR) | _BV(DORD) | _BV(CPOL) | _BV(CPHA)));
+  CHECK(!(SPSR & _BV(SPI2X)));
+  delayMicroseconds(1);
+  CHECK(dev.selected);
+  pot.deselect();
+  delayMicroseconds(1);
+  CHECK(!dev.selected);
+  CHECK(dev.count == 0);
+
+  pot.writeRegisters(values[0], values + 1, sizeof(values) - 1);
+  delayMicroseconds(1);
+  CHECK(!dev.selected);
+  CHECK(sent(dev, values, sizeof(values)));
+
+  dev.count = 0;
+  pot.readRegisters(reads[0], rx, sizeof(rx));
+  CHECK(sent(dev, reads, sizeof(reads)));
+  for (uint8_t i = 0; i < sizeof(rx); i++) {
+    CHECK(rx[i] == Recorder::reply(i + 1));
+  }
+
+  dev.count = 0;
+  CHECK(pot.readRegister(0x8B) == Recorder::reply(1));
+  pot.writeRegister(0x0B, 0x99);
+  CHECK(dev.count == 4 && dev.log[2] == 0x0B && dev.log[3] == 0x99);
+  CHECK(pot.pin() == CS);
+  stop();
+}
+
+// SPIScheduler: requests tagged by their first tx byte, and the order
+// their callbacks ran in.
+static uint8_t ran[8];
+static uint8_t nran;
+
+static void record(SPIRequest *req) {
+  if (nran < sizeof(ran)) {
+    ran[nran++] = *(const uint8_t *)req->tx;
+  }
+}
+
+static void request(SPIRequest &req, const uint8_t *tx, size_t count, uint8_t priority,
+                    unsigned long deadline, uint8_t device = 0) {
+  req = SPIRequest();
+  req.settings = oneMHz;
+  req.csPin = CS;
+  req.tx = tx;
+  req.count = count;
+  req.priority = priority;
+  req.device = device;
+  req.deadline = deadline;
+  req.callback = record;
+}
+
+static bool ranInOrder(const uint8_t *order, uint8_t n) {
+  return nran == n && !memcmp(ran, order, n);
+}
+
+// Highest priority first; within a priority the earliest deadline, then
+// those without one. Equal requests, deadline ties included, keep their
+// submission order.
+static const uint8_t ids[] = { 1, 2, 3, 4, 5, 6, 7 };
+
+// Submits the seven requests on a fresh board. 6 is due the same
+// microsecond as 3, deadline 1000 us, given how much later it was submitted.
+static void submitSeven(Recorder &dev, SPIRequest *req, unsigned long later) {
+  start(dev);
+  request(req[0], &ids[0], 1, SPI_PRIORITY_LOW, 0);
+  request(req[1], &ids[1], 1, SPI_PRIORITY_NORMAL, 5000);
+  request(req[2], &ids[2], 1, SPI_PRIORITY_NORMAL, 1000);
+  request(req[3], &ids[3], 1, SPI_PRIORITY_HIGH, 0);
+  request(req[4], &ids[4], 1, SPI_PRIORITY_NORMAL, 0);
+  request(req[5], &ids[5], 1, SPI_PRIORITY_NORMAL, 1000 - later);
+  request(req[6], &ids[6], 1, SPI_PRIORITY_NORMAL, 0);
+  for (uint8_t i = 0; i < 7; i++) {
+    CHECK(SPIScheduler.submit(&req[i]));
+    CHECK(req[i].state == SPI_REQ_QUEUED);
+  }
+}
+
+static void schedulerOrder(void) {
+  static const uint8_t order[] = { 4, 3, 6, 2, 5, 7, 1 };
+  SPIRequest req[7];
+  Recorder dev;
+
+  // The simulation is deterministic: a first run tells how far apart 3
+  // and 6 are submitted, the second one uses it for the tie
+  submitSeven(dev, req, 0);
+  unsigned long later = req[5].submitted - req[2].submitted;
+  for (uint8_t i = 0; i < 7; i++) {
+    CHECK(SPIScheduler.cancel(&req[i]));
+  }
+  stop();
+  CHECK(SPIScheduler.idle());
+  submitSeven(dev, req, later);
+  CHECK(req[5].submitted + req[5].deadline == req[2].submitted + req[2].deadline);
+  CHECK(later > 0);
+  SPIScheduler.resetStats();
+  nran = 0;
+  // Once is enough
+  CHECK(!SPIScheduler.submit(&req[0]));
+  CHECK(!SPIScheduler.idle());
+
+  SPIScheduler.runAll();
+  CHECK(ranInOrder(order, sizeof(order)));
+  CHECK(SPIScheduler.idle());
+  CHECK(sent(dev, order, sizeof(order)));
+  for (uint8_t i = 0; i < 7; i++) {
+    CHECK(req[i].state == SPI_REQ_DONE);
+  }
+
+  // A deadline submitted later but due sooner goes first
+  nran = 0;
+  request(req[0], &ids[0], 1, SPI_PRIORITY_NORMAL, 3000);
+  request(req[1], &ids[1], 1, SPI_PRIORITY_NORMAL, 1000);
+  CHECK(SPIScheduler.submit(&req[0]));
+  delayMicroseconds(1500);
+  CHECK(SPIScheduler.submit(&req[1]));
+  SPIScheduler.runAll();
+  CHECK(nran == 2 && ran[0] == 2 && ran[1] == 1);
+
+  // Cancelled before it ran
+  nran = 0;
+  CHECK(SPIScheduler.submit(&req[0]));
+  CHECK(SPIScheduler.cancel(&req[0]));
+  CHECK(req[0].state == SPI_REQ_IDLE);
+  CHECK(!SPIScheduler.cancel(&req[0]));
+  CHECK(!SPIScheduler.runNext());
+  CHECK(nran == 0);
+  stop();
+}
+
+// A request submitted from an interrupt handler while another one holds
+// the bus waits for it to finish, then goes ahead of everything queued.
+static SPIRequest urgent;
+static bool urgentRanAtOnce;
+
+static void canInterrupt(void) {
+  SPIScheduler.submit(&urgent);
+  urgentRanAtOnce = SPIScheduler.runNext();
+}
+
+class Interrupter : public Recorder {
+ public:
+  Interrupter() : irq(-1) {}
+  int8_t pinLevel(uint8_t pin) { return pin == 2 ? irq : -1; }
+  int16_t spiTransfer(uint8_t mosi) {
+    int16_t reply = Recorder::spiTransfer(mosi);
+    // Halfway through the first request
+    if (selected && count == 4 && irq < 0) {
+      irq = LOW;
+      sim_input_changed(2, LOW);
+    }
+    return reply;
+  }
+  int8_t irq;
+};
+
+static void schedulerRunToCompletion(void) {
+  static const uint8_t first[] = { 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17 };
+  static const uint8_t low[] = { 0x30 };
+  static const uint8_t can[] = { 0x20, 0x21 };
+  static const uint8_t wire[] = { 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17,
+                                  0x20, 0x21, 0x30 };
+  static const uint8_t order[] = { 0x10, 0x20, 0x30 };
+  SPIRequest a, b;
+  Interrupter dev;
+
+  start(dev);
+  pinMode(2, INPUT);
+  attachInterrupt(digitalPinToInterrupt(2), canInterrupt, FALLING);
+  nran = 0;
+  urgentRanAtOnce = true;
+  request(a, first, sizeof(first), SPI_PRIORITY_NORMAL, 0);
+  request(b, low, sizeof(low), SPI_PRIORITY_LOW, 0);
+  request(urgent, can, sizeof(can), SPI_PRIORITY_CAN_RX, 0);
+  CHECK(SPIScheduler.submit(&a));
+  CHECK(SPIScheduler.submit(&b));
+
+  CHECK(SPIScheduler.runNext());
+  CHECK(dev.irq == LOW);
+  CHECK(!urgentRanAtOnce);
+  CHECK(urgent.state == SPI_REQ_QUEUED);
+  SPIScheduler.runAll();
+  CHECK(ranInOrder(order, sizeof(order)));
+  CHECK(sent(dev, wire, sizeof(wire)));
+  detachInterrupt(digitalPinToInterrupt(2));
+  stop();
+}
+
+// Latency from submit() to completion per device slot, and the deadlines
+// missed. At F_CPU / 128 eight bytes take 512 us.
+static void schedulerStats(void) {
+  static const uint8_t tx[8] = { 0x40 };
+  SPIRequest slow, quick, whenever, untracked;
+  Recorder dev;
+
+  start(dev);
+  SPIScheduler.resetStats();
+  nran = 0;
+  request(slow, tx, sizeof(tx), SPI_PRIORITY_NORMAL, 100, 1);
+  request(quick, tx, 1, SPI_PRIORITY_NORMAL, 10000, 2);
+  request(whenever, tx, 1, SPI_PRIORITY_NORMAL, 0, 3);
+  request(untracked, tx, 1, SPI_PRIORITY_NORMAL, 0, SPI_SCHED_DEVICES);
+  slow.settings = SPISettings(125000, MSBFIRST, SPI_MODE0);
+  quick.settings = slow.settings;
+
+  for (uint8_t i = 0; i < 3; i++) {
+    CHECK(SPIScheduler.submit(&slow));
+    SPIScheduler.runAll();
+  }
+  CHECK(SPIScheduler.submit(&quick));
+  CHECK(SPIScheduler.submit(&whenever));
+  CHECK(SPIScheduler.submit(&untracked));
+  SPIScheduler.runAll();
+
+  const SPIDeviceStats &s1 = SPIScheduler.stats(1);
+  CHECK(s1.transactions == 3);
+  CHECK(s1.missed == 3);
+  CHECK(s1.maxLatency >= 512 && s1.maxLatency < 600);
+  CHECK(s1.totalLatency >= 3 * 512 && s1.totalLatency <= 3 * s1.maxLatency);
+  const SPIDeviceStats &s2 = SPIScheduler.stats(2);
+  CHECK(s2.transactions == 1);
+  CHECK(s2.missed == 0);
+  CHECK(s2.maxLatency >= 64 && s2.maxLatency == s2.totalLatency);
+  // No deadline, nothing to miss
+  const SPIDeviceStats &s3 = SPIScheduler.stats(3);
+  CHECK(s3.transactions == 1);
+  CHECK(s3.missed == 0);
+  CHECK(SPIScheduler.stats(0).transactions == 0);
+  CHECK(nran == 6);
+
+  SPIScheduler.resetStats();
+  CHECK(SPIScheduler.stats(1).transactions == 0 && SPIScheduler.stats(1).maxLatency == 0);
+  stop();
+}
+
+// USARTSPI on plain memory standing in for a USART's registers: with RXC
+// and UDRE always set and UDR reading back what was written, the bus
+// loops every byte back at once. That is enough for the MSPIM setup and
+// for the bulk loop's byte counting; the timing needs simavr
+// (bench/spi_bench).
+struct FakeUSART {
+  uint8_t ucsra, ucsrb, ucsrc, ubrrl, ubrrh, udr, ddr;
+};
+
+static void usartSPI(void) {
+  FakeUSART u = { 0, 0, 0, 0xAA, 0xAA, 0, 0x01 };
+  USARTSPIClass bus(&u.ucsra, &u.ucsrb, &u.ucsrc, &u.ubrrl, &u.ubrrh, &u.udr, &u.ddr, 0x10);
+
+  bus.begin();
+  CHECK(u.ucsrc == 0xC0);                       // UMSEL = 11, mode 0, MSB first
+  CHECK(u.ucsrb == 0x18);                       // RXEN | TXEN
+  CHECK(u.ubrrh == 0 && u.ubrrl == 1);          // F_CPU / 4
+  CHECK(u.ddr == 0x11);                         // XCK an output
+
+  // UBRR = divider / 2 - 1, the divider SPI would use
+  bus.beginTransaction(SPISettings(8000000, MSBFIRST, SPI_MODE0));
+  CHECK(u.ubrrl == 0 && u.ucsrc == 0xC0);
+  bus.beginTransaction(SPISettings(1000000, LSBFIRST, SPI_MODE0));
+  CHECK(u.ubrrl == 7 && u.ucsrc == 0xC4);       // UDORD
+  bus.beginTransaction(SPISettings(125000, MSBFIRST, SPI_MODE1));
+  CHECK(u.ubrrl == 63 && u.ucsrc == 0xC2);      // UCPHA
+  bus.beginTransaction(SPISettings(4000000, MSBFIRST, SPI_MODE3));
+  CHECK(u.ubrrl == 1 && u.ucsrc == 0xC3);       // UCPOL | UCPHA
+  bus.beginTransaction(SPISettings(4000000, MSBFIRST, SPI_MODE2));
+  CHECK(u.ucsrc == 0xC1);                       // UCPOL
+
+  u.ucsra = 0xA0;                               // RXC | UDRE
+  uint8_t tx[8], rx[8], buf[8], fill[8];
+  for (uint8_t i = 0; i < sizeof(tx); i++) {
+    tx[i] = 0x30 + i;
+  }
+  CHECK(bus.transfer(0x5A) == 0x5A);
+  bus.transfer(tx, rx, sizeof(rx));
+  CHECK(!memcmp(rx, tx, sizeof(rx)));
+  memcpy(buf, tx, sizeof(buf));
+  bus.transfer(buf, sizeof(buf));
+  CHECK(!memcmp(buf, tx, sizeof(buf)));
+  bus.read(rx, sizeof(rx), 0x66);
+  memset(fill, 0x66, sizeof(fill));
+  CHECK(!memcmp(rx, fill, sizeof(rx)));
+  bus.write(tx, sizeof(tx));
+  CHECK(u.udr == tx[sizeof(tx) - 1]);
+  // Both byte orders put the word back together
+  CHECK(bus.transfer16(0x1234) == 0x1234);
+  bus.beginTransaction(SPISettings(4000000, LSBFIRST, SPI_MODE0));
+  CHECK(bus.transfer16(0x1234) == 0x1234);
+  CHECK(u.udr == 0x12);
+
+  bus.end();
+  CHECK(u.ucsrb == 0 && u.ucsrc == 0);
+  CHECK(u.ddr == 0x01);
+}
+
+// SPISlave, with the master modelled here: it drives SS, which reaches the
+// slave through the pin change interrupt, and clocks bytes through the
+// peripheral with sim_spi_slave(), leaving the slave's SPI interrupt time
+// to run between them.
+class Master : public SimDevice {
+ public:
+  Master() : ss(HIGH) {}
+  int8_t pinLevel(uint8_t pin) { return pin == SS ? ss : -1; }
+
+  void select(uint8_t level) {
+    ss = level;
+    sim_input_changed(SS, level);
+    delayMicroseconds(4);
+  }
+  void clock(const uint8_t *tx, uint8_t *rx, uint8_t n) {
+    for (uint8_t i = 0; i < n; i++) {
+      rx[i] = sim_spi_slave(tx[i]);
+      delayMicroseconds(4);
+    }
+  }
+
+  int8_t ss;
+};
+
+// Queued blocks go out as a length byte, the block and then 0xFF, and
+// what the master sends in a frame comes back as one frame.
+static void slaveFrames(void) {
+  Master master;
+  uint8_t block[3] = { 0x01, 0x02, 0x03 };
+  uint8_t tx[5] = { 0x10, 0x11, 0x12, 0x13, 0x14 }, rx[5], buf[8];
+  uint8_t expect[5] = { 3, 0x01, 0x02, 0x03, 0xFF };
+
+  sim_reset();
+  sim_attach(&master);
+  SPISlave.begin();
+  CHECK(!(SPCR & _BV(MSTR)) && (SPCR & _BV(SPIE)));
+  CHECK(SPISlave.write(block, sizeof(block)));
+
+  master.select(LOW);
+  master.clock(tx, rx, sizeof(tx));
+  master.select(HIGH);
+  CHECK(!memcmp(rx, expect, sizeof(rx)));
+  CHECK(SPISlave.available());
+  CHECK(SPISlave.read(buf, sizeof(buf)) == sizeof(tx));
+  CHECK(!memcmp(buf, tx, sizeof(tx)));
+  CHECK(!SPISlave.available());
+
+  // Nothing queued: a length of 0
+  master.select(LOW);
+  master.clock(tx, rx, 2);
+  master.select(HIGH);
+  CHECK(rx[0] == 0 && rx[1] == 0xFF);
+  CHECK(SPISlave.read(buf, sizeof(buf)) == 2);
+  CHECK(SPISlave.rxOverruns() == 0);
+  CHECK(SPISlave.txTruncated() == 0);
+  SPISlave.end();
+}
+
+// begin() with SS already low joins a frame halfway through. The rest of
+// that frame is dropped rather than handed to read() without its start,
+// SPDR is left alone while it is being clocked, and the next frame is
+// whole.
+static void slaveStartedMidFrame(void) {
+  Master master;
+  uint8_t block[2] = { 0xB1, 0xB2 };
+  uint8_t tail[3] = { 0x21, 0x22, 0x23 };
+  uint8_t tx[4] = { 0x31, 0x32, 0x33, 0x34 }, rx[4], buf[8];
+  uint8_t expect[4] = { 2, 0xB1, 0xB2, 0xFF };
+
+  sim_reset();
+  sim_attach(&master);
+  // What the shift register holds from before
+  SPDR = 0x5A;
+  master.ss = LOW;
+  SPISlave.begin();
+  // Not loaded until SS rises
+  CHECK(SPISlave.write(block, sizeof(block)));
+  master.clock(tail, rx, sizeof(tail));
+  CHECK(rx[0] == 0x5A);
+  CHECK(rx[1] == 0xFF && rx[2] == 0xFF);
+  master.select(HIGH);
+  CHECK(!SPISlave.available());
+  CHECK(SPISlave.rxOverruns() == 1);
+
+  master.select(LOW);
+  master.clock(tx, rx, sizeof(tx));
+  master.select(HIGH);
+  CHECK(!memcmp(rx, expect, sizeof(rx)));
+  CHECK(SPISlave.read(buf, sizeof(buf)) == sizeof(tx));
+  CHECK(!memcmp(buf, tx, sizeof(tx)));
+  CHECK(!SPISlave.available());
+  CHECK(SPISlave.txTruncated() == 0);
+  SPISlave.end();
+}
+
+#ifdef SPI_STATISTICS
+// spi_host_stats only: the counters, and the longest masked window per
+// usingInterrupt() slot.
+static void transaction(unsigned int us) {
+  SPI.beginTransaction(oneMHz);
+  delayMicroseconds(us);
+  SPI.endTransaction();
+}
+
+// A window of us, give or take the micros() calls around it
+static bool window(uint16_t micros, uint16_t us) {
+  return micros >= us && micros <= us + 3;
+}
+
+static void statistics(void) {
+  Recorder dev;
+  uint8_t buf[8] = { 0 };
+  const SPIStatistics &stats = SPI.statistics();
+
+  start(dev);
+  SPI.resetStatistics();
+  CHECK(stats.transactions == 0 && stats.bytes == 0 && stats.busyMicros == 0);
+
+  SPI.beginTransaction(oneMHz);
+  digitalWrite(CS, LOW);
+  SPI.transfer(0x01);
+  SPI.transfer16(0x0203);
+  SPI.transfer(buf, sizeof(buf));
+  digitalWrite(CS, HIGH);
+  SPI.endTransaction();
+  CHECK(stats.transactions == 1);
+  CHECK(stats.bytes == 11 && dev.count == 11);
+
+  // Nothing registered, so nothing was masked. asyncPolled() registered
+  // 255 before the last SPI.end(), which doesn't count any more.
+  transaction(100);
+  CHECK(stats.transactions == 2);
+  CHECK(SPI.maxMaskedMicros(0) == 0 && SPI.maxMaskedMicros(255) == 0);
+
+  // Masking INT0 only: its slot keeps the longest window
+  SPI.usingInterrupt(0);
+  transaction(50);
+  transaction(20);
+  CHECK(window(SPI.maxMaskedMicros(0), 50));
+  CHECK(SPI.maxMaskedMicros(1) == 0);
+  CHECK(SPI.maxMaskedMicros(255) == 0);
+
+  // Masking everything counts for every registered slot. Numbers past 7
+  // share the last one.
+  SPI.usingInterrupt(255);
+  transaction(30);
+  CHECK(window(SPI.maxMaskedMicros(255), 30));
+  CHECK(SPI.maxMaskedMicros(200) == SPI.maxMaskedMicros(255));
+  CHECK(window(SPI.maxMaskedMicros(0), 50));
+  transaction(70);
+  CHECK(window(SPI.maxMaskedMicros(0), 70));
+  CHECK(window(SPI.maxMaskedMicros(255), 70));
+  CHECK(SPI.maxMaskedMicros(1) == 0);
+  CHECK(stats.transactions == 6);
+  CHECK(stats.busyMicros >= 100 + 50 + 20 + 30 + 70);
+
+  SPI.resetStatistics();
+  CHECK(stats.transactions == 0 && stats.bytes == 0 && stats.busyMicros == 0);
+  CHECK(SPI.maxMaskedMicros(0) == 0 && SPI.maxMaskedMicros(255) == 0);
+  stop();
+}
+#endif
+
+int main(void) {
+  asyncInterrupt();
+  asyncNoBuffers();
+  asyncPolled();
+  asyncFlushOnTransaction();
+  bulk();
+  words();
+  modeFault();
+  device();
+  schedulerOrder();
+  schedulerRunToCompletion();
+  schedulerStats();
+  usartSPI();
+  slaveFrames();
+  slaveStartedMidFrame();
+#ifdef SPI_STATISTICS
+  statistics();
+#endif
+
+  if (failures) {
+    fprintf(stderr, "%d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("all checks passed\n");
+  return 0;
+}
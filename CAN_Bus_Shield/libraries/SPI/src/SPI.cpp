@@ -19,9 +19,20 @@ uint8_t SPIClass::initialized = 0;
 uint8_t SPIClass::interruptMode = 0;
 uint8_t SPIClass::interruptMask = 0;
 uint8_t SPIClass::interruptSave = 0;
+const uint8_t *SPIClass::asyncTx = NULL;
+uint8_t *SPIClass::asyncRx = NULL;
+size_t SPIClass::asyncCount = 0;
+SPIAsyncCallback SPIClass::asyncCallback = NULL;
+volatile uint8_t SPIClass::asyncBusy = 0;
+void (*SPIClass::slaveHandler)(void) = NULL;
 #ifdef SPI_TRANSACTION_MISMATCH_LED
 uint8_t SPIClass::inTransactionFlag = 0;
 #endif
+#ifdef SPI_STATISTICS
+SPIStatistics SPIClass::stats;
+unsigned long SPIClass::statsStart = 0;
+uint16_t SPIClass::statsRegistered = 0;
+#endif
 
 void SPIClass::begin()
 {
@@ -71,8 +82,12 @@ void SPIClass::end() {
     initialized--;
   // If there are no more references disable SPI
   if (!initialized) {
+    if (asyncBusy) asyncFlush();
     SPCR &= ~_BV(SPE);
     interruptMode = 0;
+    #ifdef SPI_STATISTICS
+    statsRegistered = 0;
+    #endif
     #ifdef SPI_TRANSACTION_MISMATCH_LED
     inTransactionFlag = 0;
     #endif
@@ -154,6 +169,9 @@ void SPIClass::usingInterrupt(uint8_t interruptNumber)
   interruptMask |= mask;
   if (!interruptMode)
     interruptMode = 1;
+  #ifdef SPI_STATISTICS
+  statsRegistered |= 1 << statsSlot(interruptNumber);
+  #endif
   SREG = sreg;
 }
 
@@ -197,5 +215,113 @@ void SPIClass::notUsingInterrupt(uint8_t interruptNumber)
   interruptMask &= ~mask;
   if (!interruptMask)
     interruptMode = 0;
+  #ifdef SPI_STATISTICS
+  statsRegistered &= ~(1 << statsSlot(interruptNumber));
+  #endif
+  SREG = sreg;
+}
+
+#ifdef SPI_STATISTICS
+void SPIClass::statsEnd(void)
+{
+  unsigned long elapsed = micros() - statsStart;
+  uint8_t sreg = SREG;
+  noInterrupts();
+  stats.transactions++;
+  stats.busyMicros += elapsed;
+  // In mode 1 only the registered external interrupts were masked, in
+  // mode 2 everything was, so in both cases every registered slot counts
+  if (interruptMode > 0) {
+    uint16_t window = elapsed > 0xFFFF ? 0xFFFF : elapsed;
+    for (uint8_t i = 0; i < SPI_STATS_INTERRUPTS; i++) {
+      if ((statsRegistered & (1 << i)) && window > stats.maxMaskedMicros[i])
+        stats.maxMaskedMicros[i] = window;
+    }
+  }
+  SREG = sreg;
+}
+
+uint16_t SPIClass::maxMaskedMicros(uint8_t interruptNumber)
+{
+  uint8_t sreg = SREG;
+  noInterrupts();
+  uint16_t window = stats.maxMaskedMicros[statsSlot(interruptNumber)];
+  SREG = sreg;
+  return window;
+}
+
+void SPIClass::resetStatistics(void)
+{
+  uint8_t sreg = SREG;
+  noInterrupts();
+  memset(&stats, 0, sizeof(stats));
+  SREG = sreg;
+}
+#endif
+
+bool SPIClass::transferAsync(const void *tx, void *rx, size_t count,
+                             SPIAsyncCallback callback)
+{
+  uint8_t sreg = SREG;
+  noInterrupts();
+  if (asyncBusy) {
+    SREG = sreg;
+    return false;
+  }
+  if (count == 0) {
+    SREG = sreg;
+    if (callback) callback();
+    return true;
+  }
+  asyncTx = (const uint8_t *)tx;
+  asyncRx = (uint8_t *)rx;
+  asyncCount = count;
+  asyncCallback = callback;
+  asyncBusy = 1;
+  SPI_COUNT_BYTES(count);
+
+  // Clear a SPIF left over from before so the interrupt doesn't fire early
+  // (reading SPSR then SPDR clears it)
+  (void)SPSR;
+  (void)SPDR;
+  SPCR |= _BV(SPIE);
+  SPDR = asyncTx ? *asyncTx++ : 0xFF;
   SREG = sreg;
+
+  if (!(sreg & _BV(SREG_I))) asyncFlush();
+  return true;
+}
+
+void SPIClass::asyncFlush()
+{
+  while (asyncBusy) {
+    // With interrupts disabled the ISR can't run, so do its work here
+    if (!(SREG & _BV(SREG_I)) && (SPSR & _BV(SPIF))) {
+      handleInterrupt();
+    }
+  }
+}
+
+void SPIClass::handleInterrupt()
+{
+  if (slaveHandler) {
+    slaveHandler();
+    return;
+  }
+  uint8_t in = SPDR;
+  if (asyncRx) *asyncRx++ = in;
+  if (--asyncCount) {
+    SPDR = asyncTx ? *asyncTx++ : 0xFF;
+    return;
+  }
+  SPCR &= ~_BV(SPIE);
+  asyncBusy = 0;
+  if (asyncCallback) asyncCallback();
+}
+
+// Weak, so sketches that install their own SPI interrupt handler keep
+// working as long as they don't use transferAsync()
+ISR(SPI_STC_vect, __attribute__((weak)))
+{
+  SPIClass::handleInterrupt();
 }
@@ -30,6 +30,27 @@
 // available too.
 #define SPI_ATOMIC_VERSION 1
 
+// SPI_HAS_TRANSFER_ASYNC means SPI has transferAsync(), driven by the SPI
+// transfer complete interrupt.
+#define SPI_HAS_TRANSFER_ASYNC 1
+
+// SPI_HAS_TRANSFER_STREAM means SPI has writeStream() and transferStream(),
+// cycle-counted loops for SPI_CLOCK_DIV2 and SPI_CLOCK_DIV4.
+#define SPI_HAS_TRANSFER_STREAM 1
+
+// Spare CPU cycles per byte in writeStream() and transferStream(), on top of
+// the eight SCK periods it takes to shift a byte. Raise it if a peripheral
+// needs a gap between bytes.
+#ifndef SPI_STREAM_SLACK
+#define SPI_STREAM_SLACK 2
+#endif
+
+// Build with -DSPI_STATISTICS (for the sketch and the library alike) to have
+// SPI count transactions, bytes and busy time, and track the longest window
+// each usingInterrupt() interrupt was masked for. See SPIClass::statistics().
+// It costs two micros() calls per transaction.
+//#define SPI_STATISTICS
+
 // Uncomment this line to add detection of mismatched begin/end transactions.
 // A mismatch occurs if other libraries fail to use SPI.endTransaction() for
 // each SPI.beginTransaction().  Connect an LED to this pin.  The LED will turn
@@ -150,8 +171,34 @@ private:
   uint8_t spcr;
   uint8_t spsr;
   friend class SPIClass;
+  friend class USARTSPIClass;
+  friend class SPISlaveClass;
+};
+
+
+#ifdef SPI_STATISTICS
+// Interrupt numbers 0-7 passed to usingInterrupt() have their own slot, the
+// last one covers everything else (timers, 255).
+#define SPI_STATS_INTERRUPTS 9
+
+struct SPIStatistics {
+  uint32_t transactions;
+  uint32_t bytes;
+  // Microseconds between beginTransaction() and endTransaction()
+  uint32_t busyMicros;
+  // Longest time each registered interrupt was masked by a transaction, in
+  // microseconds. Inaccurate beyond 1 ms when all interrupts are masked,
+  // as micros() then misses timer overflows.
+  uint16_t maxMaskedMicros[SPI_STATS_INTERRUPTS];
 };
+#define SPI_COUNT_BYTES(n) (SPIClass::stats.bytes += (n))
+#else
+#define SPI_COUNT_BYTES(n)
+#endif
 
+// Called when a transferAsync() completes. Runs in interrupt context, unless
+// the transfer had to be completed by polling (see transferAsync()).
+typedef void (*SPIAsyncCallback)(void);
 
 class SPIClass {
 public:
@@ -176,6 +223,13 @@ public:
   // this function is used to gain exclusive access to the SPI bus
   // and configure the correct settings.
   inline static void beginTransaction(SPISettings settings) {
+    // Never reconfigure the bus under a running transferAsync()
+    if (asyncBusy) asyncFlush();
+
+    #ifdef SPI_STATISTICS
+    statsStart = micros();
+    #endif
+
     if (interruptMode > 0) {
       uint8_t sreg = SREG;
       noInterrupts();
@@ -200,12 +254,15 @@ public:
     inTransactionFlag = 1;
     #endif
 
+    // Always written, even if unchanged: a low SS input in master mode
+    // clears MSTR, and this puts it back.
     SPCR = settings.spcr;
     SPSR = settings.spsr;
   }
 
   // Write to the SPI bus (MOSI pin) and also receive (MISO pin)
   inline static uint8_t transfer(uint8_t data) {
+    SPI_COUNT_BYTES(1);
     SPDR = data;
     /*
      * The following NOP introduces a small delay that can prevent the wait
@@ -220,6 +277,7 @@ public:
   inline static uint16_t transfer16(uint16_t data) {
     union { uint16_t val; struct { uint8_t lsb; uint8_t msb; }; } in, out;
     in.val = data;
+    SPI_COUNT_BYTES(2);
     if (!(SPCR & _BV(DORD))) {
       SPDR = in.msb;
       asm volatile("nop"); // See transfer(uint8_t) function
@@ -241,8 +299,41 @@ public:
     }
     return out.val;
   }
+  // 24 bits from the low three bytes of data, order as set by SPISettings
+  inline static uint32_t transfer24(uint32_t data) {
+    union { uint32_t val; uint8_t b[4]; } in, out;
+    in.val = data;
+    out.val = 0;
+    if (!(SPCR & _BV(DORD))) {
+      out.b[2] = transfer(in.b[2]);
+      out.b[1] = transfer(in.b[1]);
+      out.b[0] = transfer(in.b[0]);
+    } else {
+      out.b[0] = transfer(in.b[0]);
+      out.b[1] = transfer(in.b[1]);
+      out.b[2] = transfer(in.b[2]);
+    }
+    return out.val;
+  }
+  inline static uint32_t transfer32(uint32_t data) {
+    union { uint32_t val; uint8_t b[4]; } in, out;
+    in.val = data;
+    if (!(SPCR & _BV(DORD))) {
+      out.b[3] = transfer(in.b[3]);
+      out.b[2] = transfer(in.b[2]);
+      out.b[1] = transfer(in.b[1]);
+      out.b[0] = transfer(in.b[0]);
+    } else {
+      out.b[0] = transfer(in.b[0]);
+      out.b[1] = transfer(in.b[1]);
+      out.b[2] = transfer(in.b[2]);
+      out.b[3] = transfer(in.b[3]);
+    }
+    return out.val;
+  }
   inline static void transfer(void *buf, size_t count) {
     if (count == 0) return;
+    SPI_COUNT_BYTES(count);
     uint8_t *p = (uint8_t *)buf;
     SPDR = *p;
     while (--count > 0) {
@@ -255,9 +346,174 @@ public:
     while (!(SPSR & _BV(SPIF))) ;
     *p = SPDR;
   }
+  // Send count bytes from txbuf and store what comes back in rxbuf, which
+  // may be the same buffer
+  inline static void transfer(const void *txbuf, void *rxbuf, size_t count) {
+    if (count == 0) return;
+    SPI_COUNT_BYTES(count);
+    const uint8_t *tx = (const uint8_t *)txbuf;
+    uint8_t *rx = (uint8_t *)rxbuf;
+    SPDR = *tx++;
+    while (--count > 0) {
+      uint8_t out = *tx++;
+      while (!(SPSR & _BV(SPIF))) ;
+      uint8_t in = SPDR;
+      SPDR = out;
+      *rx++ = in;
+    }
+    while (!(SPSR & _BV(SPIF))) ;
+    *rx = SPDR;
+  }
+  // Send count bytes and ignore what comes back
+  inline static void write(const void *buf, size_t count) {
+    if (count == 0) return;
+    SPI_COUNT_BYTES(count);
+    const uint8_t *p = (const uint8_t *)buf;
+    SPDR = *p++;
+    while (--count > 0) {
+      uint8_t out = *p++;
+      while (!(SPSR & _BV(SPIF))) ;
+      SPDR = out;
+    }
+    while (!(SPSR & _BV(SPIF))) ;
+    (void)SPDR; // clear SPIF
+  }
+  // Receive count bytes while sending fill
+  inline static void read(void *buf, size_t count, uint8_t fill = 0xFF) {
+    if (count == 0) return;
+    SPI_COUNT_BYTES(count);
+    uint8_t *p = (uint8_t *)buf;
+    SPDR = fill;
+    while (--count > 0) {
+      while (!(SPSR & _BV(SPIF))) ;
+      uint8_t in = SPDR;
+      SPDR = fill;
+      *p++ = in;
+    }
+    while (!(SPSR & _BV(SPIF))) ;
+    *p = SPDR;
+  }
+  // Streaming versions of write() and transfer(). clockDiv must be the
+  // SPI_CLOCK_DIVn constant matching the clock of the current transaction.
+  // At SPI_CLOCK_DIV2 and SPI_CLOCK_DIV4 the polled loops above lose a few
+  // cycles per byte waiting for SPIF, so instead the next byte is loaded in
+  // advance and written to SPDR a fixed number of cycles after the previous
+  // one, as soon as the shift register is free. Interrupts may still run;
+  // they only widen the gap. Slower clocks fall back to the polled loops.
+  template<uint8_t clockDiv>
+  inline static void writeStream(const void *buf, size_t count) {
+    if (streamDivider(clockDiv) > 4) {
+      write(buf, count);
+      return;
+    }
+    if (count == 0) return;
+    SPI_COUNT_BYTES(count);
+    const uint8_t *p = (const uint8_t *)buf;
+    size_t n = count - 1;
+    asm volatile(
+      "ld __tmp_reg__, %a[p]+\n\t"
+      "out %[spdr], __tmp_reg__\n\t"
+      "cp %A[n], __zero_reg__\n\t"     // 1
+      "cpc %B[n], __zero_reg__\n\t"    // 1
+      "breq 2f\n\t"                    // 1
+      // Pad the way in to the loop period: the cp/cpc/breq above stand
+      // in for the sbiw/brne at the end of the loop, one cycle short
+      "nop\n\t"                        // 1
+      "1:\n\t"
+      "ld __tmp_reg__, %a[p]+\n\t"     // 2
+      ".rept %[delay]\n\t"
+      "nop\n\t"
+      ".endr\n\t"
+      "out %[spdr], __tmp_reg__\n\t"   // 1
+      "sbiw %[n], 1\n\t"               // 2
+      "brne 1b\n\t"                    // 2
+      "2:\n\t"
+      ".rept %[tail]\n\t"
+      "nop\n\t"
+      ".endr\n\t"
+      : [p] "+e" (p), [n] "+w" (n)
+      : [spdr] "I" (_SFR_IO_ADDR(SPDR)),
+        [delay] "n" (streamCycles(clockDiv) - 7),
+        [tail] "n" (streamCycles(clockDiv) - 3)
+      : "memory");
+    // SPIF is set by now, reading SPSR then SPDR clears it
+    while (!(SPSR & _BV(SPIF))) ;
+    (void)SPDR;
+  }
+  template<uint8_t clockDiv>
+  inline static void transferStream(const void *txbuf, void *rxbuf, size_t count) {
+    if (streamDivider(clockDiv) > 4) {
+      transfer(txbuf, rxbuf, count);
+      return;
+    }
+    if (count == 0) return;
+    SPI_COUNT_BYTES(count);
+    const uint8_t *tx = (const uint8_t *)txbuf;
+    uint8_t *rx = (uint8_t *)rxbuf;
+    size_t n = count - 1;
+    uint8_t in;
+    // Each received byte is read back one cycle before the next write, by
+    // which time it has been completely shifted in
+    asm volatile(
+      "ld __tmp_reg__, %a[tx]+\n\t"
+      "out %[spdr], __tmp_reg__\n\t"
+      "cp %A[n], __zero_reg__\n\t"     // 1
+      "cpc %B[n], __zero_reg__\n\t"    // 1
+      "breq 2f\n\t"                    // 1
+      // Pad the way in to the loop period: the cp/cpc/breq above stand
+      // in for the st/sbiw/brne at the end of the loop, three cycles short
+      "nop\n\t"                        // 1
+      "nop\n\t"                        // 1
+      "nop\n\t"                        // 1
+      "1:\n\t"
+      "ld __tmp_reg__, %a[tx]+\n\t"    // 2
+      ".rept %[delay]\n\t"
+      "nop\n\t"
+      ".endr\n\t"
+      "in %[in], %[spdr]\n\t"          // 1
+      "out %[spdr], __tmp_reg__\n\t"   // 1
+      "st %a[rx]+, %[in]\n\t"          // 2
+      "sbiw %[n], 1\n\t"               // 2
+      "brne 1b\n\t"                    // 2
+      "2:\n\t"
+      ".rept %[tail]\n\t"
+      "nop\n\t"
+      ".endr\n\t"
+      : [in] "=&r" (in), [tx] "+e" (tx), [rx] "+e" (rx), [n] "+w" (n)
+      : [spdr] "I" (_SFR_IO_ADDR(SPDR)),
+        [delay] "n" (streamCycles(clockDiv) - 10),
+        [tail] "n" (streamCycles(clockDiv) - 3)
+      : "memory");
+    while (!(SPSR & _BV(SPIF))) ;
+    *rx = SPDR;
+  }
+  // Start clocking count bytes out of tx and into rx in the background, one
+  // byte per SPI transfer complete interrupt. tx may be NULL to send 0xFF,
+  // rx may be NULL to discard what comes back. The buffers must stay valid
+  // until the transfer is done. callback, if not NULL, is called once the
+  // last byte is in. Returns false if another transfer is still running.
+  //
+  // Call this inside beginTransaction()/endTransaction() like transfer().
+  // endTransaction() and the next beginTransaction() wait for the transfer
+  // to finish. If interrupts are disabled when this is called, e.g. because
+  // the transaction masks them globally, the interrupt can't run and the
+  // transfer is completed by polling before this returns.
+  static bool transferAsync(const void *tx, void *rx, size_t count,
+                            SPIAsyncCallback callback = NULL);
+  // True once the last transferAsync() has completed
+  inline static bool asyncDone(void) { return !asyncBusy; }
+  // Wait for the running transferAsync(), if any, to complete
+  static void asyncFlush(void);
+  // The SPI transfer complete interrupt handler. Only called from the ISR,
+  // or by asyncFlush() when interrupts are disabled. Hands over to
+  // SPISlave while slave mode is active.
+  static void handleInterrupt(void);
+
   // After performing a group of transfers and releasing the chip select
   // signal, this function allows others to access the SPI bus
   inline static void endTransaction(void) {
+    if (asyncBusy) asyncFlush();
+
     #ifdef SPI_TRANSACTION_MISMATCH_LED
     if (!inTransactionFlag) {
       pinMode(SPI_TRANSACTION_MISMATCH_LED, OUTPUT);
@@ -281,8 +537,20 @@ public:
         SREG = interruptSave;
       }
     }
+
+    #ifdef SPI_STATISTICS
+    statsEnd();
+    #endif
   }
 
+  #ifdef SPI_STATISTICS
+  // Counters since startup or the last resetStatistics()
+  inline static const SPIStatistics &statistics(void) { return stats; }
+  // Longest masked window for an interrupt number given to usingInterrupt()
+  static uint16_t maxMaskedMicros(uint8_t interruptNumber);
+  static void resetStatistics(void);
+  #endif
+
   // Disable the SPI bus
   static void end();
 
@@ -305,15 +573,44 @@ public:
   }
   // These undocumented functions should not be used.  SPI.transfer()
   // polls the hardware flag which is automatically cleared as the
-  // AVR responds to SPI's interrupt
+  // AVR responds to SPI's interrupt.  transferAsync() manages SPIE itself.
   inline static void attachInterrupt() { SPCR |= _BV(SPIE); }
   inline static void detachInterrupt() { SPCR &= ~_BV(SPIE); }
 
 private:
+  // CPU cycles per SCK period for an SPI_CLOCK_DIVn constant
+  static constexpr uint8_t streamDivider(uint8_t clockDiv) {
+    return ((clockDiv & SPI_CLOCK_MASK) == SPI_CLOCK_MASK ? 128 :
+            4 << (2 * (clockDiv & SPI_CLOCK_MASK))) >> ((clockDiv >> 2) & 1);
+  }
+  // CPU cycles between SPDR writes in the streaming loops: eight SCK periods
+  // plus SPI_STREAM_SLACK, so a write never lands while the previous byte
+  // is still shifting (which would set WCOL and drop it)
+  static constexpr uint16_t streamCycles(uint8_t clockDiv) {
+    return 8 * streamDivider(clockDiv) + SPI_STREAM_SLACK;
+  }
+
+  friend class SPISlaveClass;
+  static void (*slaveHandler)(void);
+
   static uint8_t initialized;
+  #ifdef SPI_STATISTICS
+  static SPIStatistics stats;
+  static unsigned long statsStart;
+  static uint16_t statsRegistered; // bit per SPIStatistics slot
+  static void statsEnd(void);
+  static uint8_t statsSlot(uint8_t interruptNumber) {
+    return interruptNumber < SPI_STATS_INTERRUPTS - 1 ? interruptNumber : SPI_STATS_INTERRUPTS - 1;
+  }
+  #endif
   static uint8_t interruptMode; // 0=none, 1=mask, 2=global
   static uint8_t interruptMask; // which interrupts to mask
   static uint8_t interruptSave; // temp storage, to restore state
+  static const uint8_t *asyncTx; // next byte to send, NULL for 0xFF
+  static uint8_t *asyncRx;       // where the next byte goes, NULL to drop
+  static size_t asyncCount;      // bytes still to be received
+  static SPIAsyncCallback asyncCallback;
+  static volatile uint8_t asyncBusy;
   #ifdef SPI_TRANSACTION_MISMATCH_LED
   static uint8_t inTransactionFlag;
   #endif
@@ -0,0 +1,42 @@
+/*
+ * Handle for one device on the SPI bus.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of either the GNU General Public License version 2
+ * or the GNU Lesser General Public License version 2.1, both as
+ * published by the Free Software Foundation.
+ */
+
+#include "SPIDevice.h"
+
+SPIDevice::SPIDevice(uint8_t csPin, SPISettings settings)
+  : settings(settings), cs(csPin)
+{
+#ifdef __AVR
+  csPort = portOutputRegister(digitalPinToPort(cs));
+  csMask = digitalPinToBitMask(cs);
+#endif
+}
+
+void SPIDevice::begin(void)
+{
+  digitalWrite(cs, HIGH);
+  pinMode(cs, OUTPUT);
+  SPI.begin();
+}
+
+void SPIDevice::readRegisters(uint8_t command, void *buf, size_t count, uint8_t fill)
+{
+  select();
+  SPI.transfer(command);
+  SPI.read(buf, count, fill);
+  deselect();
+}
+
+void SPIDevice::writeRegisters(uint8_t command, const void *buf, size_t count)
+{
+  select();
+  SPI.transfer(command);
+  SPI.write(buf, count);
+  deselect();
+}
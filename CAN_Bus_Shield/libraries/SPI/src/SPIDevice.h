@@ -0,0 +1,82 @@
+/*
+ * Handle for one device on the SPI bus: its SPISettings plus a chip select
+ * pin resolved to a port register and bit mask up front, so each chip
+ * select edge is a masked port write instead of a digitalWrite(), which
+ * looks the pin up again every time. bench/spi_bench measures the two as
+ * spi_device_select and spi_digitalWrite_select.
+ *
+ *   SPIDevice pot(10, SPISettings(4000000, MSBFIRST, SPI_MODE0));
+ *   pot.begin();
+ *   pot.writeRegisters(0x00, values, sizeof(values));
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of either the GNU General Public License version 2
+ * or the GNU Lesser General Public License version 2.1, both as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef _SPI_DEVICE_H_INCLUDED
+#define _SPI_DEVICE_H_INCLUDED
+
+#include "SPI.h"
+
+class SPIDevice {
+public:
+  SPIDevice(uint8_t csPin, SPISettings settings);
+
+  // Make chip select an output, deselect the device and start SPI.
+  void begin(void);
+
+  // Start a transaction and pull chip select low.
+  inline void select(void) {
+    SPI.beginTransaction(settings);
+    csLow();
+  }
+  // Release chip select and end the transaction.
+  inline void deselect(void) {
+    csHigh();
+    SPI.endTransaction();
+  }
+
+  // Send command, typically a register address with the device's read or
+  // write bits applied, then read or write count bytes, in one selection.
+  void readRegisters(uint8_t command, void *buf, size_t count, uint8_t fill = 0x00);
+  void writeRegisters(uint8_t command, const void *buf, size_t count);
+  inline uint8_t readRegister(uint8_t command) {
+    uint8_t value;
+    readRegisters(command, &value, 1);
+    return value;
+  }
+  inline void writeRegister(uint8_t command, uint8_t value) {
+    writeRegisters(command, &value, 1);
+  }
+
+  inline uint8_t pin(void) const { return cs; }
+
+private:
+#ifdef __AVR
+  // The port may be shared with pins driven from interrupt handlers, so the
+  // read-modify-write must not be interrupted
+  inline void csLow(void) {
+    uint8_t sreg = SREG;
+    cli();
+    *csPort &= ~csMask;
+    SREG = sreg;
+  }
+  inline void csHigh(void) {
+    uint8_t sreg = SREG;
+    cli();
+    *csPort |= csMask;
+    SREG = sreg;
+  }
+  volatile uint8_t *csPort;
+  uint8_t csMask;
+#else
+  inline void csLow(void) { digitalWrite(cs, LOW); }
+  inline void csHigh(void) { digitalWrite(cs, HIGH); }
+#endif
+  SPISettings settings;
+  uint8_t cs;
+};
+
+#endif
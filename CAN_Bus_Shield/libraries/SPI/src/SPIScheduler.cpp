@@ -0,0 +1,133 @@
+/*
+ * Queue-based scheduler for several devices sharing one SPI bus.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of either the GNU General Public License version 2
+ * or the GNU Lesser General Public License version 2.1, both as
+ * published by the Free Software Foundation.
+ */
+
+#include "SPIScheduler.h"
+
+SPISchedulerClass SPIScheduler;
+
+SPIRequest *volatile SPISchedulerClass::head = NULL;
+volatile uint8_t SPISchedulerClass::running = 0;
+SPIDeviceStats SPISchedulerClass::deviceStats[SPI_SCHED_DEVICES];
+
+// True if a should run before b: higher priority first, then the earlier
+// deadline, requests with a deadline before those without.
+bool SPISchedulerClass::before(const SPIRequest *a, const SPIRequest *b)
+{
+  if (a->priority != b->priority)
+    return a->priority > b->priority;
+  if (!b->deadline)
+    return a->deadline != 0;
+  if (!a->deadline)
+    return false;
+  return (long)((a->submitted + a->deadline) - (b->submitted + b->deadline)) < 0;
+}
+
+bool SPISchedulerClass::submit(SPIRequest *req)
+{
+  uint8_t sreg = SREG;
+  noInterrupts();
+  if (req->state == SPI_REQ_QUEUED || req->state == SPI_REQ_RUNNING) {
+    SREG = sreg;
+    return false;
+  }
+  req->state = SPI_REQ_QUEUED;
+  req->submitted = micros();
+
+  // Insert after every request that should run before this one, so equal
+  // requests keep their submission order
+  SPIRequest *volatile *link = &head;
+  while (*link && !before(req, *link))
+    link = &(*link)->next;
+  req->next = *link;
+  *link = req;
+  SREG = sreg;
+  return true;
+}
+
+bool SPISchedulerClass::cancel(SPIRequest *req)
+{
+  uint8_t sreg = SREG;
+  noInterrupts();
+  for (SPIRequest *volatile *link = &head; *link; link = &(*link)->next) {
+    if (*link == req) {
+      *link = req->next;
+      req->state = SPI_REQ_IDLE;
+      SREG = sreg;
+      return true;
+    }
+  }
+  SREG = sreg;
+  return false;
+}
+
+bool SPISchedulerClass::runNext(void)
+{
+  uint8_t sreg = SREG;
+  noInterrupts();
+  SPIRequest *req = head;
+  if (running || !req) {
+    SREG = sreg;
+    return false;
+  }
+  head = req->next;
+  req->state = SPI_REQ_RUNNING;
+  running = 1;
+  SREG = sreg;
+
+  execute(req);
+
+  unsigned long latency = micros() - req->submitted;
+  if (req->device < SPI_SCHED_DEVICES) {
+    SPIDeviceStats *s = &deviceStats[req->device];
+    s->transactions++;
+    s->totalLatency += latency;
+    if (latency > s->maxLatency)
+      s->maxLatency = latency;
+    if (req->deadline && latency > req->deadline)
+      s->missed++;
+  }
+
+  req->state = SPI_REQ_DONE;
+  running = 0;
+  if (req->callback)
+    req->callback(req);
+  return true;
+}
+
+void SPISchedulerClass::runAll(void)
+{
+  while (runNext())
+    ;
+}
+
+void SPISchedulerClass::execute(SPIRequest *req)
+{
+  SPI.beginTransaction(req->settings);
+  digitalWrite(req->csPin, LOW);
+  if (req->tx && req->rx) {
+    SPI.transfer(req->tx, req->rx, req->count);
+  } else if (req->tx) {
+    SPI.write(req->tx, req->count);
+  } else if (req->rx) {
+    SPI.read(req->rx, req->count);
+  } else {
+    for (size_t i = 0; i < req->count; i++)
+      SPI.transfer(0xFF);
+  }
+  digitalWrite(req->csPin, HIGH);
+  SPI.endTransaction();
+}
+
+void SPISchedulerClass::resetStats(void)
+{
+  uint8_t sreg = SREG;
+  noInterrupts();
+  memset(deviceStats, 0, sizeof(deviceStats));
+  SREG = sreg;
+}
@@ -0,0 +1,109 @@
+/*
+ * Queue-based scheduler for several devices sharing one SPI bus.
+ *
+ * Instead of calling SPI.beginTransaction() themselves, drivers fill in an
+ * SPIRequest (settings, chip select pin, buffers, priority, deadline) and
+ * submit it. The scheduler runs one request at a time, always picking the
+ * highest priority one and, among equal priorities, the earliest deadline.
+ *
+ * Requests are never split, since most devices need chip select held for
+ * the whole exchange, so preemption happens between requests: a CAN RX
+ * request submitted from the MCP2515 INT handler is run before any sensor
+ * read still waiting in the queue. runNext() may itself be called from that
+ * handler; if the bus is idle the request runs right away, otherwise it
+ * runs as soon as the current request finishes.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of either the GNU General Public License version 2
+ * or the GNU Lesser General Public License version 2.1, both as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef _SPI_SCHEDULER_H_INCLUDED
+#define _SPI_SCHEDULER_H_INCLUDED
+
+#include "SPI.h"
+
+// Number of per-device statistics slots, see SPIRequest::device.
+#ifndef SPI_SCHED_DEVICES
+#define SPI_SCHED_DEVICES 4
+#endif
+
+// Suggested priorities. Any value 0-255 works, higher runs first.
+#define SPI_PRIORITY_LOW 0
+#define SPI_PRIORITY_NORMAL 64
+#define SPI_PRIORITY_HIGH 128
+#define SPI_PRIORITY_CAN_RX 192
+
+struct SPIRequest;
+
+// Called after a request completed, from wherever runNext() ran it. The
+// request may be submitted again from here.
+typedef void (*SPIRequestCallback)(SPIRequest *req);
+
+enum SPIRequestState {
+  SPI_REQ_IDLE,
+  SPI_REQ_QUEUED,
+  SPI_REQ_RUNNING,
+  SPI_REQ_DONE
+};
+
+// A single chip-select-low-to-high exchange. Owned by the caller and must
+// stay valid, along with its buffers, until it is done.
+struct SPIRequest {
+  SPISettings settings;
+  uint8_t csPin;        // Active low, already an OUTPUT held HIGH
+  const void *tx;       // NULL to send 0xFF
+  void *rx;             // NULL to discard what comes back
+  size_t count;
+  uint8_t priority;     // Higher runs first
+  uint8_t device;       // Statistics slot, below SPI_SCHED_DEVICES
+  unsigned long deadline; // Microseconds after submit(), 0 for none
+  SPIRequestCallback callback; // May be NULL
+
+  // Managed by the scheduler
+  volatile uint8_t state;
+  unsigned long submitted;
+  SPIRequest *next;
+};
+
+struct SPIDeviceStats {
+  uint16_t transactions;
+  uint16_t missed;            // Completed after their deadline
+  unsigned long maxLatency;   // Microseconds from submit() to completion
+  unsigned long totalLatency;
+};
+
+class SPISchedulerClass {
+public:
+  // Queue req. Safe to call from an interrupt handler. Returns false if req
+  // is already queued or running.
+  static bool submit(SPIRequest *req);
+  // Remove req from the queue if it has not started yet.
+  static bool cancel(SPIRequest *req);
+  // Run the most urgent queued request to completion. Returns false if the
+  // queue is empty or another call is still running a request.
+  static bool runNext(void);
+  // Run requests until the queue is empty.
+  static void runAll(void);
+  inline static bool idle(void) { return head == NULL && !running; }
+
+  // Latency statistics per SPIRequest::device. If runNext() is called from
+  // an interrupt handler, read them with interrupts disabled.
+  inline static const SPIDeviceStats &stats(uint8_t device) {
+    return deviceStats[device];
+  }
+  static void resetStats(void);
+
+private:
+  static bool before(const SPIRequest *a, const SPIRequest *b);
+  static void execute(SPIRequest *req);
+
+  static SPIRequest *volatile head;
+  static volatile uint8_t running;
+  static SPIDeviceStats deviceStats[SPI_SCHED_DEVICES];
+};
+
+extern SPISchedulerClass SPIScheduler;
+
+#endif
@@ -0,0 +1,227 @@
+/*
+ * SPI slave mode with interrupt driven transmit and receive rings.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of either the GNU General Public License version 2
+ * or the GNU Lesser General Public License version 2.1, both as
+ * published by the Free Software Foundation.
+ */
+
+#include "SPISlave.h"
+
+#define TX_MASK (SPI_SLAVE_TX_SIZE - 1)
+#define RX_MASK (SPI_SLAVE_RX_SIZE - 1)
+
+static_assert(SPI_SLAVE_TX_SIZE <= 128 && !(SPI_SLAVE_TX_SIZE & TX_MASK),
+              "SPI_SLAVE_TX_SIZE must be a power of two up to 128");
+static_assert(SPI_SLAVE_RX_SIZE <= 128 && !(SPI_SLAVE_RX_SIZE & RX_MASK),
+              "SPI_SLAVE_RX_SIZE must be a power of two up to 128");
+
+SPISlaveClass SPISlave;
+
+uint8_t SPISlaveClass::txRing[SPI_SLAVE_TX_SIZE];
+volatile uint8_t SPISlaveClass::txHead = 0;
+volatile uint8_t SPISlaveClass::txTail = 0;
+uint8_t SPISlaveClass::txRemaining = 0;
+uint8_t SPISlaveClass::txClocked = 0;
+volatile uint8_t SPISlaveClass::txLoaded = 0;
+uint8_t SPISlaveClass::rxRing[SPI_SLAVE_RX_SIZE];
+volatile uint8_t SPISlaveClass::rxHead = 0;
+volatile uint8_t SPISlaveClass::rxTail = 0;
+uint8_t SPISlaveClass::rxWrite = 0;
+uint8_t SPISlaveClass::rxLength = 0;
+uint8_t SPISlaveClass::rxDropping = 0;
+uint8_t SPISlaveClass::rxEnabled = 0;
+volatile uint8_t *SPISlaveClass::ssPin = NULL;
+uint8_t SPISlaveClass::ssMask = 0;
+uint8_t SPISlaveClass::ssLow = 0;
+volatile uint16_t SPISlaveClass::overruns = 0;
+volatile uint16_t SPISlaveClass::truncated = 0;
+
+// Set while slave mode is active. The pin change ISR below is linked into
+// every sketch using SPI, going through a pointer keeps the rings out of
+// those that never call SPISlave.begin().
+static void (*volatile selectHandler)(void) = NULL;
+
+void SPISlaveClass::begin(SPISettings settings, bool receive)
+{
+  uint8_t sreg = SREG;
+  noInterrupts();
+  txHead = txTail = 0;
+  txRemaining = txClocked = txLoaded = 0;
+  rxHead = rxTail = 0;
+  rxLength = rxDropping = 0;
+  rxEnabled = receive;
+
+  pinMode(MISO, OUTPUT);
+  pinMode(SS, INPUT);
+  pinMode(SCK, INPUT);
+  pinMode(MOSI, INPUT);
+  ssPin = portInputRegister(digitalPinToPort(SS));
+  ssMask = digitalPinToBitMask(SS);
+  ssLow = !(*ssPin & ssMask);
+
+  SPIClass::slaveHandler = handleTransfer;
+  selectHandler = handleSelect;
+  SPCR = (settings.spcr & ~_BV(MSTR)) | _BV(SPIE);
+  if (ssLow) {
+    // Started in the middle of a frame: drop what is left of it, and
+    // leave SPDR alone until SS rises
+    rxWrite = rxHead + 1;
+    rxDropping = rxEnabled;
+  } else {
+    preload();
+  }
+
+  *digitalPinToPCMSK(SS) |= _BV(digitalPinToPCMSKbit(SS));
+  PCIFR = _BV(digitalPinToPCICRbit(SS));
+  *digitalPinToPCICR(SS) |= _BV(digitalPinToPCICRbit(SS));
+  SREG = sreg;
+}
+
+void SPISlaveClass::end(void)
+{
+  uint8_t sreg = SREG;
+  noInterrupts();
+  *digitalPinToPCMSK(SS) &= ~_BV(digitalPinToPCMSKbit(SS));
+  SPCR = 0;
+  SPIClass::slaveHandler = NULL;
+  selectHandler = NULL;
+  pinMode(MISO, INPUT);
+  txHead = txTail;
+  txLoaded = 0;
+  SREG = sreg;
+}
+
+uint8_t SPISlaveClass::writeSpace(void)
+{
+  return SPI_SLAVE_TX_SIZE - (uint8_t)(txHead - txTail);
+}
+
+bool SPISlaveClass::write(const void *block, uint8_t length)
+{
+  if (!length || length >= writeSpace())
+    return false;
+
+  // Only this function writes past txHead, so the block can be copied in
+  // with interrupts on and published with a single store
+  const uint8_t *p = (const uint8_t *)block;
+  uint8_t head = txHead;
+  txRing[head++ & TX_MASK] = length;
+  for (uint8_t i = 0; i < length; i++)
+    txRing[head++ & TX_MASK] = p[i];
+
+  uint8_t sreg = SREG;
+  noInterrupts();
+  txHead = head;
+  // Between frames with nothing loaded, load this block right away
+  if (!txLoaded && !ssLow)
+    preload();
+  SREG = sreg;
+  return true;
+}
+
+uint8_t SPISlaveClass::read(void *buf, uint8_t size)
+{
+  uint8_t tail = rxTail;
+  if (tail == rxHead)
+    return 0;
+
+  uint8_t length = rxRing[tail & RX_MASK];
+  uint8_t copy = length < size ? length : size;
+  uint8_t *p = (uint8_t *)buf;
+  for (uint8_t i = 0; i < copy; i++)
+    p[i] = rxRing[(uint8_t)(tail + 1 + i) & RX_MASK];
+  rxTail = tail + 1 + length;
+  return copy;
+}
+
+// Load the next block's length byte into SPDR, or 0 if nothing is queued.
+// Called with interrupts off while SS is high.
+void SPISlaveClass::preload(void)
+{
+  if (txHead != txTail) {
+    uint8_t length = txRing[txTail & TX_MASK];
+    txTail++;
+    txRemaining = length;
+    txLoaded = 1;
+    SPDR = length;
+  } else {
+    txRemaining = 0;
+    txLoaded = 0;
+    SPDR = 0;
+  }
+}
+
+void SPISlaveClass::handleTransfer(void)
+{
+  // The master may start the next byte at any time, reload SPDR first
+  uint8_t in = SPDR;
+  if (txRemaining) {
+    SPDR = txRing[txTail & TX_MASK];
+    txTail++;
+    txRemaining--;
+  } else {
+    SPDR = 0xFF;
+  }
+  txClocked = 1;
+
+  if (rxEnabled && !rxDropping) {
+    if ((uint8_t)(rxWrite - rxTail) < SPI_SLAVE_RX_SIZE && rxLength < 255) {
+      rxRing[rxWrite & RX_MASK] = in;
+      rxWrite++;
+      rxLength++;
+    } else {
+      rxDropping = 1;
+    }
+  }
+}
+
+void SPISlaveClass::handleSelect(void)
+{
+  uint8_t low = !(*ssPin & ssMask);
+  if (low == ssLow)
+    return; // Another pin on the same port changed
+  ssLow = low;
+
+  if (low) {
+    txClocked = 0;
+    if (rxEnabled) {
+      // Reserve a byte for the frame length
+      rxLength = 0;
+      rxDropping = (uint8_t)(rxHead - rxTail) >= SPI_SLAVE_RX_SIZE;
+      rxWrite = rxHead + 1;
+    }
+    return;
+  }
+
+  if (rxEnabled && (rxLength || rxDropping)) {
+    if (rxDropping) {
+      overruns++;
+    } else {
+      rxRing[rxHead & RX_MASK] = rxLength;
+      rxHead = rxWrite;
+    }
+  }
+
+  // Keep a loaded block the master never clocked, otherwise drop what is
+  // left of it and load the next
+  if (txClocked || !txLoaded) {
+    if (txRemaining) {
+      txTail += txRemaining;
+      truncated++;
+    }
+    preload();
+  }
+}
+
+// SS is on port B on the boards this library is built for: PB2 on the
+// ATmega168/328, PB0 on the ATmega1280/2560. Weak so a sketch or library
+// with its own handler for the port still links.
+#if defined(PCINT0_vect)
+ISR(PCINT0_vect, __attribute__((weak)))
+{
+  if (selectHandler)
+    selectHandler();
+}
+#endif
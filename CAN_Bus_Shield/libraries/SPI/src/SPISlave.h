@@ -0,0 +1,109 @@
+/*
+ * SPI slave mode, for streaming telemetry to a supervising processor that
+ * is the bus master. Everything runs from the SPI transfer complete and SS
+ * pin change interrupts; the sketch only queues and collects whole frames.
+ *
+ * A frame is everything clocked between SS falling and SS rising.
+ *
+ * Slave to master: the sketch queues blocks, each shorter than the ring,
+ * with write(). Each frame sends the oldest block as a length byte followed by
+ * the block, then 0xFF for as long as the master keeps clocking. A length
+ * of 0 means nothing was queued. If SS rises before the whole block was
+ * clocked out, the rest is dropped; if no byte was clocked at all the
+ * block is kept for the next frame. The next block is loaded into SPDR as
+ * soon as SS rises, so it is ready when SS falls again.
+ *
+ * Master to slave: unless begin() was told otherwise, the bytes the master
+ * sends in a frame are collected and returned as one frame by read().
+ * Frames that don't fit in the receive ring are dropped and counted, as
+ * is a frame already under way when begin() is called.
+ *
+ * Both directions go through rings (SPI_SLAVE_TX_SIZE, SPI_SLAVE_RX_SIZE),
+ * so the sketch can fill the next block while the current one is being
+ * clocked out, and read a frame while the next one comes in.
+ *
+ * The AVR gets no time between bytes to reload SPDR other than what the
+ * master gives it. Clock at F_CPU / 4 or slower and leave a few
+ * microseconds after SS falls and between bytes for the interrupt to run.
+ *
+ * SS edges use the pin change interrupt for port B (PCINT0_vect), defined
+ * weak here. A sketch that also uses SoftwareSerial, which defines that
+ * vector itself, loses framing.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of either the GNU General Public License version 2
+ * or the GNU Lesser General Public License version 2.1, both as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef _SPI_SLAVE_H_INCLUDED
+#define _SPI_SLAVE_H_INCLUDED
+
+#include "SPI.h"
+
+// Ring sizes in bytes, powers of two up to 128. Every queued block or
+// received frame takes one extra byte for its length.
+#ifndef SPI_SLAVE_TX_SIZE
+#define SPI_SLAVE_TX_SIZE 128
+#endif
+#ifndef SPI_SLAVE_RX_SIZE
+#define SPI_SLAVE_RX_SIZE 64
+#endif
+
+class SPISlaveClass {
+public:
+  // Switch the SPI peripheral to slave mode. The clock in settings is
+  // ignored, the mode and bit order must match the master. With receive
+  // false, whatever the master sends is ignored.
+  static void begin(SPISettings settings = SPISettings(), bool receive = true);
+  // Leave slave mode and drop anything still queued
+  static void end(void);
+
+  // Queue a block for the master. Returns false if it doesn't fit.
+  static bool write(const void *block, uint8_t length);
+  // Bytes available for write(), including the length byte
+  static uint8_t writeSpace(void);
+
+  // Copy the oldest complete frame from the master into buf, truncated to
+  // size, and return the number of bytes copied, or 0 if there is none.
+  static uint8_t read(void *buf, uint8_t size);
+  static bool available(void) { return rxHead != rxTail; }
+
+  // Frames the master sent that didn't fit in the receive ring, or that
+  // began before begin()
+  static uint16_t rxOverruns(void) { return overruns; }
+  // Blocks cut short because SS rose before they were clocked out
+  static uint16_t txTruncated(void) { return truncated; }
+
+  // Interrupt handlers
+  static void handleTransfer(void);
+  static void handleSelect(void);
+
+private:
+  static void preload(void);
+
+  static uint8_t txRing[SPI_SLAVE_TX_SIZE];
+  static volatile uint8_t txHead;  // Written by write()
+  static volatile uint8_t txTail;  // Advanced by the interrupt handlers
+  static uint8_t txRemaining;      // Bytes of the loaded block still to send
+  static uint8_t txClocked;        // Set once a byte of this frame was clocked
+  static volatile uint8_t txLoaded; // SPDR holds a block's length byte
+
+  static uint8_t rxRing[SPI_SLAVE_RX_SIZE];
+  static volatile uint8_t rxHead;  // End of the last complete frame
+  static volatile uint8_t rxTail;  // Advanced by read()
+  static uint8_t rxWrite;          // Where the next byte of this frame goes
+  static uint8_t rxLength;         // Bytes in this frame so far
+  static uint8_t rxDropping;       // This frame didn't fit
+  static uint8_t rxEnabled;
+
+  static volatile uint8_t *ssPin;
+  static uint8_t ssMask;
+  static uint8_t ssLow;
+  static volatile uint16_t overruns;
+  static volatile uint16_t truncated;
+};
+
+extern SPISlaveClass SPISlave;
+
+#endif
@@ -0,0 +1,83 @@
+/*
+ * A USART in Master SPI Mode (MSPIM) as a second SPI bus.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of either the GNU General Public License version 2
+ * or the GNU Lesser General Public License version 2.1, both as
+ * published by the Free Software Foundation.
+ */
+
+#include "USARTSPI.h"
+
+void USARTSPIClass::begin(void)
+{
+  // Initialization order from the datasheet: the baud rate must be zero
+  // while the transmitter is enabled
+  *ubrrh = 0;
+  *ubrrl = 0;
+  *xckDdr |= xckMask;
+  *ucsrc = USARTSPI_MSPIM;
+  *ucsrb = _BV(USARTSPI_RXEN) | _BV(USARTSPI_TXEN);
+  *ubrrl = 1;
+}
+
+void USARTSPIClass::end(void)
+{
+  *ucsrb = 0;
+  *ucsrc = 0;
+  *xckDdr &= ~xckMask;
+}
+
+void USARTSPIClass::beginTransaction(SPISettings settings)
+{
+  // Same divider as SPI: SPR1:0 select 4, 16, 64 or 128, SPI2X halves it.
+  // MSPIM runs at F_CPU / (2 * (UBRR + 1)).
+  static const uint8_t dividers[] = { 4, 16, 64, 128 };
+  uint8_t divider = dividers[settings.spcr & SPI_CLOCK_MASK] >> (settings.spsr & SPI_2XCLOCK_MASK);
+  uint8_t mode = USARTSPI_MSPIM;
+  if (settings.spcr & _BV(DORD))
+    mode |= USARTSPI_UDORD;
+  if (settings.spcr & _BV(CPOL))
+    mode |= USARTSPI_UCPOL;
+  if (settings.spcr & _BV(CPHA))
+    mode |= USARTSPI_UCPHA;
+
+  *ucsrc = mode;
+  *ubrrl = divider / 2 - 1;
+}
+
+uint16_t USARTSPIClass::transfer16(uint16_t data)
+{
+  uint8_t b[2] = { (uint8_t)(data >> 8), (uint8_t)data };
+  if (*ucsrc & USARTSPI_UDORD) {
+    b[0] = data;
+    b[1] = data >> 8;
+    bulk(b, b, 2, 0);
+    return b[0] | (b[1] << 8);
+  }
+  bulk(b, b, 2, 0);
+  return (b[0] << 8) | b[1];
+}
+
+void USARTSPIClass::bulk(const uint8_t *tx, uint8_t *rx, size_t count, uint8_t fill)
+{
+  // Keep up to two bytes written but not yet read back: one shifting and
+  // one waiting in the transmit buffer, so the clock never stops. Even if
+  // an interrupt delays the reads, both fit in the two level receive
+  // buffer and nothing is overrun.
+  size_t out = count;
+  size_t in = count;
+  while (in) {
+    uint8_t status = *ucsra;
+    if (out && in - out < 2 && (status & _BV(USARTSPI_UDRE))) {
+      *udr = tx ? *tx++ : fill;
+      out--;
+    }
+    if (status & _BV(USARTSPI_RXC)) {
+      uint8_t data = *udr;
+      if (rx)
+        *rx++ = data;
+      in--;
+    }
+  }
+}
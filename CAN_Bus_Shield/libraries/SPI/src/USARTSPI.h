@@ -0,0 +1,117 @@
+/*
+ * A USART in Master SPI Mode (MSPIM) as a second SPI bus, with the same
+ * SPISettings and transaction API as SPI. TxD is MOSI, RxD is MISO and
+ * XCK is SCK; chip select pins are driven by the sketch as usual.
+ *
+ *   USARTSPIClass bus(USARTSPI_USART0);
+ *
+ *   bus.begin();
+ *   bus.beginTransaction(SPISettings(4000000, MSBFIRST, SPI_MODE0));
+ *   digitalWrite(cs, LOW);
+ *   bus.transfer(buf, sizeof(buf));
+ *   digitalWrite(cs, HIGH);
+ *   bus.endTransaction();
+ *
+ * There are no global bus objects: a sketch declares the one it uses, so
+ * the others cost neither RAM nor a constructor at start-up.
+ *
+ * The USART transmitter is double buffered, so the bulk transfers keep a
+ * second byte queued while the first is shifting and the clock runs
+ * without gaps. Clock rates are the same powers of two SPISettings picks
+ * for SPI. beginTransaction() does not mask interrupts: do not use the
+ * same USARTSPI bus from an interrupt handler and from loop().
+ *
+ * On the ATmega168/328 USART0 is also Serial, so the two can't be used in
+ * the same sketch. XCK0 is digital pin 4 on the Nano. On the ATmega1280/
+ * 2560 USART1-3 are free, but their XCK pins are not broken out on the
+ * Mega board.
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of either the GNU General Public License version 2
+ * or the GNU Lesser General Public License version 2.1, both as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef _USART_SPI_H_INCLUDED
+#define _USART_SPI_H_INCLUDED
+
+#include "SPI.h"
+
+// Constructor arguments for each USART: its registers and its XCK pin.
+#if defined(__AVR_ATmega1280__) || defined(__AVR_ATmega2560__)
+  // XCK0 PE2, XCK1 PD5, XCK2 PH2, XCK3 PJ2
+  #define USARTSPI_USART0 &UCSR0A, &UCSR0B, &UCSR0C, &UBRR0L, &UBRR0H, &UDR0, &DDRE, _BV(2)
+  #define USARTSPI_USART1 &UCSR1A, &UCSR1B, &UCSR1C, &UBRR1L, &UBRR1H, &UDR1, &DDRD, _BV(5)
+  #define USARTSPI_USART2 &UCSR2A, &UCSR2B, &UCSR2C, &UBRR2L, &UBRR2H, &UDR2, &DDRH, _BV(2)
+  #define USARTSPI_USART3 &UCSR3A, &UCSR3B, &UCSR3C, &UBRR3L, &UBRR3H, &UDR3, &DDRJ, _BV(2)
+#elif defined(UBRR0H)
+  // XCK0 PD4
+  #define USARTSPI_USART0 &UCSR0A, &UCSR0B, &UCSR0C, &UBRR0L, &UBRR0H, &UDR0, &DDRD, _BV(4)
+#endif
+
+class USARTSPIClass {
+public:
+  constexpr USARTSPIClass(volatile uint8_t *ucsra, volatile uint8_t *ucsrb,
+                          volatile uint8_t *ucsrc, volatile uint8_t *ubrrl,
+                          volatile uint8_t *ubrrh, volatile uint8_t *udr,
+                          volatile uint8_t *xckDdr, uint8_t xckMask)
+    : ucsra(ucsra), ucsrb(ucsrb), ucsrc(ucsrc), ubrrl(ubrrl), ubrrh(ubrrh),
+      udr(udr), xckDdr(xckDdr), xckMask(xckMask) {}
+
+  // Put the USART in MSPIM mode, mode 0, MSB first at F_CPU / 4
+  void begin(void);
+  // Give the USART back
+  void end(void);
+
+  void beginTransaction(SPISettings settings);
+  inline void endTransaction(void) {}
+
+  inline uint8_t transfer(uint8_t data) {
+    *udr = data;
+    while (!(*ucsra & _BV(USARTSPI_RXC))) ;
+    return *udr;
+  }
+  uint16_t transfer16(uint16_t data);
+  inline void transfer(void *buf, size_t count) {
+    bulk((const uint8_t *)buf, (uint8_t *)buf, count, 0);
+  }
+  inline void transfer(const void *txbuf, void *rxbuf, size_t count) {
+    bulk((const uint8_t *)txbuf, (uint8_t *)rxbuf, count, 0);
+  }
+  inline void write(const void *buf, size_t count) {
+    bulk((const uint8_t *)buf, NULL, count, 0);
+  }
+  inline void read(void *buf, size_t count, uint8_t fill = 0xFF) {
+    bulk(NULL, (uint8_t *)buf, count, fill);
+  }
+
+private:
+  // Bits in UCSRnA and UCSRnB, the same for every USART
+  enum {
+    USARTSPI_RXC = 7,
+    USARTSPI_UDRE = 5,
+    USARTSPI_RXEN = 4,
+    USARTSPI_TXEN = 3
+  };
+  // UCSRnC in MSPIM mode: UMSELn1:0 = 11, UDORDn, UCPHAn, UCPOLn
+  enum {
+    USARTSPI_MSPIM = 0xC0,
+    USARTSPI_UDORD = 0x04,
+    USARTSPI_UCPHA = 0x02,
+    USARTSPI_UCPOL = 0x01
+  };
+
+  // tx NULL sends fill, rx NULL discards what comes back
+  void bulk(const uint8_t *tx, uint8_t *rx, size_t count, uint8_t fill);
+
+  volatile uint8_t * const ucsra;
+  volatile uint8_t * const ucsrb;
+  volatile uint8_t * const ucsrc;
+  volatile uint8_t * const ubrrl;
+  volatile uint8_t * const ubrrh;
+  volatile uint8_t * const udr;
+  volatile uint8_t * const xckDdr;
+  const uint8_t xckMask;
+};
+
+#endif
@@ -1,6 +1,9 @@
 // demo: CAN-BUS Shield, send data
-#include <mcp_can.h>
 #include <SPI.h>
+#include <mcp2515.h>
+#include <cantxscheduler.h>
+#include <candiagnostics.h>
+#include <tasks.h>
 
 // the cs pin of the version after v1.1 is default to D9
 // v0.9b and v1.0 is default D10
@@ -8,28 +11,92 @@ const int SPI_CS_PIN = 9;
 const int ledHIGH    = 1;
 const int ledLOW     = 0;
 
-MCP_CAN CAN(SPI_CS_PIN);                                    // Set CS pin
+MCP2515 CAN(SPI_CS_PIN);                                    // Set CS pin
+CANTxScheduler scheduler(CAN);
+CANDiagnostics diagnostics(CAN);
+TaskScheduler tasks;
 
-void setup()
+unsigned char stmp[8] = {ledHIGH, 1, 2, 3, ledLOW, 5, 6, 7};
+
+uint8_t blinkPayload(const can_tx_entry *entry, uint8_t *data)
 {
-    Serial.begin(115200);
+    memcpy(data, stmp, sizeof(stmp));
+    return sizeof(stmp);
+}
+
+uint8_t uptimePayload(const can_tx_entry *entry, uint8_t *data)
+{
+    unsigned long ms = millis();
+    data[0] = ms;
+    data[1] = ms >> 8;
+    data[2] = ms >> 16;
+    data[3] = ms >> 24;
+    return 4;
+}
+
+// id, period in ms, payload
+can_tx_entry schedule[] = {
+    { 0x70, 1000, blinkPayload },
+    { 0x71,  100, uptimePayload },
+    { 0x7F0, 1000 },                                        // diagnostics
+};
+const uint8_t SCHEDULE_SIZE = sizeof(schedule) / sizeof(schedule[0]);
 
-    while (CAN_OK != CAN.begin(CAN_500KBPS))              // init can bus : baudrate = 500k
-    {
-        Serial.println("CAN BUS Shield init fail");
-        Serial.println(" Init CAN BUS Shield again");
-        delay(100);
+// per message statistics
+void report(task_entry *task)
+{
+    for (uint8_t i = 0; i < SCHEDULE_SIZE; i++) {
+        Serial.print("0x");
+        Serial.print(schedule[i].id, HEX);
+        Serial.print(" sent ");
+        Serial.print(schedule[i].sent);
+        Serial.print(" missed ");
+        Serial.print(schedule[i].missed);
+        Serial.print(" max latency us ");
+        Serial.println(schedule[i].maxLatency);
     }
-    Serial.println("CAN BUS Shield init ok!");
+    const can_diagnostics &d = diagnostics.read();
+    Serial.print("TEC ");
+    Serial.print(d.tec);
+    Serial.print(" REC ");
+    Serial.print(d.rec);
+    Serial.print(" EFLG 0x");
+    Serial.print(d.eflg, HEX);
+    Serial.print(" bus load permille ");
+    Serial.println(d.busLoad);
 }
 
-unsigned char stmp[8] = {ledHIGH, 1, 2, 3, ledLOW, 5, 6, 7};
+task_entry reportTask = { report };
+
+// init can bus : baudrate = 500k, retrying every 100 ms without holding
+// up the rest of the loop
+void startCan(task_entry *task)
+{
+    if (CAN.beginStep(CAN_500KBPS)) {
+        tasks.cancel(*task);
+        Serial.println("CAN BUS Shield init ok!");
+        scheduler.begin(schedule, SCHEDULE_SIZE);
+        tasks.every(reportTask, 10000, 10000);              // every 10 s
+    }
+}
+
+task_entry canStart = { startCan };
+
+void setup()
+{
+    Serial.begin(115200);
+    diagnostics.attach(schedule[2]);
+    tasks.everyMicros(canStart, 100);
+}
 
 void loop()
-{   Serial.println("In loop");
-    // send data:  id = 0x00, standard frame, data len = 8, stmp: data buf
-    CAN.sendMsgBuf(0x70,0, 8, stmp);
-    delay(1000);                       // send data once per second
+{
+    tasks.poll();
+    // the CAN messages keep their own schedule, to the microsecond
+    scheduler.poll();
+    if (CAN.ready()) {
+        diagnostics.poll();
+    }
 }
 
 /*********************************************************************************************************
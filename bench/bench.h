@@ -0,0 +1,49 @@
+// Benchmark region markers for sketches run under bench/simbench.
+//
+// A region is opened by writing its id to GPIOR0 and closed by writing
+// BENCH_MARK_END. GPIOR0 sits at the same data address on every MCU in the
+// Jenkinsfile matrix, costs a single OUT instruction to write and is not used
+// by the Arduino core, so the markers do not disturb what is being measured.
+// The harness subtracts the "calibrate" region (an empty BENCH_BEGIN/END
+// pair) from every other region.
+
+#ifndef _BENCH_H_INCLUDED
+#define _BENCH_H_INCLUDED
+
+#include <Arduino.h>
+#include "bench_ids.h"
+
+// Compiler barrier so work is not hoisted in or out of a region.
+#define BENCH_BARRIER() asm volatile("" ::: "memory")
+
+#define BENCH_BEGIN(id) do { BENCH_BARRIER(); GPIOR0 = (id); BENCH_BARRIER(); } while (0)
+#define BENCH_END() do { BENCH_BARRIER(); GPIOR0 = BENCH_MARK_END; BENCH_BARRIER(); } while (0)
+
+// Run `stmt` `n` times, each call in its own region.
+#define BENCH_RUN(id, n, stmt) \
+  do { \
+    for (uint16_t _bench_i = 0; _bench_i < (n); _bench_i++) { \
+      BENCH_BEGIN(id); \
+      stmt; \
+      BENCH_END(); \
+    } \
+  } while (0)
+
+// Report that the data moved by benchmark `id` came out wrong. The harness
+// still writes the results but exits non-zero.
+#define BENCH_CHECK(id, cond) \
+  do { \
+    if (!(cond)) { \
+      GPIOR0 = BENCH_MARK_FAIL; \
+      GPIOR0 = (id); \
+    } \
+  } while (0)
+
+// Tell the harness the sketch is finished.
+inline void bench_done(void) {
+  BENCH_RUN(BENCH_calibrate, 16, (void)0);
+  GPIOR0 = BENCH_MARK_DONE;
+  for (;;) ;
+}
+
+#endif
@@ -0,0 +1,49 @@
+// Benchmark region identifiers.
+//
+// Shared between the benchmark sketches (which write the id to GPIOR0 when a
+// region starts) and the simavr harness (which turns the id back into a name
+// for the results file). Ids must stay stable so results can be diffed
+// between commits: append new entries, never renumber.
+
+#ifndef _BENCH_IDS_H_INCLUDED
+#define _BENCH_IDS_H_INCLUDED
+
+#define BENCH_MARK_END  0x00  // Closes the currently open region
+#define BENCH_MARK_DONE 0xFF  // Sketch finished, harness stops simulating
+#define BENCH_MARK_FAIL 0xFE  // Followed by the id whose data check failed
+
+// BENCH_ID(id, name)
+#define BENCH_ID_LIST \
+  BENCH_ID(0x01, calibrate) \
+  BENCH_ID(0x10, spi_transfer8) \
+  BENCH_ID(0x11, spi_transfer16) \
+  BENCH_ID(0x12, spi_transfer_buf32) \
+  BENCH_ID(0x13, spi_transferAsync_buf32) \
+  BENCH_ID(0x14, spi_transferAsync_start32) \
+  BENCH_ID(0x15, spi_transfer_txrx_buf32) \
+  BENCH_ID(0x16, spi_write_buf32) \
+  BENCH_ID(0x17, spi_read_buf32) \
+  BENCH_ID(0x18, spi_transfer32) \
+  BENCH_ID(0x19, spi_writeStream_buf32) \
+  BENCH_ID(0x1A, spi_transferStream_buf32) \
+  BENCH_ID(0x1B, spi_device_select) \
+  BENCH_ID(0x1C, spi_digitalWrite_select) \
+  BENCH_ID(0x1D, spi_device_readRegisters4) \
+  BENCH_ID(0x1E, spi_transfer24) \
+  BENCH_ID(0x20, max6675_readCelsius) \
+  BENCH_ID(0x21, max6675_readFahrenheit) \
+  BENCH_ID(0x22, max6675_spi_readCelsius) \
+  BENCH_ID(0x23, max6675_legacy_readCelsius) \
+  BENCH_ID(0x24, max6675_array_readAll4) \
+  BENCH_ID(0x25, max6675_readCentiFahrenheit) \
+  BENCH_ID(0x30, rtd_Get_RTD_Temperature_degC) \
+  BENCH_ID(0x31, rtd_Get_RTD_ADC_Reading) \
+  BENCH_ID(0x40, usartspi_transfer8) \
+  BENCH_ID(0x41, usartspi_transfer_buf32) \
+  BENCH_ID(0x42, usartspi_write_buf32)
+
+#define BENCH_ID(id, name) BENCH_##name = id,
+enum { BENCH_ID_LIST };
+#undef BENCH_ID
+
+#endif
@@ -0,0 +1,85 @@
+// Cycle benchmark for the MAX6675 thermocouple driver.
+// The bit-banged sensor uses the same pins as
+// max6675k_thermocouple/serialthermocouple.pde, where the harness attaches a
+// MAX6675 model. The hardware SPI sensor talks to the SPI loopback model.
+
+#include <util/delay.h>
+#include "max6675.h"
+#include "max6675array.h"
+#include "bench.h"
+
+#define BENCH_CALLS 4
+
+int thermoDO = 4;
+int thermoCS = 5;
+int thermoCLK = 6;
+
+MAX6675 thermocouple(thermoCLK, thermoCS, thermoDO);
+MAX6675 spi_thermocouple(SS);
+
+// Four sensors on the bit-bang bus; the harness model answers on CS 5.
+const int8_t arrayCS[] = { 5, 7, 8, 9 };
+MAX6675Array thermocouples(thermoCLK, thermoDO, arrayCS, 4);
+uint16_t frames[4];
+
+// The original digitalWrite()/_delay_ms(1) bit-bang read, kept as the
+// baseline for the port register implementation.
+static uint8_t legacy_spiread(void) {
+  uint8_t d = 0;
+
+  for (int i = 7; i >= 0; i--) {
+    digitalWrite(thermoCLK, LOW);
+    _delay_ms(1);
+    if (digitalRead(thermoDO)) {
+      d |= (1 << i);
+    }
+    digitalWrite(thermoCLK, HIGH);
+    _delay_ms(1);
+  }
+  return d;
+}
+
+static double legacy_readCelsius(void) {
+  uint16_t v;
+
+  digitalWrite(thermoCS, LOW);
+  _delay_ms(1);
+  v = legacy_spiread();
+  v <<= 8;
+  v |= legacy_spiread();
+  digitalWrite(thermoCS, HIGH);
+
+  if (v & 0x4) {
+    return NAN;
+  }
+  v >>= 3;
+  return v * 0.25;
+}
+
+void setup() {
+  // readCelsius() after a full conversion period goes to the bus, the
+  // float and integer Fahrenheit reads right behind it are served from the
+  // cached frame.
+  for (uint8_t i = 0; i < BENCH_CALLS; i++) {
+    delay(MAX6675_CONVERSION_MS + 1);
+    BENCH_RUN(BENCH_max6675_readCelsius, 1, thermocouple.readCelsius());
+    BENCH_RUN(BENCH_max6675_readFahrenheit, 1, thermocouple.readFahrenheit());
+    BENCH_RUN(BENCH_max6675_readCentiFahrenheit, 1, thermocouple.readCentiFahrenheit());
+    BENCH_RUN(BENCH_max6675_spi_readCelsius, 1, spi_thermocouple.readCelsius());
+    BENCH_RUN(BENCH_max6675_array_readAll4, 1, thermocouples.readAll(frames));
+  }
+  BENCH_RUN(BENCH_max6675_legacy_readCelsius, BENCH_CALLS, legacy_readCelsius());
+
+  // The harness model reads 25 C, frame 0x0320, so a read that lost or
+  // shifted a bit shows.
+  delay(MAX6675_CONVERSION_MS + 1);
+  BENCH_CHECK(BENCH_max6675_readCelsius, thermocouple.readCelsius() == 25.0);
+  BENCH_CHECK(BENCH_max6675_readFahrenheit, thermocouple.readFahrenheit() == 77.0);
+  BENCH_CHECK(BENCH_max6675_readCentiFahrenheit, thermocouple.readCentiFahrenheit() == 7700);
+  BENCH_CHECK(BENCH_max6675_array_readAll4,
+              thermocouples.readAll(frames) && frames[0] == 0x0320);
+  bench_done();
+}
+
+void loop() {
+}
@@ -0,0 +1,21 @@
+// Cycle benchmark for the ProtoVoltaics RTD shield driver.
+// The harness attaches an RTD shield register model at I2C address 82.
+
+#include <Wire.h>
+#include <PV_RTD_RS232_RS485_Shield.h>
+#include "bench.h"
+
+#define BENCH_CALLS 8
+
+PV_RTD_RS232_RS485 my_rtds( 82, 100.0 );
+
+void setup() {
+  I2C_RTD_PORTNAME.begin();
+
+  BENCH_RUN(BENCH_rtd_Get_RTD_ADC_Reading, BENCH_CALLS, my_rtds.Get_RTD_ADC_Reading( 3, 1 ));
+  BENCH_RUN(BENCH_rtd_Get_RTD_Temperature_degC, BENCH_CALLS, my_rtds.Get_RTD_Temperature_degC( 3, 1 ));
+  bench_done();
+}
+
+void loop() {
+}
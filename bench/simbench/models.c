@@ -0,0 +1,225 @@
+// Peripheral models attached to the simulated MCU by simbench.
+
+#include <string.h>
+#include "sim_io.h"
+#include "avr_spi.h"
+#include "avr_twi.h"
+#include "avr_uart.h"
+#include "avr_ioport.h"
+#include "models.h"
+
+// Port/bit for digital pins 0-13 on the boards in the Jenkinsfile matrix.
+static const char nano_ports[] = "DDDDDDDDBBBBBB";
+static const uint8_t nano_bits[] = { 0, 1, 2, 3, 4, 5, 6, 7, 0, 1, 2, 3, 4, 5 };
+static const char mega_ports[] = "EEEEGEHHHHBBBB";
+static const uint8_t mega_bits[] = { 0, 1, 4, 5, 5, 3, 3, 4, 5, 6, 4, 5, 6, 7 };
+
+int simbench_pin(const char *board, int pin, char *port, int *bit)
+{
+  if (pin < 0 || pin > 13)
+    return -1;
+  if (!strcmp(board, "mega")) {
+    *port = mega_ports[pin];
+    *bit = mega_bits[pin];
+  } else {
+    *port = nano_ports[pin];
+    *bit = nano_bits[pin];
+  }
+  return 0;
+}
+
+// SPI
+
+// CPU cycles per SCK period for the current SPCR/SPSR setting.
+static uint32_t spi_divider(avr_t *avr)
+{
+  static const uint8_t div[] = { 4, 16, 64, 128 };
+  uint32_t d = div[avr->data[SIMBENCH_SPCR] & 0x03];
+  if (avr->data[SIMBENCH_SPSR] & 0x01)
+    d /= 2;
+  return d;
+}
+
+static void spi_model_output(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+  spi_model_t *m = (spi_model_t *)param;
+  uint32_t cycles = 8 * spi_divider(m->avr);
+
+  if (m->avr->cycle < m->free_cycle) {
+    m->collisions++;
+    return;
+  }
+  m->free_cycle = m->avr->cycle + cycles;
+  m->bus.bytes++;
+  m->bus.busy_cycles += cycles;
+  avr_raise_irq(m->input, m->last);
+  m->last = value;
+}
+
+void spi_model_init(spi_model_t *m, avr_t *avr)
+{
+  memset(m, 0, sizeof(*m));
+  m->avr = avr;
+  m->input = avr_io_getirq(avr, AVR_IOCTL_SPI_GETIRQ(0), SPI_IRQ_INPUT);
+  avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_SPI_GETIRQ(0), SPI_IRQ_OUTPUT),
+                          spi_model_output, m);
+}
+
+// USART in MSPIM mode
+
+static void usart_model_output(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+  usart_model_t *m = (usart_model_t *)param;
+
+  m->bus.bytes++;
+  m->bus.busy_cycles += 16 * (m->avr->data[m->ubrrl] + 1);
+  avr_raise_irq(m->input, m->last);
+  m->last = value;
+}
+
+void usart_model_init(usart_model_t *m, avr_t *avr, const char *board)
+{
+  char uart = strcmp(board, "mega") ? '0' : '1';
+
+  memset(m, 0, sizeof(*m));
+  m->avr = avr;
+  m->ubrrl = uart == '0' ? SIMBENCH_UBRR0L : SIMBENCH_UBRR1L;
+  m->input = avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ(uart), UART_IRQ_INPUT);
+  avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ(uart), UART_IRQ_OUTPUT),
+                          usart_model_output, m);
+}
+
+// TWI
+
+// CPU cycles per SCL period: F_CPU / SCL = 16 + 2 * TWBR * 4^TWPS.
+static uint32_t twi_bit_cycles(avr_t *avr)
+{
+  uint32_t prescale = 1 << (2 * (avr->data[SIMBENCH_TWSR] & 0x03));
+  return 16 + 2 * avr->data[SIMBENCH_TWBR] * prescale;
+}
+
+static void rtd_model_output(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+  rtd_model_t *m = (rtd_model_t *)param;
+  avr_twi_msg_irq_t v;
+  v.u.v = value;
+
+  if (v.u.twi.msg & TWI_COND_STOP)
+    m->selected = 0;
+
+  if (v.u.twi.msg & TWI_COND_START) {
+    m->selected = 0;
+    if ((v.u.twi.addr >> 1) == m->addr) {
+      m->selected = v.u.twi.addr;
+      m->pointer_pending = !(v.u.twi.addr & 1);
+      avr_raise_irq(m->input, avr_twi_irq_msg(TWI_COND_ACK, m->selected, 1));
+    }
+    // Start condition, address byte and ack
+    m->bus.bytes++;
+    m->bus.busy_cycles += 10 * twi_bit_cycles(m->avr);
+  }
+
+  if (!m->selected)
+    return;
+
+  if (v.u.twi.msg & TWI_COND_WRITE) {
+    avr_raise_irq(m->input, avr_twi_irq_msg(TWI_COND_ACK, m->selected, 1));
+    if (m->pointer_pending) {
+      m->pointer = v.u.twi.data;
+      m->pointer_pending = 0;
+    } else {
+      m->regs[m->pointer++] = v.u.twi.data;
+    }
+    m->bus.bytes++;
+    m->bus.busy_cycles += 9 * twi_bit_cycles(m->avr);
+  }
+
+  if (v.u.twi.msg & TWI_COND_READ) {
+    avr_raise_irq(m->input, avr_twi_irq_msg(TWI_COND_READ, m->selected,
+                                            m->regs[m->pointer++]));
+    m->bus.bytes++;
+    m->bus.busy_cycles += 9 * twi_bit_cycles(m->avr);
+  }
+}
+
+void rtd_model_init(rtd_model_t *m, avr_t *avr, uint8_t addr)
+{
+  memset(m, 0, sizeof(*m));
+  m->avr = avr;
+  m->addr = addr;
+
+  // 3-wire channel 1: PGA 32, 250uA, and an ADC reading near 110 ohms.
+  m->regs[8] = 0x00;
+  m->regs[9] = 0x01;
+  m->regs[18] = 0x53;
+  m->regs[191] = 0x12;
+  m->regs[192] = 0x34;
+  m->regs[193] = 0x56;
+
+  m->input = avr_io_getirq(avr, AVR_IOCTL_TWI_GETIRQ(0), TWI_IRQ_INPUT);
+  avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_TWI_GETIRQ(0), TWI_IRQ_OUTPUT),
+                          rtd_model_output, m);
+}
+
+// MAX6675
+
+static void max6675_model_present(max6675_model_t *m)
+{
+  avr_raise_irq(m->so, (m->bit >= 0) ? (m->frame >> m->bit) & 1 : 0);
+}
+
+static void max6675_model_cs(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+  max6675_model_t *m = (max6675_model_t *)param;
+
+  if (!value && !m->cs_low) {
+    m->cs_low = 1;
+    m->cs_low_cycle = m->avr->cycle;
+    m->frame = (m->quarter_degrees << 3) | (m->open ? 0x4 : 0);
+    m->bit = 15;
+    max6675_model_present(m);
+  } else if (value && m->cs_low) {
+    m->cs_low = 0;
+    m->bus.bytes += 2;
+    m->bus.busy_cycles += m->avr->cycle - m->cs_low_cycle;
+  }
+}
+
+static void max6675_model_sck(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+  max6675_model_t *m = (max6675_model_t *)param;
+
+  if (m->cs_low && m->sck && !value) {
+    m->bit--;
+    max6675_model_present(m);
+  }
+  m->sck = value;
+}
+
+int max6675_model_init(max6675_model_t *m, avr_t *avr, const char *board,
+                       int sclk, int cs, int so)
+{
+  char port;
+  int bit;
+
+  memset(m, 0, sizeof(*m));
+  m->avr = avr;
+  m->quarter_degrees = 25 * 4;
+  m->bit = -1;
+
+  if (simbench_pin(board, so, &port, &bit))
+    return -1;
+  m->so = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(port), bit);
+
+  if (simbench_pin(board, cs, &port, &bit))
+    return -1;
+  avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(port), bit),
+                          max6675_model_cs, m);
+  m->cs_low = 0;
+
+  if (simbench_pin(board, sclk, &port, &bit))
+    return -1;
+  avr_irq_register_notify(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(port), bit),
+                          max6675_model_sck, m);
+  return 0;
+}
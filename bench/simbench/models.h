@@ -0,0 +1,95 @@
+// Peripheral models attached to the simulated MCU by simbench.
+//
+// Every model keeps a running count of bytes moved and CPU cycles the bus
+// was busy, which simbench snapshots at the start and end of each benchmark
+// region to compute bus utilization.
+
+#ifndef _SIMBENCH_MODELS_H_INCLUDED
+#define _SIMBENCH_MODELS_H_INCLUDED
+
+#include <stdint.h>
+#include "sim_avr.h"
+
+// Data addresses of the registers the models and markers look at. They are
+// identical on the ATmega168/328 and ATmega1280/2560.
+#define SIMBENCH_GPIOR0 0x3E
+#define SIMBENCH_SPCR   0x4C
+#define SIMBENCH_SPSR   0x4D
+#define SIMBENCH_TWBR   0xB8
+#define SIMBENCH_TWSR   0xB9
+#define SIMBENCH_UBRR0L 0xC4
+#define SIMBENCH_UBRR1L 0xCC
+
+typedef struct bus_counters_t {
+  uint64_t bytes;
+  uint64_t busy_cycles;
+} bus_counters_t;
+
+// Arduino digital pin -> AVR port letter and bit for the board tag.
+int simbench_pin(const char *board, int pin, char *port, int *bit);
+
+// Hardware SPI slave that answers each byte with the previous MOSI byte.
+// A byte that finishes less than eight SCK periods after the one before it
+// was written to SPDR while that one was still shifting. The hardware sets
+// WCOL and drops such a write, so the model drops the byte too and counts
+// it in collisions; the gap it leaves shows in the replies.
+typedef struct spi_model_t {
+  avr_t *avr;
+  avr_irq_t *input;
+  uint8_t last;
+  avr_cycle_count_t free_cycle;
+  uint64_t collisions;
+  bus_counters_t bus;
+} spi_model_t;
+
+void spi_model_init(spi_model_t *m, avr_t *avr);
+
+// USARTSPI's bus, USART0 on the Nano and USART1 on the Mega, answering
+// each byte with the previous one like spi_model_t. simavr only models the
+// USART as an asynchronous UART, so bytes come and go at UART frame timing
+// rather than in MSPIM's eight clocks; busy cycles are counted at the MSPIM
+// rate, 16 * (UBRR + 1) per byte.
+typedef struct usart_model_t {
+  avr_t *avr;
+  avr_irq_t *input;
+  uint16_t ubrrl;
+  uint8_t last;
+  bus_counters_t bus;
+} usart_model_t;
+
+void usart_model_init(usart_model_t *m, avr_t *avr, const char *board);
+
+// RTD shield on the TWI bus: a register pointer plus a 256 byte register
+// file, preloaded with a plausible 3-wire channel 1 configuration.
+typedef struct rtd_model_t {
+  avr_t *avr;
+  avr_irq_t *input;
+  uint8_t addr;
+  uint8_t selected;
+  uint8_t pointer_pending;
+  uint8_t pointer;
+  uint8_t regs[256];
+  bus_counters_t bus;
+} rtd_model_t;
+
+void rtd_model_init(rtd_model_t *m, avr_t *avr, uint8_t addr);
+
+// MAX6675 on three GPIO pins. SO presents D15 when CS falls and shifts on
+// every falling SCK edge while CS is low.
+typedef struct max6675_model_t {
+  avr_t *avr;
+  avr_irq_t *so;
+  uint8_t cs_low;
+  uint8_t sck;
+  int8_t bit;
+  uint16_t frame;
+  uint16_t quarter_degrees;
+  uint8_t open;
+  uint64_t cs_low_cycle;
+  bus_counters_t bus;
+} max6675_model_t;
+
+int max6675_model_init(max6675_model_t *m, avr_t *avr, const char *board,
+                       int sclk, int cs, int so);
+
+#endif
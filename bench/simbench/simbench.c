@@ -0,0 +1,240 @@
+// simbench: run a benchmark sketch under simavr and report CPU cycles per
+// marked region plus the utilization of every modelled bus.
+//
+//   simbench -m atmega328p -b nano -s spi_bench -o out.csv firmware.elf
+//
+// Regions are delimited by writes to GPIOR0 (see bench/bench.h). One CSV row
+// is written per region id, in id order, so two result files can be diffed
+// directly. A sketch can also flag a benchmark whose data came out wrong,
+// which makes simbench exit non-zero.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "sim_avr.h"
+#include "sim_elf.h"
+#include "sim_io.h"
+#include "bench_ids.h"
+#include "models.h"
+
+#define SIMBENCH_F_CPU 16000000
+// Give up after this many simulated seconds without BENCH_MARK_DONE.
+#define SIMBENCH_TIMEOUT_S 120
+
+enum { BUS_SPI, BUS_TWI, BUS_GPIO, BUS_USART, BUS_COUNT };
+static const char *bus_names[BUS_COUNT] = { "spi", "twi", "gpio", "usart" };
+
+typedef struct region_t {
+  uint32_t calls;
+  uint64_t total;
+  uint64_t min;
+  uint64_t max;
+  bus_counters_t bus[BUS_COUNT];
+} region_t;
+
+static region_t regions[256];
+static uint8_t open_id;
+static uint64_t open_cycle;
+static bus_counters_t open_bus[BUS_COUNT];
+static int done;
+static int failing;   // BENCH_MARK_FAIL seen, the id comes next
+static int failures;
+
+static spi_model_t spi;
+static rtd_model_t rtd;
+static max6675_model_t max6675;
+static usart_model_t usart;
+
+static void snapshot(bus_counters_t *out)
+{
+  out[BUS_SPI] = spi.bus;
+  out[BUS_TWI] = rtd.bus;
+  out[BUS_GPIO] = max6675.bus;
+  out[BUS_USART] = usart.bus;
+}
+
+static const char *region_name(int id)
+{
+  switch (id) {
+#define BENCH_ID(id, name) case id: return #name;
+  BENCH_ID_LIST
+#undef BENCH_ID
+  }
+  return NULL;
+}
+
+static void gpior0_write(struct avr_t *avr, avr_io_addr_t addr, uint8_t v, void *param)
+{
+  bus_counters_t now[BUS_COUNT];
+  region_t *r;
+  uint64_t cycles;
+  int i;
+
+  avr->data[addr] = v;
+
+  if (failing) {
+    failing = 0;
+    failures++;
+    fprintf(stderr, "simbench: data check failed for %s\n",
+            region_name(v) ? region_name(v) : "unknown");
+    return;
+  }
+  if (v == BENCH_MARK_FAIL) {
+    failing = 1;
+    return;
+  }
+  if (v == BENCH_MARK_DONE) {
+    done = 1;
+    return;
+  }
+  if (v != BENCH_MARK_END) {
+    open_id = v;
+    open_cycle = avr->cycle;
+    snapshot(open_bus);
+    return;
+  }
+  if (!open_id)
+    return;
+
+  snapshot(now);
+  cycles = avr->cycle - open_cycle;
+  r = &regions[open_id];
+  if (!r->calls || cycles < r->min)
+    r->min = cycles;
+  if (cycles > r->max)
+    r->max = cycles;
+  r->total += cycles;
+  r->calls++;
+  for (i = 0; i < BUS_COUNT; i++) {
+    r->bus[i].bytes += now[i].bytes - open_bus[i].bytes;
+    r->bus[i].busy_cycles += now[i].busy_cycles - open_bus[i].busy_cycles;
+  }
+  open_id = 0;
+}
+
+static void report(FILE *out, const char *board, const char *mcu, const char *sketch)
+{
+  uint64_t overhead = regions[BENCH_calibrate].calls ? regions[BENCH_calibrate].min : 0;
+  int id, i;
+
+  for (id = 1; id < BENCH_MARK_DONE; id++) {
+    region_t *r = &regions[id];
+    const char *name = region_name(id);
+    uint64_t min, avg, max;
+
+    if (!r->calls || id == BENCH_calibrate)
+      continue;
+
+    min = r->min - overhead;
+    avg = r->total / r->calls - overhead;
+    max = r->max - overhead;
+    fprintf(out, "%s,%s,%s,%s,%u,%llu,%llu,%llu", board, mcu, sketch,
+            name ? name : "unknown", r->calls, (unsigned long long)min,
+            (unsigned long long)avg, (unsigned long long)max);
+    for (i = 0; i < BUS_COUNT; i++) {
+      // Throughput over the whole region, CPU overhead included
+      uint64_t cycles = r->total - overhead * r->calls;
+      fprintf(out, ",%llu,%llu,%.1f,%llu",
+              (unsigned long long)(r->bus[i].bytes / r->calls),
+              (unsigned long long)(r->bus[i].busy_cycles / r->calls),
+              r->total ? 100.0 * r->bus[i].busy_cycles / r->total : 0.0,
+              cycles ? (unsigned long long)((double)r->bus[i].bytes * SIMBENCH_F_CPU / cycles) : 0ULL);
+    }
+    fprintf(out, "\n");
+  }
+}
+
+static void header(FILE *out)
+{
+  int i;
+
+  fprintf(out, "board,mcu,sketch,benchmark,calls,cycles_min,cycles_avg,cycles_max");
+  for (i = 0; i < BUS_COUNT; i++)
+    fprintf(out, ",%s_bytes,%s_busy_cycles,%s_util_pct,%s_bytes_per_s", bus_names[i],
+            bus_names[i], bus_names[i], bus_names[i]);
+  fprintf(out, "\n");
+}
+
+static void usage(const char *argv0)
+{
+  fprintf(stderr,
+          "usage: %s -m mcu -b board -s sketch [-o out.csv] [-H] firmware.elf\n"
+          "  -m  simavr MCU name (atmega168, atmega328p, atmega1280, atmega2560)\n"
+          "  -b  Arduino board tag, selects the pin map (nano, mega)\n"
+          "  -s  sketch name written to the sketch column\n"
+          "  -o  append results to this file instead of stdout\n"
+          "  -H  print the CSV header and exit\n", argv0);
+  exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+  const char *mcu = NULL, *board = NULL, *sketch = NULL, *outname = NULL;
+  elf_firmware_t firmware;
+  avr_t *avr;
+  FILE *out = stdout;
+  int state = cpu_Running;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "m:b:s:o:H")) != -1) {
+    switch (opt) {
+    case 'm': mcu = optarg; break;
+    case 'b': board = optarg; break;
+    case 's': sketch = optarg; break;
+    case 'o': outname = optarg; break;
+    case 'H': header(stdout); return 0;
+    default: usage(argv[0]);
+    }
+  }
+  if (!mcu || !board || !sketch || optind != argc - 1)
+    usage(argv[0]);
+
+  memset(&firmware, 0, sizeof(firmware));
+  if (elf_read_firmware(argv[optind], &firmware)) {
+    fprintf(stderr, "%s: unable to load %s\n", argv[0], argv[optind]);
+    return 1;
+  }
+
+  avr = avr_make_mcu_by_name(mcu);
+  if (!avr) {
+    fprintf(stderr, "%s: unknown MCU %s\n", argv[0], mcu);
+    return 1;
+  }
+  avr_init(avr);
+  firmware.frequency = SIMBENCH_F_CPU;
+  avr_load_firmware(avr, &firmware);
+
+  spi_model_init(&spi, avr);
+  rtd_model_init(&rtd, avr, 82);
+  // serialthermocouple.pde wiring: CLK 6, CS 5, DO 4
+  if (max6675_model_init(&max6675, avr, board, 6, 5, 4)) {
+    fprintf(stderr, "%s: no pin map for board %s\n", argv[0], board);
+    return 1;
+  }
+  usart_model_init(&usart, avr, board);
+  avr_register_io_write(avr, SIMBENCH_GPIOR0, gpior0_write, NULL);
+
+  while (!done && state != cpu_Done && state != cpu_Crashed &&
+         avr->cycle < (avr_cycle_count_t)SIMBENCH_TIMEOUT_S * SIMBENCH_F_CPU)
+    state = avr_run(avr);
+
+  if (!done) {
+    fprintf(stderr, "%s: %s did not finish (state %d, cycle %llu)\n", argv[0],
+            sketch, state, (unsigned long long)avr->cycle);
+    return 1;
+  }
+
+  if (spi.collisions)
+    fprintf(stderr, "%s: %s wrote %llu SPI byte(s) while the previous one was "
+            "still shifting\n", argv[0], sketch, (unsigned long long)spi.collisions);
+
+  if (outname && !(out = fopen(outname, "a"))) {
+    perror(outname);
+    return 1;
+  }
+  report(out, board, mcu, sketch);
+  if (out != stdout)
+    fclose(out);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,10 @@
+// Stand-in for simavr's avr_ioport.h. See standin.c.
+
+#ifndef _STANDIN_AVR_IOPORT_H_INCLUDED
+#define _STANDIN_AVR_IOPORT_H_INCLUDED
+
+#include "sim_io.h"
+
+#define AVR_IOCTL_IOPORT_GETIRQ(_name) AVR_IOCTL_DEF('i', 'o', 'g', (_name))
+
+#endif
@@ -0,0 +1,16 @@
+// Stand-in for simavr's avr_spi.h. See standin.c.
+
+#ifndef _STANDIN_AVR_SPI_H_INCLUDED
+#define _STANDIN_AVR_SPI_H_INCLUDED
+
+#include "sim_io.h"
+
+enum {
+  SPI_IRQ_INPUT = 0,
+  SPI_IRQ_OUTPUT,
+  SPI_IRQ_COUNT
+};
+
+#define AVR_IOCTL_SPI_GETIRQ(_name) AVR_IOCTL_DEF('s', 'p', 'i', (_name))
+
+#endif
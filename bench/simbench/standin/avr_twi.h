@@ -0,0 +1,46 @@
+// Stand-in for simavr's avr_twi.h. See standin.c.
+
+#ifndef _STANDIN_AVR_TWI_H_INCLUDED
+#define _STANDIN_AVR_TWI_H_INCLUDED
+
+#include "sim_io.h"
+
+enum {
+  TWI_IRQ_INPUT = 0,
+  TWI_IRQ_OUTPUT,
+  TWI_IRQ_STATUS,
+  TWI_IRQ_COUNT
+};
+
+enum {
+  TWI_COND_START = (1 << 0),
+  TWI_COND_STOP = (1 << 1),
+  TWI_COND_ADDR = (1 << 2),
+  TWI_COND_ACK = (1 << 3),
+  TWI_COND_WRITE = (1 << 4),
+  TWI_COND_READ = (1 << 5),
+};
+
+typedef struct avr_twi_msg_t {
+  uint32_t unused : 8,
+    msg : 8,
+    addr : 8,
+    data : 8;
+} avr_twi_msg_t;
+
+typedef struct avr_twi_msg_irq_t {
+  union {
+    uint32_t v;
+    avr_twi_msg_t twi;
+  } u;
+} avr_twi_msg_irq_t;
+
+#define AVR_IOCTL_TWI_GETIRQ(_name) AVR_IOCTL_DEF('t', 'w', 'i', (_name))
+
+static inline uint32_t avr_twi_irq_msg(uint8_t msg, uint8_t addr, uint8_t data)
+{
+  avr_twi_msg_irq_t m = { .u.twi.msg = msg, .u.twi.addr = addr, .u.twi.data = data };
+  return m.u.v;
+}
+
+#endif
@@ -0,0 +1,18 @@
+// Stand-in for simavr's avr_uart.h. See standin.c.
+
+#ifndef _STANDIN_AVR_UART_H_INCLUDED
+#define _STANDIN_AVR_UART_H_INCLUDED
+
+#include "sim_io.h"
+
+enum {
+  UART_IRQ_INPUT = 0,
+  UART_IRQ_OUTPUT,
+  UART_IRQ_OUT_XON,
+  UART_IRQ_OUT_XOFF,
+  UART_IRQ_COUNT
+};
+
+#define AVR_IOCTL_UART_GETIRQ(_name) AVR_IOCTL_DEF('u', 'a', 'r', (_name))
+
+#endif
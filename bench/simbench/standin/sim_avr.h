@@ -0,0 +1,41 @@
+// Stand-in for simavr's sim_avr.h: the subset of the core simbench and its
+// models use, with the same names and signatures. See standin.c.
+
+#ifndef _STANDIN_SIM_AVR_H_INCLUDED
+#define _STANDIN_SIM_AVR_H_INCLUDED
+
+#include <stdint.h>
+#include "sim_irq.h"
+
+typedef uint64_t avr_cycle_count_t;
+typedef uint16_t avr_io_addr_t;
+
+enum {
+  cpu_Limbo = 0,
+  cpu_Stopped,
+  cpu_Running,
+  cpu_Sleeping,
+  cpu_Step,
+  cpu_StepDone,
+  cpu_Done,
+  cpu_Crashed,
+};
+
+typedef struct avr_t {
+  const char *mmcu;
+  uint32_t frequency;
+  avr_cycle_count_t cycle;
+  uint8_t *data;
+  int state;
+  // The script standing in for the firmware, see standin.c
+  void *script;
+} avr_t;
+
+typedef void (*avr_io_write_t)(struct avr_t *avr, avr_io_addr_t addr, uint8_t v,
+                               void *param);
+
+avr_t *avr_make_mcu_by_name(const char *name);
+int avr_init(avr_t *avr);
+int avr_run(avr_t *avr);
+
+#endif
@@ -0,0 +1,18 @@
+// Stand-in for simavr's sim_elf.h: the "firmware" is the name of a script
+// in standin.c. See standin.c.
+
+#ifndef _STANDIN_SIM_ELF_H_INCLUDED
+#define _STANDIN_SIM_ELF_H_INCLUDED
+
+#include "sim_avr.h"
+
+typedef struct elf_firmware_t {
+  char mmcu[64];
+  uint32_t frequency;
+  void *script;
+} elf_firmware_t;
+
+int elf_read_firmware(const char *file, elf_firmware_t *firmware);
+void avr_load_firmware(avr_t *avr, elf_firmware_t *firmware);
+
+#endif
@@ -0,0 +1,15 @@
+// Stand-in for simavr's sim_io.h. See standin.c.
+
+#ifndef _STANDIN_SIM_IO_H_INCLUDED
+#define _STANDIN_SIM_IO_H_INCLUDED
+
+#include "sim_avr.h"
+
+#define AVR_IOCTL_DEF(_a, _b, _c, _d) \
+  (((_a) << 24) | ((_b) << 16) | ((_c) << 8) | ((_d)))
+
+avr_irq_t *avr_io_getirq(avr_t *avr, uint32_t ctl, int index);
+void avr_register_io_write(avr_t *avr, avr_io_addr_t addr, avr_io_write_t writep,
+                           void *param);
+
+#endif
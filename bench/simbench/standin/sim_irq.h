@@ -0,0 +1,24 @@
+// Stand-in for simavr's sim_irq.h. See standin.c.
+
+#ifndef _STANDIN_SIM_IRQ_H_INCLUDED
+#define _STANDIN_SIM_IRQ_H_INCLUDED
+
+#include <stdint.h>
+
+struct avr_irq_t;
+
+typedef void (*avr_irq_notify_t)(struct avr_irq_t *irq, uint32_t value, void *param);
+
+#define STANDIN_IRQ_HOOKS 4
+
+typedef struct avr_irq_t {
+  uint32_t irq;
+  uint32_t value;
+  avr_irq_notify_t notify[STANDIN_IRQ_HOOKS];
+  void *param[STANDIN_IRQ_HOOKS];
+} avr_irq_t;
+
+void avr_irq_register_notify(avr_irq_t *irq, avr_irq_notify_t notify, void *param);
+void avr_raise_irq(avr_irq_t *irq, uint32_t value);
+
+#endif
@@ -0,0 +1,404 @@
+// Stand-in for libsimavr, for checking simbench without simavr or an AVR
+// toolchain (make -C bench selftest).
+//
+// Instead of running firmware, avr_run() plays a script named by the
+// "firmware" file name: the GPIOR0 writes a benchmark sketch would make and
+// the bus traffic simavr would raise on the SPI, TWI, UART and port IRQs,
+// at given cycle counts. The scripts check what the models raise back, and the
+// selftest target diffs simbench's CSV against the expected file next to
+// this one. This only covers simbench's own logic, the region accounting
+// and the models; the cycle counts of real sketches still need simavr.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sim_avr.h"
+#include "sim_elf.h"
+#include "sim_io.h"
+#include "avr_spi.h"
+#include "avr_twi.h"
+#include "avr_uart.h"
+#include "avr_ioport.h"
+#include "bench_ids.h"
+#include "simbench/models.h"
+
+#define STANDIN_DATA_SIZE 0x2200
+#define STANDIN_IRQS 32
+#define STANDIN_IO_WRITES 4
+
+typedef int (*script_t)(avr_t *avr);
+
+static struct {
+  uint32_t ctl;
+  int index;
+  avr_irq_t irq;
+} irqs[STANDIN_IRQS];
+static int nirqs;
+
+static struct {
+  avr_io_addr_t addr;
+  avr_io_write_t write;
+  void *param;
+} io_writes[STANDIN_IO_WRITES];
+static int nio_writes;
+
+void avr_irq_register_notify(avr_irq_t *irq, avr_irq_notify_t notify, void *param)
+{
+  int i;
+
+  for (i = 0; i < STANDIN_IRQ_HOOKS; i++) {
+    if (!irq->notify[i]) {
+      irq->notify[i] = notify;
+      irq->param[i] = param;
+      return;
+    }
+  }
+  fprintf(stderr, "standin: too many hooks on irq %08x\n", irq->irq);
+  exit(2);
+}
+
+void avr_raise_irq(avr_irq_t *irq, uint32_t value)
+{
+  int i;
+
+  irq->value = value;
+  for (i = 0; i < STANDIN_IRQ_HOOKS && irq->notify[i]; i++)
+    irq->notify[i](irq, value, irq->param[i]);
+}
+
+avr_irq_t *avr_io_getirq(avr_t *avr, uint32_t ctl, int index)
+{
+  int i;
+
+  for (i = 0; i < nirqs; i++) {
+    if (irqs[i].ctl == ctl && irqs[i].index == index)
+      return &irqs[i].irq;
+  }
+  if (nirqs == STANDIN_IRQS) {
+    fprintf(stderr, "standin: out of irqs\n");
+    exit(2);
+  }
+  irqs[nirqs].ctl = ctl;
+  irqs[nirqs].index = index;
+  irqs[nirqs].irq.irq = ctl + index;
+  return &irqs[nirqs++].irq;
+}
+
+void avr_register_io_write(avr_t *avr, avr_io_addr_t addr, avr_io_write_t writep,
+                           void *param)
+{
+  if (nio_writes == STANDIN_IO_WRITES) {
+    fprintf(stderr, "standin: out of io write hooks\n");
+    exit(2);
+  }
+  io_writes[nio_writes].addr = addr;
+  io_writes[nio_writes].write = writep;
+  io_writes[nio_writes].param = param;
+  nio_writes++;
+}
+
+avr_t *avr_make_mcu_by_name(const char *name)
+{
+  avr_t *avr = calloc(1, sizeof(*avr));
+
+  avr->mmcu = name;
+  avr->data = calloc(1, STANDIN_DATA_SIZE);
+  return avr;
+}
+
+int avr_init(avr_t *avr)
+{
+  avr->state = cpu_Running;
+  return 0;
+}
+
+// Scripts
+
+// A data memory write by the firmware, through any registered hook
+static void io_write(avr_t *avr, avr_io_addr_t addr, uint8_t v)
+{
+  int i;
+
+  for (i = 0; i < nio_writes; i++) {
+    if (io_writes[i].addr == addr) {
+      io_writes[i].write(avr, addr, v, io_writes[i].param);
+      return;
+    }
+  }
+  avr->data[addr] = v;
+}
+
+// A region of cycles length, from its GPIOR0 write to BENCH_MARK_END
+static void region(avr_t *avr, uint8_t id, avr_cycle_count_t cycles)
+{
+  io_write(avr, SIMBENCH_GPIOR0, id);
+  avr->cycle += cycles;
+  io_write(avr, SIMBENCH_GPIOR0, BENCH_MARK_END);
+}
+
+// What bench_done() does: the calibration regions, then BENCH_MARK_DONE.
+// An empty region costs the two OUT instructions, one cycle each.
+static void done(avr_t *avr)
+{
+  int i;
+
+  for (i = 0; i < 16; i++) {
+    region(avr, BENCH_calibrate, 1);
+    avr->cycle += 4;
+  }
+  io_write(avr, SIMBENCH_GPIOR0, BENCH_MARK_DONE);
+}
+
+static int expect(const char *what, uint32_t got, uint32_t want)
+{
+  if (got == want)
+    return 0;
+  fprintf(stderr, "standin: %s: got 0x%x, expected 0x%x\n", what, got, want);
+  return 1;
+}
+
+// Last value raised on an IRQ, recorded by a hook
+static void record(struct avr_irq_t *irq, uint32_t value, void *param)
+{
+  *(uint32_t *)param = value;
+}
+
+// Region accounting: min/avg/max per id with the calibration subtracted,
+// an END with no region open and a region nobody closes are ignored.
+static int markers(avr_t *avr)
+{
+  io_write(avr, SIMBENCH_GPIOR0, BENCH_MARK_END);
+  region(avr, BENCH_spi_transfer8, 1 + 10);
+  region(avr, BENCH_spi_transfer8, 1 + 14);
+  region(avr, BENCH_spi_transfer8, 1 + 12);
+  region(avr, BENCH_spi_transfer16, 1 + 100);
+  io_write(avr, SIMBENCH_GPIOR0, BENCH_spi_transfer32);
+  io_write(avr, SIMBENCH_GPIOR0, BENCH_spi_transfer16);
+  avr->cycle += 1 + 300;
+  io_write(avr, SIMBENCH_GPIOR0, BENCH_MARK_END);
+  return 0;
+}
+
+// The SPI model answers each byte with the previous one and counts eight
+// SCK periods per byte: F_CPU / 2 here, SPE | MSTR and SPI2X.
+static int spi(avr_t *avr)
+{
+  static const uint8_t out[] = { 0x11, 0x22, 0x33 };
+  avr_irq_t *mosi = avr_io_getirq(avr, AVR_IOCTL_SPI_GETIRQ(0), SPI_IRQ_OUTPUT);
+  avr_irq_t *miso = avr_io_getirq(avr, AVR_IOCTL_SPI_GETIRQ(0), SPI_IRQ_INPUT);
+  uint32_t in = 0xFFFF;
+  uint8_t last = 0;
+  int errors = 0;
+  unsigned i;
+
+  avr_irq_register_notify(miso, record, &in);
+  avr->data[SIMBENCH_SPCR] = 0x50;
+  avr->data[SIMBENCH_SPSR] = 0x01;
+
+  io_write(avr, SIMBENCH_GPIOR0, BENCH_spi_transfer_buf32);
+  avr->cycle += 1;
+  for (i = 0; i < sizeof(out); i++) {
+    // simavr raises the byte once it has been shifted out
+    avr->cycle += 16;
+    avr_raise_irq(mosi, out[i]);
+    errors += expect("spi reply", in, last);
+    last = out[i];
+  }
+  io_write(avr, SIMBENCH_GPIOR0, BENCH_MARK_END);
+  return errors;
+}
+
+// The USARTSPI model on the Nano's USART0 does the same as the SPI one;
+// UBRR0 = 1 is F_CPU / 4, 32 cycles per byte.
+static int usart(avr_t *avr)
+{
+  static const uint8_t out[] = { 0x44, 0x55, 0x66 };
+  avr_irq_t *txd = avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_OUTPUT);
+  avr_irq_t *rxd = avr_io_getirq(avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_INPUT);
+  uint32_t in = 0xFFFF;
+  uint8_t last = 0;
+  int errors = 0;
+  unsigned i;
+
+  avr_irq_register_notify(rxd, record, &in);
+  avr->data[SIMBENCH_UBRR0L] = 1;
+
+  io_write(avr, SIMBENCH_GPIOR0, BENCH_usartspi_transfer_buf32);
+  avr->cycle += 1;
+  for (i = 0; i < sizeof(out); i++) {
+    avr->cycle += 32;
+    avr_raise_irq(txd, out[i]);
+    errors += expect("usart reply", in, last);
+    last = out[i];
+  }
+  io_write(avr, SIMBENCH_GPIOR0, BENCH_MARK_END);
+  return errors;
+}
+
+// The RTD model: a write sets the register pointer, reads return the
+// registers from there on. 100 kHz SCL, 160 cycles per bit.
+static int twi(avr_t *avr)
+{
+  avr_irq_t *out = avr_io_getirq(avr, AVR_IOCTL_TWI_GETIRQ(0), TWI_IRQ_OUTPUT);
+  avr_irq_t *in = avr_io_getirq(avr, AVR_IOCTL_TWI_GETIRQ(0), TWI_IRQ_INPUT);
+  uint32_t reply = 0;
+  avr_twi_msg_irq_t msg;
+  int errors = 0;
+
+  avr_irq_register_notify(in, record, &reply);
+  avr->data[SIMBENCH_TWBR] = 72;
+  avr->data[SIMBENCH_TWSR] = 0;
+
+  io_write(avr, SIMBENCH_GPIOR0, BENCH_rtd_Get_RTD_ADC_Reading);
+  avr->cycle += 1;
+  // Nobody else answers at 0x50
+  avr_raise_irq(out, avr_twi_irq_msg(TWI_COND_START, 0x50 << 1, 0));
+  errors += expect("twi no ack", reply, 0);
+  avr_raise_irq(out, avr_twi_irq_msg(TWI_COND_STOP, 0, 0));
+
+  avr_raise_irq(out, avr_twi_irq_msg(TWI_COND_START, 82 << 1, 0));
+  errors += expect("twi address ack", reply, avr_twi_irq_msg(TWI_COND_ACK, 82 << 1, 1));
+  avr_raise_irq(out, avr_twi_irq_msg(TWI_COND_WRITE, 82 << 1, 191));
+  errors += expect("twi write ack", reply, avr_twi_irq_msg(TWI_COND_ACK, 82 << 1, 1));
+  avr_raise_irq(out, avr_twi_irq_msg(TWI_COND_START, (82 << 1) | 1, 0));
+  avr_raise_irq(out, avr_twi_irq_msg(TWI_COND_READ, (82 << 1) | 1, 0));
+  msg.u.v = reply;
+  errors += expect("twi read 191", msg.u.twi.data, 0x12);
+  avr_raise_irq(out, avr_twi_irq_msg(TWI_COND_READ, (82 << 1) | 1, 0));
+  msg.u.v = reply;
+  errors += expect("twi read 192", msg.u.twi.data, 0x34);
+  avr_raise_irq(out, avr_twi_irq_msg(TWI_COND_READ, (82 << 1) | 1, 0));
+  msg.u.v = reply;
+  errors += expect("twi read 193", msg.u.twi.data, 0x56);
+  avr_raise_irq(out, avr_twi_irq_msg(TWI_COND_STOP, 0, 0));
+  avr->cycle += 12000;
+  io_write(avr, SIMBENCH_GPIOR0, BENCH_MARK_END);
+  return errors;
+}
+
+// The MAX6675 model on the Nano pins of serialthermocouple.pde: CLK D6,
+// CS D5, SO D4, all on port D. It shows D15 when CS falls and the next bit
+// on each falling SCK edge: 25 C, 100 quarter degrees, is frame 0x0320.
+static int max6675(avr_t *avr)
+{
+  avr_irq_t *cs = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('D'), 5);
+  avr_irq_t *sck = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('D'), 6);
+  avr_irq_t *so = avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('D'), 4);
+  uint32_t level = 0;
+  uint16_t frame = 0;
+  int i;
+
+  avr_irq_register_notify(so, record, &level);
+  io_write(avr, SIMBENCH_GPIOR0, BENCH_max6675_readCelsius);
+  avr->cycle += 1;
+  avr_raise_irq(cs, 1);
+  avr_raise_irq(sck, 0);
+  avr_raise_irq(cs, 0);
+  for (i = 0; i < 16; i++) {
+    avr->cycle += 20;
+    frame = (frame << 1) | (level & 1);
+    avr_raise_irq(sck, 1);
+    avr->cycle += 20;
+    avr_raise_irq(sck, 0);
+  }
+  avr_raise_irq(cs, 1);
+  avr->cycle += 100;
+  io_write(avr, SIMBENCH_GPIOR0, BENCH_MARK_END);
+  return expect("max6675 frame", frame, 0x0320);
+}
+
+// A stream written two cycles per byte too fast at F_CPU / 2: the second
+// byte lands while the first is still shifting and is dropped, so the
+// byte after it is answered with the first one. The check spi_bench makes
+// on writeStream() sees the gap and fails.
+static int collide(avr_t *avr)
+{
+  static const uint8_t out[] = { 0x11, 0x22, 0x33 };
+  avr_irq_t *mosi = avr_io_getirq(avr, AVR_IOCTL_SPI_GETIRQ(0), SPI_IRQ_OUTPUT);
+  avr_irq_t *miso = avr_io_getirq(avr, AVR_IOCTL_SPI_GETIRQ(0), SPI_IRQ_INPUT);
+  uint32_t in = 0xFFFF;
+  int errors = 0;
+  unsigned i;
+
+  avr_irq_register_notify(miso, record, &in);
+  avr->data[SIMBENCH_SPCR] = 0x50;
+  avr->data[SIMBENCH_SPSR] = 0x01;
+
+  io_write(avr, SIMBENCH_GPIOR0, BENCH_spi_writeStream_buf32);
+  avr->cycle += 1 + 2;
+  for (i = 0; i < sizeof(out); i++) {
+    avr->cycle += 14;
+    avr_raise_irq(mosi, out[i]);
+  }
+  io_write(avr, SIMBENCH_GPIOR0, BENCH_MARK_END);
+  errors += expect("spi reply after a dropped byte", in, 0x11);
+
+  avr->cycle += 16;
+  avr_raise_irq(mosi, 0xEE);
+  errors += expect("spi reply after the stream", in, 0x33);
+  if (in != out[1]) {
+    io_write(avr, SIMBENCH_GPIOR0, BENCH_MARK_FAIL);
+    io_write(avr, SIMBENCH_GPIOR0, BENCH_spi_writeStream_buf32);
+  }
+  return errors;
+}
+
+// BENCH_CHECK() failing: simbench names the benchmark and exits non-zero
+static int fail(avr_t *avr)
+{
+  region(avr, BENCH_spi_writeStream_buf32, 1 + 600);
+  io_write(avr, SIMBENCH_GPIOR0, BENCH_MARK_FAIL);
+  io_write(avr, SIMBENCH_GPIOR0, BENCH_spi_writeStream_buf32);
+  return 0;
+}
+
+static const struct script {
+  const char *name;
+  script_t run;
+} scripts[] = {
+  { "markers", markers },
+  { "spi", spi },
+  { "twi", twi },
+  { "max6675", max6675 },
+  { "usart", usart },
+  { "collide", collide },
+  { "fail", fail },
+};
+
+int elf_read_firmware(const char *file, elf_firmware_t *firmware)
+{
+  const char *name = strrchr(file, '/') ? strrchr(file, '/') + 1 : file;
+  unsigned i;
+
+  for (i = 0; i < sizeof(scripts) / sizeof(scripts[0]); i++) {
+    if (!strcmp(scripts[i].name, name)) {
+      firmware->script = (void *)&scripts[i];
+      return 0;
+    }
+  }
+  return -1;
+}
+
+void avr_load_firmware(avr_t *avr, elf_firmware_t *firmware)
+{
+  avr->frequency = firmware->frequency;
+  avr->script = firmware->script;
+}
+
+// Plays the whole script in one go and finishes like bench_done(). A
+// script whose checks failed stops short of BENCH_MARK_DONE instead, which
+// simbench reports as a sketch that did not finish.
+int avr_run(avr_t *avr)
+{
+  const struct script *script = (const struct script *)avr->script;
+
+  if (avr->state != cpu_Running)
+    return avr->state;
+  if (script->run(avr)) {
+    avr->state = cpu_Crashed;
+    return avr->state;
+  }
+  done(avr);
+  avr->state = cpu_Done;
+  return avr->state;
+}
@@ -0,0 +1,166 @@
+// Cycle benchmark for the bundled SPI library.
+// Run under bench/simbench; the harness answers every byte with a loopback
+// model on the hardware SPI pins and on USARTSPI's USART.
+
+#include <SPI.h>
+#include <SPIDevice.h>
+#include <USARTSPI.h>
+#include "bench.h"
+
+#define BENCH_CALLS 64
+
+uint8_t buf[32];
+uint8_t rxbuf[32];
+const uint8_t txbuf[32] = { 0x55 };
+uint8_t pattern[32];
+
+// The model answers each byte with the one sent before it, so whatever
+// comes back must be what went out, one byte late. A byte written to SPDR
+// too early is dropped (WCOL) and shows up as a gap in the sequence.
+bool transferStreamIntact(void) {
+  bool ok = true;
+  for (uint8_t n = 1; n <= sizeof(pattern); n++) {
+    SPI.transfer(0xEE);
+    SPI.transferStream<SPI_CLOCK_DIV2>(pattern, rxbuf, n);
+    ok = ok && rxbuf[0] == 0xEE;
+    for (uint8_t i = 1; i < n; i++) {
+      ok = ok && rxbuf[i] == pattern[i - 1];
+    }
+  }
+  return ok;
+}
+
+// The same checks for the polled bulk transfers.
+bool transferTxRxIntact(void) {
+  SPI.transfer(0xEE);
+  SPI.transfer(pattern, rxbuf, sizeof(pattern));
+  bool ok = rxbuf[0] == 0xEE;
+  for (uint8_t i = 1; i < sizeof(pattern); i++) {
+    ok = ok && rxbuf[i] == pattern[i - 1];
+  }
+  return ok;
+}
+
+bool writeIntact(void) {
+  SPI.write(pattern, sizeof(pattern));
+  return SPI.transfer(0xEE) == pattern[sizeof(pattern) - 1];
+}
+
+bool readIntact(void) {
+  SPI.transfer(0xEE);
+  SPI.read(rxbuf, sizeof(rxbuf), 0x5A);
+  bool ok = rxbuf[0] == 0xEE;
+  for (uint8_t i = 1; i < sizeof(rxbuf); i++) {
+    ok = ok && rxbuf[i] == 0x5A;
+  }
+  return ok;
+}
+
+// Most significant byte first: 0x123456 goes out as 12 34 56 and comes
+// back as EE 12 34.
+bool transfer24Intact(void) {
+  SPI.transfer(0xEE);
+  return SPI.transfer24(0x123456) == 0xEE1234;
+}
+
+bool transfer32Intact(void) {
+  SPI.transfer(0xEE);
+  return SPI.transfer32(0x12345678) == 0xEE123456;
+}
+
+// writeStream() returns nothing, so ask the model for the last byte it got.
+bool writeStreamIntact(void) {
+  bool ok = true;
+  for (uint8_t n = 1; n <= sizeof(pattern); n++) {
+    SPI.writeStream<SPI_CLOCK_DIV2>(pattern, n);
+    ok = ok && SPI.transfer(0xEE) == pattern[n - 1];
+  }
+  return ok;
+}
+
+SPISettings fast(8000000, MSBFIRST, SPI_MODE0);
+SPIDevice device(SS, fast);
+
+// The harness answers on USART0 on the Nano and USART1 on the Mega. Under
+// simavr the USART runs at UART frame timing, not MSPIM's, so these regions
+// show the CPU side of the bulk loop and check its data.
+#ifdef USARTSPI_USART1
+USARTSPIClass usart(USARTSPI_USART1);
+#else
+USARTSPIClass usart(USARTSPI_USART0);
+#endif
+
+// Two bytes in flight and every one back in order: each reply is the byte
+// sent before it.
+bool usartIntact(void) {
+  usart.transfer(0xEE);
+  usart.transfer(pattern, rxbuf, sizeof(pattern));
+  bool ok = rxbuf[0] == 0xEE;
+  for (uint8_t i = 1; i < sizeof(pattern); i++) {
+    ok = ok && rxbuf[i] == pattern[i - 1];
+  }
+  usart.write(pattern, sizeof(pattern));
+  return ok && usart.transfer(0xEE) == pattern[sizeof(pattern) - 1];
+}
+
+void setup() {
+  SPI.begin();
+  // F_CPU / 2, i.e. SPI_CLOCK_DIV2
+  SPI.beginTransaction(SPISettings(8000000, MSBFIRST, SPI_MODE0));
+
+  BENCH_RUN(BENCH_spi_transfer8, BENCH_CALLS, SPI.transfer(0xA5));
+  BENCH_RUN(BENCH_spi_transfer16, BENCH_CALLS, SPI.transfer16(0xA55A));
+  BENCH_RUN(BENCH_spi_transfer_buf32, BENCH_CALLS, SPI.transfer(buf, sizeof(buf)));
+  BENCH_RUN(BENCH_spi_transfer_txrx_buf32, BENCH_CALLS, SPI.transfer(txbuf, rxbuf, sizeof(rxbuf)));
+  BENCH_RUN(BENCH_spi_write_buf32, BENCH_CALLS, SPI.write(txbuf, sizeof(txbuf)));
+  BENCH_RUN(BENCH_spi_read_buf32, BENCH_CALLS, SPI.read(rxbuf, sizeof(rxbuf)));
+  BENCH_RUN(BENCH_spi_transfer24, BENCH_CALLS, SPI.transfer24(0xA55AA5));
+  BENCH_RUN(BENCH_spi_transfer32, BENCH_CALLS, SPI.transfer32(0xA55AA55A));
+  // Against spi_write_buf32 and spi_transfer_txrx_buf32
+  BENCH_RUN(BENCH_spi_writeStream_buf32, BENCH_CALLS,
+            SPI.writeStream<SPI_CLOCK_DIV2>(txbuf, sizeof(txbuf)));
+  BENCH_RUN(BENCH_spi_transferStream_buf32, BENCH_CALLS,
+            SPI.transferStream<SPI_CLOCK_DIV2>(txbuf, rxbuf, sizeof(rxbuf)));
+  for (uint8_t i = 0; i < sizeof(pattern); i++) {
+    pattern[i] = i * 7 + 1;
+  }
+  BENCH_CHECK(BENCH_spi_transfer_txrx_buf32, transferTxRxIntact());
+  BENCH_CHECK(BENCH_spi_write_buf32, writeIntact());
+  BENCH_CHECK(BENCH_spi_read_buf32, readIntact());
+  BENCH_CHECK(BENCH_spi_transfer24, transfer24Intact());
+  BENCH_CHECK(BENCH_spi_transfer32, transfer32Intact());
+  BENCH_CHECK(BENCH_spi_writeStream_buf32, writeStreamIntact());
+  BENCH_CHECK(BENCH_spi_transferStream_buf32, transferStreamIntact());
+  // Start to finish, and the CPU time it takes to get one going.
+  BENCH_RUN(BENCH_spi_transferAsync_buf32, BENCH_CALLS,
+            SPI.transferAsync(buf, buf, sizeof(buf)); SPI.asyncFlush());
+  for (uint8_t i = 0; i < BENCH_CALLS; i++) {
+    BENCH_RUN(BENCH_spi_transferAsync_start32, 1, SPI.transferAsync(buf, buf, sizeof(buf)));
+    SPI.asyncFlush();
+  }
+
+  SPI.endTransaction();
+
+  // Per-transaction overhead: a device handle against the usual
+  // beginTransaction() plus digitalWrite() pair
+  device.begin();
+  BENCH_RUN(BENCH_spi_device_select, BENCH_CALLS, device.select(); device.deselect());
+  BENCH_RUN(BENCH_spi_digitalWrite_select, BENCH_CALLS,
+            SPI.beginTransaction(fast); digitalWrite(SS, LOW);
+            digitalWrite(SS, HIGH); SPI.endTransaction());
+  BENCH_RUN(BENCH_spi_device_readRegisters4, BENCH_CALLS, device.readRegisters(0x80, rxbuf, 4));
+
+  usart.begin();
+  usart.beginTransaction(SPISettings(4000000, MSBFIRST, SPI_MODE0));
+  BENCH_RUN(BENCH_usartspi_transfer8, BENCH_CALLS, usart.transfer(0xA5));
+  BENCH_RUN(BENCH_usartspi_transfer_buf32, BENCH_CALLS, usart.transfer(buf, sizeof(buf)));
+  BENCH_RUN(BENCH_usartspi_write_buf32, BENCH_CALLS, usart.write(txbuf, sizeof(txbuf)));
+  BENCH_CHECK(BENCH_usartspi_transfer_buf32, usartIntact());
+  usart.endTransaction();
+  usart.end();
+
+  bench_done();
+}
+
+void loop() {
+}
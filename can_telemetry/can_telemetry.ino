@@ -0,0 +1,123 @@
+// CAN telemetry bridge: the RTD shield and a MAX6675 thermocouple as CAN
+// signals, laid out in telemetry_layout.h. decode_telemetry.py turns a
+// candump of the bus back into temperatures.
+
+#include <Wire.h>
+#include <SPI.h>
+#include <PV_RTD_RS232_RS485_Shield.h>
+#include <max6675.h>
+#include <mcp2515.h>
+#include <cantelemetry.h>
+#include <bringup.h>
+#include <tasks.h>
+#include "telemetry_layout.h"
+
+// CAN-BUS Shield chip select
+const int SPI_CS_PIN = 9;
+
+// Thermocouple on the pins used by serialthermocouple.pde
+int thermoDO = 4;
+int thermoCS = 5;
+int thermoCLK = 6;
+
+// The RTD shield needs this long after configuration before its first
+// reading is valid, and takes about this long for each new one at 16 SPS.
+const unsigned long RTD_SETTLE_MS = 2500;
+// A fresh conversion at every read, with room for jitter
+const unsigned long THERMOCOUPLE_MS = MAX6675_CONVERSION_MS + 10;
+
+PV_RTD_RS232_RS485 my_rtds( 82, 100.0 );
+MAX6675 thermocouple(thermoCLK, thermoCS, thermoDO);
+MCP2515 CAN(SPI_CS_PIN);
+CANTxScheduler scheduler(CAN);
+TaskScheduler tasks;
+
+#define CAN_MESSAGE(name, id, period) { id, period },
+can_tx_entry messages[] = { TELEMETRY_MESSAGES };
+#undef CAN_MESSAGE
+
+#define CAN_SIGNAL(name, message, start, length, isSigned, scale, offset, deadband, unit) \
+  { MSG_##message, start, length, isSigned, scale, offset, deadband },
+const can_signal signals[] = { TELEMETRY_SIGNALS };
+#undef CAN_SIGNAL
+
+can_signal_state signalState[SIG_COUNT];
+CANTelemetry telemetry(scheduler, signals, signalState, SIG_COUNT);
+
+void configureRtd(PV_RTD_RS232_RS485 &rtds) {
+  rtds.Disable_All_RTD_Channels();
+  rtds.Enable_RTD_Channel( 3, 1 );
+  rtds.Set_RTD_SPS(16);
+  rtds.Set_RTD_Idac( 3, 1, 0.000250 );
+  rtds.Set_RTD_PGA( 3, 1, 32 );
+}
+
+bool canStep(const bringup_entry *e) { return CAN.beginStep(CAN_500KBPS); }
+bool rtdStep(const bringup_entry *e) { return my_rtds.Begin_Step(); }
+bool thermocoupleStep(const bringup_entry *e) { return thermocouple.beginStep(); }
+
+// All three start together, so the board is up once the RTD shield has
+// settled rather than after every device in turn.
+enum { DEV_CAN, DEV_RTD, DEV_THERMOCOUPLE };
+bringup_entry devices[] = {
+  { "CAN", canStep, 1000 },
+  { "RTD", rtdStep, RTD_SETTLE_MS + 1000 },
+  { "thermocouple", thermocoupleStep },
+};
+BringUp bringUp(devices, sizeof(devices) / sizeof(devices[0]));
+
+void readRtd(task_entry *task) {
+  telemetry.set(SIG_rtd_temp, my_rtds.Get_RTD_Temperature_degC( 3, 1 ));
+  telemetry.setRaw(SIG_rtd_valid, 1);
+}
+
+void readThermocouple(task_entry *task) {
+  int16_t quarters = thermocouple.readRaw();
+  if (quarters != MAX6675_INVALID) {
+    telemetry.setRaw(SIG_tc_temp, quarters);
+  }
+  telemetry.setRaw(SIG_tc_status, thermocouple.status());
+}
+
+task_entry rtdTask = { readRtd };
+task_entry thermocoupleTask = { readThermocouple };
+
+void startDevices(task_entry *task) {
+  if (!bringUp.poll()) {
+    return;
+  }
+  tasks.cancel(*task);
+  bringUp.report(Serial);
+  Serial.print("up after ");
+  Serial.print(bringUp.bootTime());
+  Serial.println(" ms");
+
+  // Nowhere to send the readings without CAN. A shield that didn't come
+  // up is reported through rtd_valid staying 0.
+  if (!bringUp.ready(DEV_CAN)) {
+    return;
+  }
+  scheduler.begin(messages, MSG_COUNT);
+  if (bringUp.ready(DEV_RTD)) {
+    tasks.every(rtdTask, RTD_SETTLE_MS);
+  }
+  tasks.every(thermocoupleTask, THERMOCOUPLE_MS);
+}
+
+task_entry startTask = { startDevices };
+
+void setup() {
+  Serial.begin(115200);
+
+  I2C_RTD_PORTNAME.begin();
+  my_rtds.Begin(false, configureRtd, RTD_SETTLE_MS);
+  thermocouple.beginStep();
+  telemetry.attach(messages, MSG_COUNT);
+  tasks.everyMicros(startTask, 100);
+}
+
+void loop() {
+  tasks.poll();
+  // The CAN messages keep their own schedule, to the microsecond
+  scheduler.poll();
+}
@@ -0,0 +1,117 @@
+#!/usr/bin/env python3
+"""Decode CAN telemetry frames back into engineering values.
+
+Reads the signal layout from telemetry_layout.h and a candump capture,
+either a log file (candump -l, or candump -L) or candump's screen output
+with or without timestamps, and writes CSV: time,message,signal,value,unit.
+
+    candump -L can0 | ./decode_telemetry.py
+    ./decode_telemetry.py candump-2020-01-01_120000.log > temps.csv
+"""
+
+import argparse
+import csv
+import os
+import re
+import sys
+
+LAYOUT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "telemetry_layout.h")
+
+MESSAGE_RE = re.compile(r"^\s*CAN_MESSAGE\(\s*(\w+)\s*,\s*([^,]+?)\s*,\s*(\d+)\s*\)")
+SIGNAL_RE = re.compile(r"^\s*CAN_SIGNAL\((.*)\)")
+
+# (1612345678.123456) can0 510#0A0B0C
+LOG_RE = re.compile(r"^\((\d+\.\d+)\)\s+\S+\s+([0-9A-Fa-f]+)#(R|[0-9A-Fa-f]*)")
+# (1612345678.123456)  can0  510   [3]  0A 0B 0C, timestamp optional
+DUMP_RE = re.compile(r"^\s*(?:\((\d+\.\d+)\)\s+)?\S+\s+([0-9A-Fa-f]+)\s+\[(\d)\]\s*((?:[0-9A-Fa-f]{2}\s*)*)")
+
+
+def parse_id(text):
+    """0x510 or 0x18FEF100 | CAN_MSG_EXT -> (id, extended)"""
+    extended = "CAN_MSG_EXT" in text
+    return int(text.split("|")[0].strip(), 0), extended
+
+
+def load_layout(path):
+    """{(id, extended): (message name, [signals])} from the layout header"""
+    messages = {}
+    names = {}
+    with open(path) as f:
+        for line in f:
+            if line.lstrip().startswith("#"):
+                continue
+            m = MESSAGE_RE.match(line)
+            if m:
+                key = parse_id(m.group(2))
+                names[m.group(1)] = key
+                messages[key] = (m.group(1), [])
+                continue
+            m = SIGNAL_RE.match(line)
+            if m:
+                args = [a.strip() for a in m.group(1).split(",")]
+                name, message, start, length, signed, scale, offset = args[:7]
+                unit = args[8].strip('"') if len(args) > 8 else ""
+                messages[names[message]][1].append({
+                    "name": name,
+                    "start": int(start, 0),
+                    "length": int(length, 0),
+                    "signed": int(signed, 0) != 0,
+                    "scale": float(scale),
+                    "offset": float(offset),
+                    "unit": unit,
+                })
+    return messages
+
+
+def decode(signal, data):
+    raw = int.from_bytes(data.ljust(8, b"\0"), "little")
+    raw = (raw >> signal["start"]) & ((1 << signal["length"]) - 1)
+    if signal["signed"] and raw & (1 << (signal["length"] - 1)):
+        raw -= 1 << signal["length"]
+    return raw * signal["scale"] + signal["offset"]
+
+
+def parse_frame(line):
+    """(time or None, id, extended, data) or None if the line is no frame"""
+    m = LOG_RE.match(line)
+    if m:
+        text = m.group(3)
+        data = b"" if text == "R" else bytes.fromhex(text)
+        return float(m.group(1)), int(m.group(2), 16), len(m.group(2)) > 3, data
+    m = DUMP_RE.match(line)
+    if m:
+        data = bytes.fromhex(m.group(4).replace(" ", ""))[:int(m.group(3))]
+        time = float(m.group(1)) if m.group(1) else None
+        return time, int(m.group(2), 16), len(m.group(2)) > 3, data
+    return None
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("dump", nargs="?", type=argparse.FileType("r"), default=sys.stdin,
+                        help="candump output or log file, default stdin")
+    parser.add_argument("--layout", default=LAYOUT, help="signal layout header")
+    args = parser.parse_args()
+
+    messages = load_layout(args.layout)
+    out = csv.writer(sys.stdout)
+    out.writerow(["time", "message", "signal", "value", "unit"])
+    for line in args.dump:
+        frame = parse_frame(line)
+        if not frame:
+            continue
+        time, can_id, extended, data = frame
+        message = messages.get((can_id, extended))
+        if not message:
+            continue
+        name, signals = message
+        for signal in signals:
+            if (signal["start"] + signal["length"] + 7) // 8 > len(data):
+                continue
+            value = decode(signal, data)
+            out.writerow(["" if time is None else "%.6f" % time, name, signal["name"],
+                          "%g" % value, signal["unit"]])
+
+
+if __name__ == "__main__":
+    main()
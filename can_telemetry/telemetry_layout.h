@@ -0,0 +1,32 @@
+// CAN signal layout of the telemetry bridge.
+//
+// Read by can_telemetry.ino and by decode_telemetry.py, which parses the
+// CAN_MESSAGE and CAN_SIGNAL lines below, so keep one entry per line with
+// plain numbers. Signals are Intel (little endian), physical value is
+// raw * scale + offset.
+
+#ifndef _TELEMETRY_LAYOUT_H_INCLUDED
+#define _TELEMETRY_LAYOUT_H_INCLUDED
+
+// CAN_MESSAGE(name, id, period in ms, 0 for on change only)
+#define TELEMETRY_MESSAGES \
+  CAN_MESSAGE(rtd, 0x510, 1000) \
+  CAN_MESSAGE(thermocouple, 0x511, 5000)
+
+// CAN_SIGNAL(name, message, start bit, length, signed, scale, offset, deadband, unit)
+// deadband: raw change that sends the message before its period is up.
+#define TELEMETRY_SIGNALS \
+  CAN_SIGNAL(rtd_temp, rtd, 0, 16, 1, 0.01, 0, 10, "degC") \
+  CAN_SIGNAL(rtd_valid, rtd, 16, 1, 0, 1, 0, 1, "") \
+  CAN_SIGNAL(tc_temp, thermocouple, 0, 14, 1, 0.25, 0, 4, "degC") \
+  CAN_SIGNAL(tc_status, thermocouple, 14, 2, 0, 1, 0, 1, "")
+
+#define CAN_MESSAGE(name, id, period) MSG_##name,
+enum { TELEMETRY_MESSAGES MSG_COUNT };
+#undef CAN_MESSAGE
+
+#define CAN_SIGNAL(name, message, start, length, isSigned, scale, offset, deadband, unit) SIG_##name,
+enum { TELEMETRY_SIGNALS SIG_COUNT };
+#undef CAN_SIGNAL
+
+#endif
@@ -0,0 +1,221 @@
+// Host stand-in for the Arduino core, backed by sim.cpp.
+
+#ifndef Arduino_h
+#define Arduino_h
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "sim.h"
+
+#ifndef ARDUINO
+#define ARDUINO 10810
+#endif
+#ifndef F_CPU
+#define F_CPU SIM_F_CPU
+#endif
+
+#define HIGH 0x1
+#define LOW  0x0
+
+#define INPUT 0x0
+#define OUTPUT 0x1
+#define INPUT_PULLUP 0x2
+
+#define LSBFIRST 0
+#define MSBFIRST 1
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+// attachInterrupt() modes
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+// Hardware SPI pins as on the Uno/Nano.
+static const uint8_t SS   = 10;
+static const uint8_t MOSI = 11;
+static const uint8_t MISO = 12;
+static const uint8_t SCK  = 13;
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int digitalRead(uint8_t pin);
+
+// Port registers, see sim.h.
+#define NOT_A_PORT 0
+#define digitalPinToPort(p) ((p) < SIM_PINS ? (p) / 8 + 1 : NOT_A_PORT)
+#define digitalPinToBitMask(p) ((uint8_t)(1 << ((p) % 8)))
+#define portOutputRegister(P) sim_port_output(P)
+#define portInputRegister(P) sim_port_input(P)
+#define portModeRegister(P) sim_port_mode(P)
+
+// External interrupts 0 and 1 on D2 and D3, as on the Uno/Nano.
+// attachInterrupt() sets their bit in EIMSK, and a handler only runs while
+// it is set.
+#define NOT_AN_INTERRUPT -1
+#define digitalPinToInterrupt(p) ((p) == 2 ? 0 : ((p) == 3 ? 1 : NOT_AN_INTERRUPT))
+void attachInterrupt(uint8_t interruptNum, void (*handler)(void), int mode);
+void detachInterrupt(uint8_t interruptNum);
+extern volatile uint8_t EIMSK;
+#define EIMSK EIMSK
+#define INT0 0
+#define INT1 1
+
+unsigned long millis(void);
+unsigned long micros(void);
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+// Bit 7 is the global interrupt enable, as on the AVR. Handlers run when
+// time next advances with it set, see sim.h. Reading SREG takes a cycle,
+// so code spinning on a flag that a handler clears sees the handler run.
+struct SimStatusRegister {
+  uint8_t bits;
+  void operator=(uint8_t v) volatile { bits = v; }
+  void operator&=(uint8_t v) volatile { bits &= v; }
+  void operator|=(uint8_t v) volatile { bits |= v; }
+  operator uint8_t() const volatile;
+};
+extern volatile SimStatusRegister SREG;
+#define SREG_I 7
+#define cli() (SREG &= (uint8_t)~0x80)
+#define sei() (SREG |= 0x80)
+#define noInterrupts() cli()
+#define interrupts() sei()
+
+#define _BV(bit) (1 << (bit))
+
+// Timer1, counting in CTC mode only (WGM12). A compare match runs the
+// sketch's ISR(TIMER1_COMPA_vect) like the external interrupts above.
+// Interrupt flags: writing a one clears the flag, as on the AVR.
+struct SimFlagRegister {
+  uint8_t flags;
+  void operator=(uint8_t v) volatile { flags &= ~v; }
+  operator uint8_t() const volatile { return flags; }
+};
+extern volatile uint8_t TCCR1A, TCCR1B, TIMSK1;
+extern volatile SimFlagRegister TIFR1;
+extern volatile uint16_t TCNT1, OCR1A;
+#define CS10 0
+#define CS11 1
+#define CS12 2
+#define WGM12 3
+#define OCF1A 1
+#define OCIE1A 1
+#define ISR(vector, ...) \
+  extern "C" void vector(void) __VA_ARGS__; \
+  extern "C" void vector(void)
+
+// Pin change interrupt 0 on D8..D13, port B as on the Uno/Nano. A change on
+// a pin set in PCMSK0 sets PCIF0, and ISR(PCINT0_vect) runs while PCIE0 is
+// set in PCICR. Only changes models report with sim_input_changed() count.
+extern volatile uint8_t PCICR, PCMSK0;
+extern volatile SimFlagRegister PCIFR;
+#define PCIE0 0
+#define PCIF0 0
+#define PCINT0_vect PCINT0_vect
+#define digitalPinToPCICR(p) ((p) >= 8 && (p) <= 13 ? &PCICR : (volatile uint8_t *)0)
+#define digitalPinToPCICRbit(p) 0
+#define digitalPinToPCMSK(p) ((p) >= 8 && (p) <= 13 ? &PCMSK0 : (volatile uint8_t *)0)
+#define digitalPinToPCMSKbit(p) ((p) - 8)
+
+// The SPI peripheral. SPDR and SPSR are macros, as on the AVR, so every
+// access is seen. In master mode a write to SPDR starts a byte, which is
+// handed to the models eight SCK periods later, setting SPIF; a write
+// before then sets WCOL and is dropped. Reading SPSR with SPIF set and then
+// accessing SPDR clears the flags, as does running ISR(SPI_STC_vect) when
+// SPIE is set. A low level on SS while it is an input clears MSTR and sets
+// SPIF, as another master would. With MSTR clear a master model clocks the
+// bytes with sim_spi_slave(), see sim.h. Bit order is not modelled: models
+// get the byte as written.
+#define SPIE 7
+#define SPE 6
+#define DORD 5
+#define MSTR 4
+#define CPOL 3
+#define CPHA 2
+#define SPR1 1
+#define SPR0 0
+#define SPIF 7
+#define WCOL 6
+#define SPI2X 0
+struct SimSPIStatus {
+  uint8_t flags;
+  void operator=(uint8_t v) volatile;
+  operator uint8_t() const volatile { return flags; }
+};
+struct SimSPIData {
+  void operator=(uint8_t v) volatile;
+  operator uint8_t() const volatile;
+};
+extern volatile uint8_t SPCR;
+extern volatile SimSPIStatus sim_spsr;
+extern volatile SimSPIData sim_spdr;
+void sim_spsr_access(void);
+void sim_spdr_access(void);
+#define SPSR (sim_spsr_access(), sim_spsr)
+#define SPDR (sim_spdr_access(), sim_spdr)
+
+// I/O address of a register for inline assembly. AVR assembly can't run
+// here; this only lets headers that contain some be parsed.
+#define _SFR_IO_ADDR(sfr) 0
+
+// The parts of the core's Print and Stream that libraries take a port as.
+class Print {
+ public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *buf, size_t size) {
+    size_t n = 0;
+    while (size-- && write(*buf++)) {
+      n++;
+    }
+    return n;
+  }
+  virtual int availableForWrite(void) { return 0; }
+
+  size_t print(const char *s) { return write((const uint8_t *)s, strlen(s)); }
+  size_t print(char c) { return write(c); }
+  size_t print(unsigned char n, int base = DEC) { return print((unsigned long)n, base); }
+  size_t print(int n, int base = DEC) { return print((long)n, base); }
+  size_t print(unsigned int n, int base = DEC) { return print((unsigned long)n, base); }
+  size_t print(long n, int base = DEC);
+  size_t print(unsigned long n, int base = DEC);
+  size_t print(double n, int digits = 2);
+
+  size_t println(void) { return print("\r\n"); }
+  template<typename T> size_t println(T value) { return print(value) + println(); }
+  template<typename T> size_t println(T value, int format) { return print(value, format) + println(); }
+};
+
+class Stream : public Print {
+ public:
+  virtual int available(void) = 0;
+  virtual int read(void) = 0;
+};
+
+// Serial writes to stdout and never has input.
+class SimSerial : public Stream {
+ public:
+  void begin(unsigned long baud) {}
+  operator bool() { return true; }
+
+  int available(void) { return 0; }
+  int read(void) { return -1; }
+  int availableForWrite(void) { return 63; }
+  using Print::write;
+  size_t write(uint8_t c);
+};
+
+extern SimSerial Serial;
+
+#endif
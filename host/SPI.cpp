@@ -0,0 +1,15 @@
+// Host stand-in for the SPI library, see SPI.h.
+
+#include <SPI.h>
+
+SPIClass SPI;
+
+uint8_t SPIClass::initialized = 0;
+uint8_t SPIClass::divider = 4;
+uint8_t SPIClass::bitOrder = MSBFIRST;
+uint8_t SPIClass::interruptMask = 0;
+
+uint8_t SPIClass::transfer(uint8_t data) {
+  sim_advance(8 * divider + SIM_SPI_BYTE_OVERHEAD_CYCLES);
+  return sim_spi_exchange(data);
+}
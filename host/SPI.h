@@ -0,0 +1,168 @@
+// Host stand-in for the SPI library: bytes go to the attached SimDevices
+// and cost eight SCK periods of simulated time each.
+
+#ifndef _SPI_H_INCLUDED
+#define _SPI_H_INCLUDED
+
+#include <Arduino.h>
+
+#define SPI_HAS_TRANSACTION 1
+#define SPI_HAS_TRANSFER_ASYNC 1
+
+#define SPI_CLOCK_DIV4 0x00
+#define SPI_CLOCK_DIV16 0x01
+#define SPI_CLOCK_DIV64 0x02
+#define SPI_CLOCK_DIV128 0x03
+#define SPI_CLOCK_DIV2 0x04
+#define SPI_CLOCK_DIV8 0x05
+#define SPI_CLOCK_DIV32 0x06
+
+#define SPI_MODE0 0x00
+#define SPI_MODE1 0x04
+#define SPI_MODE2 0x08
+#define SPI_MODE3 0x0C
+
+class SPISettings {
+public:
+  SPISettings(uint32_t clock, uint8_t bitOrder, uint8_t dataMode) {
+    init(clock, bitOrder, dataMode);
+  }
+  SPISettings() {
+    init(4000000, MSBFIRST, SPI_MODE0);
+  }
+private:
+  void init(uint32_t clock, uint8_t bitOrder, uint8_t dataMode) {
+    // Same rounding as the AVR version: fastest F_CPU/2^n <= clock.
+    divider = 2;
+    while (divider < 128 && clock < F_CPU / divider) {
+      divider *= 2;
+    }
+    this->bitOrder = bitOrder;
+    this->dataMode = dataMode;
+  }
+  uint8_t divider;
+  uint8_t bitOrder;
+  uint8_t dataMode;
+  friend class SPIClass;
+};
+
+typedef void (*SPIAsyncCallback)(void);
+
+class SPIClass {
+public:
+  static void begin() { initialized++; }
+  static void end() { if (initialized) initialized--; }
+
+  static void usingInterrupt(uint8_t interruptNumber) {
+    if (interruptNumber < 8) {
+      interruptMask |= 1 << interruptNumber;
+    }
+  }
+  static void notUsingInterrupt(uint8_t interruptNumber) {
+    if (interruptNumber < 8) {
+      interruptMask &= ~(1 << interruptNumber);
+    }
+  }
+
+  static void beginTransaction(SPISettings settings) {
+    sim_masked_interrupts = interruptMask;
+    divider = settings.divider;
+    bitOrder = settings.bitOrder;
+  }
+  // Interrupts held off by the transaction run as soon as it ends.
+  static void endTransaction(void) {
+    sim_masked_interrupts = 0;
+    sim_advance(0);
+  }
+
+  static uint8_t transfer(uint8_t data);
+  static uint16_t transfer16(uint16_t data) {
+    if (bitOrder == LSBFIRST) {
+      uint8_t lsb = transfer(data & 0xFF);
+      return lsb | (transfer(data >> 8) << 8);
+    }
+    uint8_t msb = transfer(data >> 8);
+    return (msb << 8) | transfer(data & 0xFF);
+  }
+  static uint32_t transfer24(uint32_t data) {
+    if (bitOrder == LSBFIRST) {
+      return transfer16(data & 0xFFFF) | ((uint32_t)transfer((data >> 16) & 0xFF) << 16);
+    }
+    uint32_t msb = transfer((data >> 16) & 0xFF);
+    return (msb << 16) | transfer16(data & 0xFFFF);
+  }
+  static uint32_t transfer32(uint32_t data) {
+    if (bitOrder == LSBFIRST) {
+      return transfer16(data & 0xFFFF) | ((uint32_t)transfer16(data >> 16) << 16);
+    }
+    uint32_t msw = transfer16(data >> 16);
+    return (msw << 16) | transfer16(data & 0xFFFF);
+  }
+  static void transfer(void *buf, size_t count) {
+    uint8_t *p = (uint8_t *)buf;
+    while (count--) {
+      *p = transfer(*p);
+      p++;
+    }
+  }
+  static void transfer(const void *txbuf, void *rxbuf, size_t count) {
+    const uint8_t *tx = (const uint8_t *)txbuf;
+    uint8_t *rx = (uint8_t *)rxbuf;
+    while (count--) {
+      *rx++ = transfer(*tx++);
+    }
+  }
+  static void write(const void *buf, size_t count) {
+    const uint8_t *p = (const uint8_t *)buf;
+    while (count--) {
+      transfer(*p++);
+    }
+  }
+  // The cycle-counted loops are AVR only, here they are the plain loops
+  template<uint8_t clockDiv>
+  static void writeStream(const void *buf, size_t count) {
+    write(buf, count);
+  }
+  template<uint8_t clockDiv>
+  static void transferStream(const void *txbuf, void *rxbuf, size_t count) {
+    transfer(txbuf, rxbuf, count);
+  }
+  static void read(void *buf, size_t count, uint8_t fill = 0xFF) {
+    uint8_t *p = (uint8_t *)buf;
+    while (count--) {
+      *p++ = transfer(fill);
+    }
+  }
+
+  // No interrupts on the host: the transfer completes before this returns.
+  static bool transferAsync(const void *tx, void *rx, size_t count,
+                            SPIAsyncCallback callback = NULL) {
+    const uint8_t *t = (const uint8_t *)tx;
+    uint8_t *r = (uint8_t *)rx;
+    while (count--) {
+      uint8_t in = transfer(t ? *t++ : 0xFF);
+      if (r) *r++ = in;
+    }
+    if (callback) callback();
+    return true;
+  }
+  static bool asyncDone(void) { return true; }
+  static void asyncFlush(void) {}
+
+  static void setBitOrder(uint8_t order) { bitOrder = order; }
+  static void setDataMode(uint8_t dataMode) {}
+  static void setClockDivider(uint8_t clockDiv) {
+    static const uint8_t div[] = { 4, 16, 64, 128, 2, 8, 32, 64 };
+    divider = div[clockDiv & 0x07];
+  }
+
+private:
+  static uint8_t initialized;
+  static uint8_t divider;
+  static uint8_t bitOrder;
+  static uint8_t interruptMask;
+};
+
+extern SPIClass SPI;
+
+#endif
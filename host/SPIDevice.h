@@ -0,0 +1,56 @@
+// Host stand-in for the SPI library's SPIDevice: chip select goes through
+// digitalWrite() so the device models see it.
+
+#ifndef _SPI_DEVICE_H_INCLUDED
+#define _SPI_DEVICE_H_INCLUDED
+
+#include <SPI.h>
+
+class SPIDevice {
+public:
+  SPIDevice(uint8_t csPin, SPISettings settings) : settings(settings), cs(csPin) {}
+
+  void begin(void) {
+    digitalWrite(cs, HIGH);
+    pinMode(cs, OUTPUT);
+    SPI.begin();
+  }
+
+  void select(void) {
+    SPI.beginTransaction(settings);
+    digitalWrite(cs, LOW);
+  }
+  void deselect(void) {
+    digitalWrite(cs, HIGH);
+    SPI.endTransaction();
+  }
+
+  void readRegisters(uint8_t command, void *buf, size_t count, uint8_t fill = 0x00) {
+    select();
+    SPI.transfer(command);
+    SPI.read(buf, count, fill);
+    deselect();
+  }
+  void writeRegisters(uint8_t command, const void *buf, size_t count) {
+    select();
+    SPI.transfer(command);
+    SPI.write(buf, count);
+    deselect();
+  }
+  uint8_t readRegister(uint8_t command) {
+    uint8_t value;
+    readRegisters(command, &value, 1);
+    return value;
+  }
+  void writeRegister(uint8_t command, uint8_t value) {
+    writeRegisters(command, &value, 1);
+  }
+
+  uint8_t pin(void) const { return cs; }
+
+private:
+  SPISettings settings;
+  uint8_t cs;
+};
+
+#endif
@@ -0,0 +1,493 @@
+// Simulated board for building the drivers on a Linux host.
+
+#include <stdio.h>
+#include <Arduino.h>
+
+#define SIM_MAX_DEVICES 16
+#define SIM_INTERRUPTS 2
+
+sim_stats sim_stat;
+volatile SimStatusRegister SREG = { 0x80 };
+volatile uint8_t EIMSK;
+uint8_t sim_masked_interrupts;
+
+static uint64_t cycles;
+static uint8_t levels[SIM_PINS];
+static uint8_t modes[SIM_PINS];
+static SimDevice *devices[SIM_MAX_DEVICES];
+static uint8_t ndevices;
+static volatile uint8_t portOut[SIM_PORTS];
+static volatile uint8_t portIn[SIM_PORTS];
+static volatile uint8_t portMode[SIM_PORTS];
+// Ports whose registers have been handed out, bit per port
+static uint16_t watchedOut, watchedIn;
+
+static struct {
+  void (*handler)(void);
+  int mode;
+  bool pending;
+} irqs[SIM_INTERRUPTS];
+static bool inInterrupt;
+
+volatile uint8_t TCCR1A, TCCR1B, TIMSK1;
+volatile SimFlagRegister TIFR1;
+volatile uint16_t TCNT1, OCR1A;
+static uint16_t timer1Residue; // CPU cycles towards the next timer tick
+
+// Sketches that don't use Timer1 have no handler for it.
+extern "C" void __attribute__((weak)) TIMER1_COMPA_vect(void) {}
+
+volatile uint8_t PCICR, PCMSK0;
+volatile SimFlagRegister PCIFR;
+// Only builds with SPISlave have a handler, NULL in the others.
+extern "C" void PCINT0_vect(void) __attribute__((weak));
+
+volatile uint8_t SPCR;
+volatile SimSPIStatus sim_spsr;
+volatile SimSPIData sim_spdr;
+static bool spiBusy;      // A byte is shifting
+static uint64_t spiDone;  // Cycle it completes at
+static uint8_t spiOut;    // Byte being sent
+static uint8_t spiIn;     // Last byte received, what SPDR reads
+static bool spiArmed;     // SPSR was read with SPIF set
+// Only builds of the SPI library itself have a handler. Weak, so it is
+// NULL in the others; the library's own definition is weak as well.
+extern "C" void SPI_STC_vect(void) __attribute__((weak));
+
+void sim_reset(void) {
+  cycles = 0;
+  memset(levels, 0, sizeof(levels));
+  memset(modes, 0, sizeof(modes));
+  memset(&sim_stat, 0, sizeof(sim_stat));
+  ndevices = 0;
+  memset((void *)portOut, 0, sizeof(portOut));
+  memset((void *)portIn, 0, sizeof(portIn));
+  memset((void *)portMode, 0, sizeof(portMode));
+  watchedOut = watchedIn = 0;
+  memset(irqs, 0, sizeof(irqs));
+  EIMSK = 0;
+  TCCR1A = TCCR1B = TIMSK1 = 0;
+  TIFR1.flags = 0;
+  TCNT1 = OCR1A = 0;
+  timer1Residue = 0;
+  PCICR = PCMSK0 = 0;
+  PCIFR.flags = 0;
+  SPCR = 0;
+  sim_spsr.flags = 0;
+  spiBusy = spiArmed = false;
+  spiOut = spiIn = 0;
+  SREG = 0x80;
+  sim_masked_interrupts = 0;
+}
+
+void sim_attach(SimDevice *device) {
+  if (ndevices < SIM_MAX_DEVICES) {
+    devices[ndevices++] = device;
+  }
+}
+
+uint64_t sim_cycles(void) {
+  return cycles;
+}
+
+uint64_t sim_ns(void) {
+  return cycles * 1000000000ULL / SIM_F_CPU;
+}
+
+static void run(void (*handler)(void)) {
+  sim_stat.interrupts++;
+  // The AVR clears the I bit on entry and RETI sets it again
+  inInterrupt = true;
+  uint8_t oldSREG = SREG.bits;
+  SREG.bits &= ~0x80;
+  handler();
+  SREG.bits = oldSREG;
+  inInterrupt = false;
+}
+
+// Run pending interrupt handlers the sketch isn't holding off, in the
+// AVR's vector order.
+static void dispatch(void) {
+  if (inInterrupt) {
+    return;
+  }
+  for (uint8_t i = 0; i < SIM_INTERRUPTS; i++) {
+    if (!irqs[i].pending || !irqs[i].handler || !(SREG.bits & 0x80) ||
+        !(EIMSK & (1 << i)) || (sim_masked_interrupts & (1 << i))) {
+      continue;
+    }
+    irqs[i].pending = false;
+    run(irqs[i].handler);
+  }
+  if ((PCIFR & _BV(PCIF0)) && (PCICR & _BV(PCIE0)) && (SREG.bits & 0x80) &&
+      PCINT0_vect) {
+    PCIFR.flags &= ~_BV(PCIF0);
+    run(PCINT0_vect);
+  }
+  if ((TIFR1 & _BV(OCF1A)) && (TIMSK1 & _BV(OCIE1A)) && (SREG.bits & 0x80)) {
+    TIFR1.flags &= ~_BV(OCF1A);
+    run(TIMER1_COMPA_vect);
+  }
+  if ((sim_spsr.flags & _BV(SPIF)) && (SPCR & _BV(SPIE)) && (SREG.bits & 0x80) &&
+      SPI_STC_vect) {
+    sim_spsr.flags &= ~_BV(SPIF);
+    run(SPI_STC_vect);
+  }
+}
+
+// CPU cycles per Timer1 tick, or 0 when it is stopped.
+static uint16_t timer1Divider(void) {
+  static const uint16_t prescale[8] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+  return TCCR1B & _BV(WGM12) ? prescale[TCCR1B & 7] : 0;
+}
+
+// CPU cycles until the next compare match, or 0 when there is none coming.
+static uint64_t timer1Due(void) {
+  uint16_t div = timer1Divider();
+  if (!div) {
+    return 0;
+  }
+  // Counts 0..OCR1A, matching as it goes back to 0
+  uint32_t period = (uint32_t)OCR1A + 1;
+  return (uint64_t)(period - TCNT1 % period) * div - timer1Residue;
+}
+
+// Count Timer1 on by n CPU cycles, flagging compare matches.
+static void timer1(uint64_t n) {
+  uint16_t div = timer1Divider();
+  if (!div) {
+    return;
+  }
+  uint64_t ticks = (timer1Residue + n) / div;
+  timer1Residue = (timer1Residue + n) % div;
+  uint32_t period = (uint32_t)OCR1A + 1;
+  uint32_t left = period - TCNT1 % period;
+  if (ticks >= left) {
+    TIFR1.flags |= _BV(OCF1A);
+    ticks = (ticks - left) % period;
+    TCNT1 = 0;
+  }
+  TCNT1 += ticks;
+}
+
+// Drive an output pin and tell the models if its level changed.
+static void output(uint8_t pin, uint8_t val) {
+  uint8_t port = digitalPinToPort(pin);
+  uint8_t mask = digitalPinToBitMask(pin);
+
+  if (val) {
+    portOut[port] |= mask;
+  } else {
+    portOut[port] &= ~mask;
+  }
+  if (levels[pin] == val) {
+    return;
+  }
+  levels[pin] = val;
+  if (modes[pin] == OUTPUT) {
+    for (uint8_t i = 0; i < ndevices; i++) {
+      devices[i]->pinChanged(pin, val);
+    }
+  }
+}
+
+// Level the sketch would read on pin.
+static uint8_t input(uint8_t pin) {
+  if (modes[pin] != OUTPUT) {
+    for (uint8_t i = 0; i < ndevices; i++) {
+      int8_t level = devices[i]->pinLevel(pin);
+      if (level >= 0) {
+        return level;
+      }
+    }
+    // Nothing drives the pin: an undriven input floats high.
+    return HIGH;
+  }
+  return levels[pin];
+}
+
+// Hand PORT register writes made since the last advance to the models.
+static void syncOutputs(void) {
+  for (uint8_t pin = 0; pin < SIM_PINS; pin++) {
+    uint8_t port = digitalPinToPort(pin);
+    if ((watchedOut & (1 << port)) && modes[pin] == OUTPUT) {
+      output(pin, portOut[port] & digitalPinToBitMask(pin) ? HIGH : LOW);
+    }
+  }
+}
+
+static void syncInputs(void) {
+  for (uint8_t pin = 0; pin < SIM_PINS; pin++) {
+    uint8_t port = digitalPinToPort(pin);
+    uint8_t mask = digitalPinToBitMask(pin);
+    if (!(watchedIn & (1 << port))) {
+      continue;
+    }
+    if (input(pin)) {
+      portIn[port] |= mask;
+    } else {
+      portIn[port] &= ~mask;
+    }
+  }
+}
+
+// CPU cycles per SCK period.
+static uint16_t spiDivider(void) {
+  static const uint8_t div[4] = { 4, 16, 64, 128 };
+  return div[SPCR & 3] >> (sim_spsr.flags & _BV(SPI2X));
+}
+
+// Finish the byte in flight once its eight SCK periods are up.
+static void spi(void) {
+  if (!spiBusy || cycles < spiDone) {
+    return;
+  }
+  spiBusy = false;
+  spiIn = sim_spi_exchange(spiOut);
+  sim_spsr.flags |= _BV(SPIF);
+}
+
+// SS as a low input in master mode is another master taking the bus: the
+// peripheral drops to slave mode, abandons the byte in flight and sets SPIF.
+static void modeFault(void) {
+  if ((SPCR & (_BV(SPE) | _BV(MSTR))) != (_BV(SPE) | _BV(MSTR)) ||
+      modes[SS] == OUTPUT || input(SS)) {
+    return;
+  }
+  SPCR &= ~_BV(MSTR);
+  spiBusy = false;
+  sim_spsr.flags |= _BV(SPIF);
+}
+
+static void step(uint64_t n) {
+  syncOutputs();
+  cycles += n;
+  timer1(n);
+  spi();
+  for (uint8_t i = 0; i < ndevices; i++) {
+    devices[i]->advance();
+  }
+  syncInputs();
+  modeFault();
+  dispatch();
+}
+
+void sim_advance(uint64_t n) {
+  // Stop at every Timer1 match and SPI byte on the way, so their handlers
+  // run on time rather than at the end of a long delay().
+  do {
+    uint64_t due = timer1Due();
+    if (spiBusy && (!due || spiDone - cycles < due)) {
+      due = spiDone - cycles;
+    }
+    uint64_t s = due && due < n ? due : n;
+    step(s);
+    n -= s;
+  } while (n);
+}
+
+volatile uint8_t *sim_port_output(uint8_t port) {
+  watchedOut |= 1 << port;
+  return &portOut[port];
+}
+
+volatile uint8_t *sim_port_input(uint8_t port) {
+  watchedIn |= 1 << port;
+  syncInputs();
+  return &portIn[port];
+}
+
+volatile uint8_t *sim_port_mode(uint8_t port) {
+  return &portMode[port];
+}
+
+uint8_t sim_spi_exchange(uint8_t mosi) {
+  int16_t in = -1;
+
+  sim_stat.spiBytes++;
+  for (uint8_t i = 0; i < ndevices; i++) {
+    int16_t r = devices[i]->spiTransfer(mosi);
+    if (r >= 0 && in < 0) {
+      in = r;
+    }
+  }
+  // MISO floats high with nothing selected.
+  return in < 0 ? 0xFF : in;
+}
+
+uint8_t sim_spi_slave(uint8_t mosi) {
+  if ((SPCR & (_BV(SPE) | _BV(MSTR))) != _BV(SPE) || input(SS)) {
+    return 0xFF;
+  }
+  // SPDR and the shift register are one: unless the handler writes SPDR
+  // again, the byte just received goes out next
+  uint8_t miso = spiOut;
+  spiOut = spiIn = mosi;
+  sim_stat.spiBytes++;
+  sim_spsr.flags |= _BV(SPIF);
+  return miso;
+}
+
+// SPI peripheral registers
+
+void sim_spsr_access(void) {
+  sim_advance(SIM_SPSR_POLL_CYCLES);
+  spiArmed = sim_spsr.flags & (_BV(SPIF) | _BV(WCOL));
+}
+
+void sim_spdr_access(void) {
+  sim_advance(SIM_SPDR_CYCLES);
+  if (spiArmed) {
+    sim_spsr.flags &= ~(_BV(SPIF) | _BV(WCOL));
+    spiArmed = false;
+  }
+}
+
+// Only SPI2X can be written.
+void SimSPIStatus::operator=(uint8_t v) volatile {
+  flags = (flags & ~_BV(SPI2X)) | (v & _BV(SPI2X));
+}
+
+void SimSPIData::operator=(uint8_t v) volatile {
+  if (spiBusy) {
+    sim_spsr.flags |= _BV(WCOL);
+    return;
+  }
+  spiOut = v;
+  if ((SPCR & (_BV(SPE) | _BV(MSTR))) == (_BV(SPE) | _BV(MSTR))) {
+    spiBusy = true;
+    spiDone = cycles + 8 * spiDivider();
+  }
+}
+
+SimSPIData::operator uint8_t() const volatile {
+  return spiIn;
+}
+
+SimStatusRegister::operator uint8_t() const volatile {
+  sim_advance(1);
+  return bits;
+}
+
+void sim_input_changed(uint8_t pin, uint8_t level) {
+  if (digitalPinToPCMSK(pin) && (PCMSK0 & _BV(digitalPinToPCMSKbit(pin)))) {
+    PCIFR.flags |= _BV(PCIF0);
+  }
+  int8_t n = digitalPinToInterrupt(pin);
+  if (n < 0 || !irqs[n].handler) {
+    return;
+  }
+  int mode = irqs[n].mode;
+  if (mode == CHANGE || (mode == FALLING && !level) || (mode == RISING && level)) {
+    irqs[n].pending = true;
+  }
+}
+
+uint8_t sim_output(uint8_t pin) {
+  return pin < SIM_PINS ? levels[pin] : LOW;
+}
+
+// Arduino core
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  sim_advance(SIM_PINMODE_CYCLES);
+  if (pin >= SIM_PINS) {
+    return;
+  }
+  modes[pin] = mode;
+  if (mode == OUTPUT) {
+    portMode[digitalPinToPort(pin)] |= digitalPinToBitMask(pin);
+  } else {
+    portMode[digitalPinToPort(pin)] &= ~digitalPinToBitMask(pin);
+  }
+  if (mode == INPUT_PULLUP) {
+    output(pin, HIGH);
+  }
+}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+  sim_advance(SIM_DIGITALWRITE_CYCLES);
+  sim_stat.digitalWrites++;
+  if (pin >= SIM_PINS) {
+    return;
+  }
+  output(pin, val ? HIGH : LOW);
+}
+
+int digitalRead(uint8_t pin) {
+  sim_advance(SIM_DIGITALREAD_CYCLES);
+  sim_stat.digitalReads++;
+  if (pin >= SIM_PINS) {
+    return LOW;
+  }
+  return input(pin);
+}
+
+unsigned long millis(void) {
+  sim_advance(SIM_MILLIS_CYCLES);
+  return cycles / (SIM_F_CPU / 1000);
+}
+
+unsigned long micros(void) {
+  sim_advance(SIM_MILLIS_CYCLES);
+  return cycles / (SIM_F_CPU / 1000000);
+}
+
+void attachInterrupt(uint8_t interruptNum, void (*handler)(void), int mode) {
+  if (interruptNum < SIM_INTERRUPTS) {
+    irqs[interruptNum].handler = handler;
+    irqs[interruptNum].mode = mode;
+    irqs[interruptNum].pending = false;
+    EIMSK |= 1 << interruptNum;
+  }
+}
+
+void detachInterrupt(uint8_t interruptNum) {
+  if (interruptNum < SIM_INTERRUPTS) {
+    irqs[interruptNum].handler = NULL;
+    irqs[interruptNum].pending = false;
+    EIMSK &= ~(1 << interruptNum);
+  }
+}
+
+void delay(unsigned long ms) {
+  sim_advance((uint64_t)ms * (SIM_F_CPU / 1000));
+}
+
+void delayMicroseconds(unsigned int us) {
+  sim_advance((uint64_t)us * (SIM_F_CPU / 1000000));
+}
+
+// Serial
+
+SimSerial Serial;
+
+size_t SimSerial::write(uint8_t c) {
+  putchar(c);
+  return 1;
+}
+
+size_t Print::print(long n, int base) {
+  if (n < 0 && base == DEC) {
+    return write('-') + print((unsigned long)-n, base);
+  }
+  return print((unsigned long)n, base);
+}
+
+size_t Print::print(unsigned long n, int base) {
+  char buf[8 * sizeof(n) + 1];
+  char *p = &buf[sizeof(buf) - 1];
+  *p = 0;
+  do {
+    uint8_t digit = n % base;
+    *--p = digit < 10 ? '0' + digit : 'A' + digit - 10;
+    n /= base;
+  } while (n);
+  return print(p);
+}
+
+size_t Print::print(double n, int digits) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.*f", digits, n);
+  return print(buf);
+}
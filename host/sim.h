@@ -0,0 +1,98 @@
+// Simulated board for building the drivers on a Linux host.
+//
+// Time only moves when the code under test calls into the Arduino API: each
+// call advances a cycle counter by roughly what it costs on a 16 MHz AVR,
+// and delay()/_delay_ms() advance it by the requested time. Device models
+// derive from SimDevice and see every pin change, get asked for the level
+// of pins they drive, and answer SPI bytes while selected.
+
+#ifndef _SIM_H_INCLUDED
+#define _SIM_H_INCLUDED
+
+#include <stdint.h>
+
+#define SIM_F_CPU 16000000UL
+#define SIM_PINS 70
+
+// Approximate cost of the Arduino AVR core calls, in CPU cycles.
+#define SIM_PINMODE_CYCLES 60
+#define SIM_DIGITALWRITE_CYCLES 56
+#define SIM_DIGITALREAD_CYCLES 52
+#define SIM_MILLIS_CYCLES 20
+// SPDR write, SPIF poll and SPDR read around the 8 SCK periods of a byte.
+#define SIM_SPI_BYTE_OVERHEAD_CYCLES 4
+// The SPI peripheral, for the SPI library itself: an SPDR access, and a
+// trip round a loop polling SPSR (in, sbrs, rjmp).
+#define SIM_SPDR_CYCLES 1
+#define SIM_SPSR_POLL_CYCLES 3
+
+class SimDevice {
+ public:
+  virtual ~SimDevice() {}
+  // Called after the sketch changes an output pin.
+  virtual void pinChanged(uint8_t pin, uint8_t level) {}
+  // Level this device drives on pin, or -1 if it does not drive it.
+  virtual int8_t pinLevel(uint8_t pin) { return -1; }
+  // Called for every hardware SPI byte. Return the MISO byte, or -1 when the
+  // device is not selected.
+  virtual int16_t spiTransfer(uint8_t mosi) { return -1; }
+  // Called whenever simulated time has moved on.
+  virtual void advance(void) {}
+};
+
+// Reset time, pins and the device list.
+void sim_reset(void);
+void sim_attach(SimDevice *device);
+
+uint64_t sim_cycles(void);
+uint64_t sim_ns(void);
+void sim_advance(uint64_t cycles);
+
+// Level of pin as the sketch last wrote it.
+uint8_t sim_output(uint8_t pin);
+
+// A model changed the level it drives on pin. A handler attached to the pin
+// with a matching mode becomes pending, and runs the next time simulated
+// time advances with interrupts enabled in SREG and the interrupt not held
+// off by an SPI transaction. Handlers don't nest. A pin enabled in PCMSK0
+// sets PCIF0 the same way, on either edge.
+void sim_input_changed(uint8_t pin, uint8_t level);
+// Bit n holds off external interrupt n, set by SPI.beginTransaction() for
+// the interrupts passed to SPI.usingInterrupt().
+extern uint8_t sim_masked_interrupts;
+
+// Port registers, for drivers that resolve their pins once with
+// portOutputRegister() and friends instead of calling digitalWrite(). Pin p
+// is bit p % 8 of port p / 8 + 1; port 0 is NOT_A_PORT, as in the AVR core.
+// A write to a PORT register reaches the models when simulated time next
+// advances, and PIN registers are refreshed after every advance, so a
+// driver has to wait out the same setup times as on the AVR.
+#define SIM_PORTS (SIM_PINS / 8 + 2)
+volatile uint8_t *sim_port_output(uint8_t port);
+volatile uint8_t *sim_port_input(uint8_t port);
+// DDR registers follow pinMode(). Writing them doesn't change the pins.
+volatile uint8_t *sim_port_mode(uint8_t port);
+
+// Hand one hardware SPI byte to the models and return what the selected
+// one answers, 0xFF if none is. Used by both the stand-in SPI library in
+// SPI.h and the SPI peripheral in Arduino.h; the caller accounts the time.
+uint8_t sim_spi_exchange(uint8_t mosi);
+
+// A master model clocks one byte through the SPI peripheral in slave mode.
+// Returns the MISO byte, which is what was last written to SPDR, or the
+// byte received before it if SPDR wasn't written since. SPDR then reads
+// mosi and SPIF is set. With the peripheral not an enabled slave, or SS
+// not low, nothing is clocked and MISO floats high. The caller accounts
+// the time, which is when ISR(SPI_STC_vect) gets to run.
+uint8_t sim_spi_slave(uint8_t mosi);
+
+// Counters for throughput comparisons.
+struct sim_stats {
+  uint32_t digitalWrites;
+  uint32_t digitalReads;
+  uint32_t spiBytes;
+  uint32_t interrupts;
+};
+extern sim_stats sim_stat;
+
+#endif
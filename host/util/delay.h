@@ -0,0 +1,18 @@
+// Host stand-in for avr-libc's busy-wait delays.
+
+#ifndef _UTIL_DELAY_H_
+#define _UTIL_DELAY_H_
+
+#include "../sim.h"
+
+static inline void _delay_ms(double ms) {
+  sim_advance((uint64_t)(ms * (SIM_F_CPU / 1000)));
+}
+
+static inline void _delay_us(double us) {
+  // Like __builtin_avr_delay_cycles, round up to a whole cycle.
+  double cycles = us * (SIM_F_CPU / 1000000);
+  sim_advance((uint64_t)cycles + ((double)(uint64_t)cycles < cycles ? 1 : 0));
+}
+
+#endif
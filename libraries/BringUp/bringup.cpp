@@ -0,0 +1,64 @@
+// Start-up of several devices at once.
+
+#include "bringup.h"
+
+BringUp::BringUp(bringup_entry *table, uint8_t count)
+  : table(table), count(count), pending(count), failed(0), started(false),
+    start(0), finished(0) {
+  for (uint8_t i = 0; i < count; i++) {
+    table[i].state = BRINGUP_PENDING;
+    table[i].time = 0;
+  }
+}
+
+bool BringUp::poll(void) {
+  if (!pending) {
+    return true;
+  }
+  if (!started) {
+    started = true;
+    start = millis();
+  }
+
+  for (uint8_t i = 0; i < count; i++) {
+    bringup_entry &e = table[i];
+    if (e.state != BRINGUP_PENDING) {
+      continue;
+    }
+    bool up = e.step(&e);
+    // Time taken after the step, which may have been slow
+    unsigned long elapsed = millis() - start;
+    if (up) {
+      e.state = BRINGUP_READY;
+    } else if (e.timeout && elapsed >= e.timeout) {
+      e.state = BRINGUP_FAILED;
+      failed++;
+    } else {
+      continue;
+    }
+    e.time = elapsed;
+    if (!--pending) {
+      finished = elapsed;
+    }
+  }
+  return !pending;
+}
+
+void BringUp::report(Print &out) {
+  for (uint8_t i = 0; i < count; i++) {
+    out.print(table[i].name);
+    switch (table[i].state) {
+    case BRINGUP_READY:
+      out.print(" ready after ");
+      break;
+    case BRINGUP_FAILED:
+      out.print(" failed after ");
+      break;
+    default:
+      out.println(" pending");
+      continue;
+    }
+    out.print(table[i].time);
+    out.println(" ms");
+  }
+}
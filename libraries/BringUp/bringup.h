@@ -0,0 +1,73 @@
+// Start-up of several devices at once.
+//
+// Each entry of the table has a step function that moves one device's
+// start-up on by at most one non-blocking step and returns true once the
+// device is ready, usually a call to the driver's beginStep(). poll()
+// steps every device that isn't ready yet, so the waits for oscillators,
+// resets and first conversions all overlap and the board is up when the
+// slowest device is, not after the sum of them.
+//
+//   bool canStep(const bringup_entry *e) { return CAN.beginStep(CAN_500KBPS); }
+//   bool rtdStep(const bringup_entry *e) { return rtds.Begin_Step(); }
+//   bringup_entry devices[] = { { "CAN", canStep, 1000 }, { "RTD", rtdStep } };
+//   BringUp bringUp(devices, 2);
+//   // in loop()
+//   if (!bringUp.poll()) return;
+
+#ifndef _BRINGUP_H_INCLUDED
+#define _BRINGUP_H_INCLUDED
+
+#include <Arduino.h>
+
+struct bringup_entry;
+
+// Take the next start-up step and return true once the device is ready.
+typedef bool (*bringup_step)(const bringup_entry *entry);
+
+enum bringup_state {
+  BRINGUP_PENDING,
+  BRINGUP_READY,
+  BRINGUP_FAILED        // Not ready within its timeout
+};
+
+struct bringup_entry {
+  const char *name;
+  bringup_step step;
+  unsigned long timeout;  // ms from the first poll(), or 0 to keep trying
+  void *context;          // For the step function
+
+  // Kept by BringUp
+  unsigned long time;     // ms from the first poll() until ready or failed
+  uint8_t state;
+};
+
+class BringUp {
+ public:
+  BringUp(bringup_entry *table, uint8_t count);
+
+  // Step every pending device once. Returns true when none are left
+  // pending, whether or not they all came up.
+  bool poll(void);
+
+  bool done(void) { return pending == 0; }
+  // Every device came up
+  bool ok(void) { return pending == 0 && failed == 0; }
+  bool ready(uint8_t index) { return table[index].state == BRINGUP_READY; }
+
+  // ms from the first poll() until the last device came up or failed
+  unsigned long bootTime(void) { return finished; }
+
+  // Name, state and time of each device, one line each
+  void report(Print &out);
+
+ private:
+  bringup_entry *table;
+  uint8_t count;
+  uint8_t pending;
+  uint8_t failed;
+  bool started;
+  unsigned long start;
+  unsigned long finished;
+};
+
+#endif
@@ -0,0 +1,187 @@
+// Runs the task scheduler on the simulated board: periods, one-shots,
+// overruns, deadline order and load, then the Blink sketch. Exits
+// non-zero if any check fails.
+
+#include <stdio.h>
+#include <Arduino.h>
+#include "tasks.h"
+
+static int failures;
+
+#define CHECK(cond) \
+  do { \
+    if (!(cond)) { \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      failures++; \
+    } \
+  } while (0)
+
+// The sketch, built as its own translation unit
+void setup();
+void loop();
+
+// Calls poll() for ms, each pass of the loop costing a few us
+static void run(TaskScheduler &scheduler, unsigned long ms) {
+  unsigned long start = millis();
+  while (millis() - start < ms) {
+    scheduler.poll();
+    delayMicroseconds(20);
+  }
+}
+
+static void count(task_entry *t) {
+}
+
+// Busy for the number of us in its context
+static void busyTask(task_entry *t) {
+  delayMicroseconds(*(unsigned int *)t->context);
+}
+
+// A 10 ms task keeps to its schedule while a 7 ms one eats 3 ms of each
+// period: every deadline is met late but none is lost or moved.
+static void periodic(void) {
+  sim_reset();
+  TaskScheduler scheduler;
+  unsigned int cost = 3000;
+  task_entry tick = { count };
+  task_entry hog = { busyTask, &cost };
+
+  scheduler.every(tick, 10);
+  unsigned long first = tick.due;
+  scheduler.every(hog, 7, 1);
+  run(scheduler, 1000);
+  scheduler.cancel(hog);
+
+  printf("periodic: %lu runs, %lu overruns, latest %lu us, load %u permille\n",
+         tick.runs, tick.overruns, tick.maxLateness, scheduler.load());
+  CHECK(tick.runs == 100 || tick.runs == 101);
+  CHECK(tick.overruns == 0);
+  CHECK(tick.maxLateness > 0 && tick.maxLateness < 3200);
+  // Drift-free: the next deadline is a whole number of periods from the first
+  CHECK(tick.due - first == tick.runs * 10000UL);
+  CHECK(hog.maxRunTime >= 3000);
+  CHECK(scheduler.load() >= 400 && scheduler.load() <= 460);
+}
+
+// A task held up past two of its deadlines runs once for both and counts
+// the other as an overrun, rather than running twice back to back
+static void overrun(void) {
+  sim_reset();
+  TaskScheduler scheduler;
+  unsigned int cost = 12000;
+  task_entry tick = { count };
+  task_entry stall = { busyTask, &cost };
+
+  scheduler.every(tick, 5);
+  scheduler.after(stall, 20);
+  run(scheduler, 100);
+
+  printf("overrun: %lu runs, %lu overruns\n", tick.runs, tick.overruns);
+  CHECK(stall.runs == 1);
+  CHECK(!scheduler.scheduled(stall));
+  CHECK(tick.overruns == 1);
+  CHECK(tick.runs + tick.overruns == 20 || tick.runs + tick.overruns == 21);
+}
+
+static task_entry *order[4];
+static uint8_t ordered;
+
+static void record(task_entry *t) {
+  if (ordered < 4) {
+    order[ordered++] = t;
+  }
+}
+
+// Run three times, 30 ms apart, by starting itself again
+static void retrigger(task_entry *t) {
+  if (t->runs < 3) {
+    ((TaskScheduler *)t->context)->after(*t, 30);
+  }
+}
+
+static task_entry *victim;
+
+static void cancelVictim(task_entry *t) {
+  ((TaskScheduler *)t->context)->cancel(*victim);
+}
+
+// One-shots beyond the wheel, earliest deadline first, and cancelling a
+// task that is due in the same poll()
+static void oneShots(void) {
+  sim_reset();
+  TaskScheduler scheduler;
+  task_entry a = { record }, b = { record }, c = { record };
+  task_entry again = { retrigger, &scheduler };
+  task_entry canceller = { cancelVictim, &scheduler };
+
+  // Due in the same poll() after a long gap, in deadline order
+  ordered = 0;
+  scheduler.afterMicros(c, 300);
+  scheduler.afterMicros(a, 100);
+  scheduler.afterMicros(b, 200);
+  delay(5);
+  CHECK(scheduler.poll() == 3);
+  CHECK(ordered == 3 && order[0] == &a && order[1] == &b && order[2] == &c);
+
+  // A full turn of the wheel and more
+  unsigned long start = millis();
+  scheduler.after(a, 100);
+  run(scheduler, 99);
+  CHECK(a.runs == 1);
+  run(scheduler, 2);
+  CHECK(a.runs == 2);
+  CHECK(millis() - start >= 100);
+
+  scheduler.after(again, 0);
+  run(scheduler, 200);
+  CHECK(again.runs == 3);
+  CHECK(!scheduler.scheduled(again));
+
+  ordered = 0;
+  victim = &b;
+  scheduler.afterMicros(canceller, 100);
+  scheduler.afterMicros(b, 200);
+  delay(1);
+  CHECK(scheduler.poll() == 1);
+  CHECK(ordered == 0 && b.runs == 1);
+  CHECK(!scheduler.scheduled(b));
+}
+
+// Blink.ino: pin 13 changes every second on the second
+static void sketch(void) {
+  sim_reset();
+  setup();
+  unsigned long start = millis();
+  uint8_t level = digitalRead(13);
+  unsigned long changes = 0;
+  unsigned long worst = 0;
+  while (millis() - start < 10000) {
+    loop();
+    if (digitalRead(13) != level) {
+      level = !level;
+      changes++;
+      unsigned long off = (millis() - start) % 1000;
+      off = off > 500 ? 1000 - off : off;
+      if (off > worst) {
+        worst = off;
+      }
+    }
+  }
+  printf("Blink: %lu changes in 10 s, at most %lu ms off the second\n", changes, worst);
+  CHECK(changes == 10);
+  CHECK(worst <= 1);
+}
+
+int main(void) {
+  periodic();
+  overrun();
+  oneShots();
+  sketch();
+
+  if (failures) {
+    fprintf(stderr, "%d check(s) failed\n", failures);
+    return 1;
+  }
+  printf("all checks passed\n");
+  return 0;
+}
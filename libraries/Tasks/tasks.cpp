@@ -0,0 +1,139 @@
+// Cooperative deadline scheduler.
+
+#include "tasks.h"
+
+// tick counts TASK_TICK_US steps of micros(), so wraps with it
+#define TICK_MASK (~0UL >> TASK_TICK_SHIFT)
+#define SLOT_MASK (TASK_WHEEL_SLOTS - 1)
+
+enum {
+  TASK_IDLE,
+  TASK_WAITING,     // On the wheel
+  TASK_READY        // On the ready list of the poll() running now
+};
+
+TaskScheduler::TaskScheduler(void) : ready(NULL), tick(0) {
+  memset(wheel, 0, sizeof(wheel));
+  resetStats();
+}
+
+void TaskScheduler::everyMicros(task_entry &task, unsigned long periodUs, unsigned long delayUs) {
+  cancel(task);
+  task.period = periodUs;
+  task.due = micros() + delayUs;
+  insert(task);
+}
+
+void TaskScheduler::afterMicros(task_entry &task, unsigned long delayUs) {
+  everyMicros(task, 0, delayUs);
+}
+
+void TaskScheduler::cancel(task_entry &task) {
+  task_entry **p;
+  if (task.state == TASK_WAITING) {
+    p = &wheel[task.slot];
+  } else if (task.state == TASK_READY) {
+    p = &ready;
+  } else {
+    return;
+  }
+  while (*p != &task) {
+    p = &(*p)->next;
+  }
+  *p = task.next;
+  task.state = TASK_IDLE;
+}
+
+bool TaskScheduler::scheduled(const task_entry &task) {
+  return task.state != TASK_IDLE;
+}
+
+void TaskScheduler::insert(task_entry &task) {
+  // A deadline already behind the wheel goes in the slot the next poll()
+  // looks in first
+  unsigned long dueTick = task.due >> TASK_TICK_SHIFT;
+  if ((long)((dueTick - tick) << TASK_TICK_SHIFT) < 0) {
+    dueTick = tick;
+  }
+  task.slot = dueTick & SLOT_MASK;
+  task.next = wheel[task.slot];
+  wheel[task.slot] = &task;
+  task.state = TASK_WAITING;
+}
+
+uint8_t TaskScheduler::poll(void) {
+  unsigned long now = micros();
+  unsigned long nowTick = now >> TASK_TICK_SHIFT;
+
+  // The slots passed since the last call, all of them after a long gap.
+  // The last one again too: its later deadlines may have come since.
+  unsigned long ticks = (nowTick - tick) & TICK_MASK;
+  if (ticks >= TASK_WHEEL_SLOTS) {
+    ticks = TASK_WHEEL_SLOTS - 1;
+  }
+  for (uint8_t i = 0; i <= ticks; i++) {
+    task_entry **p = &wheel[(tick + i) & SLOT_MASK];
+    while (*p) {
+      task_entry *t = *p;
+      if ((long)(now - t->due) < 0) {
+        p = &t->next;
+        continue;
+      }
+      *p = t->next;
+      task_entry **r = &ready;
+      while (*r && (long)((*r)->due - t->due) <= 0) {
+        r = &(*r)->next;
+      }
+      t->next = *r;
+      *r = t;
+      t->state = TASK_READY;
+    }
+  }
+  tick = nowTick;
+
+  uint8_t n = 0;
+  while (ready) {
+    task_entry *t = ready;
+    ready = t->next;
+    t->state = TASK_IDLE;
+
+    unsigned long start = micros();
+    unsigned long late = start - t->due;
+    if (late > t->maxLateness) {
+      t->maxLateness = late;
+    }
+    // Back on the wheel before it runs, so that it can cancel or move
+    // itself
+    if (t->period) {
+      unsigned long skip = late / t->period;
+      t->overruns += skip;
+      t->due += (skip + 1) * t->period;
+      insert(*t);
+    }
+    t->runs++;
+    t->run(t);
+
+    unsigned long took = micros() - start;
+    if (took > t->maxRunTime) {
+      t->maxRunTime = took;
+    }
+    busy += took;
+    n++;
+  }
+  return n;
+}
+
+uint16_t TaskScheduler::load(void) {
+  unsigned long elapsed = millis() - statsSince;
+  if (!elapsed) {
+    return 0;
+  }
+  // us busy per ms elapsed
+  unsigned long permille = busy / elapsed;
+  return permille > 1000 ? 1000 : permille;
+}
+
+void TaskScheduler::resetStats(void) {
+  busy = 0;
+  statsSince = millis();
+}
@@ -0,0 +1,94 @@
+// Cooperative deadline scheduler.
+//
+// A task is a function that does a little work and returns. poll(),
+// called over and over from loop(), runs each one when its deadline comes
+// round, so loop() never sleeps in delay() and the time one device spends
+// waiting is free for the others. Tasks are periodic or run once, and can
+// be started, moved or cancelled at any time, from their own function too.
+//
+// Periodic deadlines advance by exactly one period from the previous
+// deadline, not from when the task got to run, so a late start only adds
+// jitter and never shifts the schedule. A task that falls a whole period
+// behind skips the periods it missed and counts them as overruns instead
+// of running back to back to catch up. When several tasks are due the
+// earliest deadline runs first.
+//
+// Waiting tasks hang off a wheel of TASK_WHEEL_SLOTS slots by deadline,
+// each slot TASK_TICK_US wide, and poll() only looks in the slots it has
+// passed since the last call. Deadlines are kept in micros(), which limits
+// periods and delays to half its range, about 35 minutes on the AVR.
+//
+//   void blink(task_entry *t) { digitalWrite(13, !digitalRead(13)); }
+//   task_entry led = { blink };
+//   scheduler.every(led, 1000);
+//   // in loop()
+//   scheduler.poll();
+
+#ifndef _TASKS_H_INCLUDED
+#define _TASKS_H_INCLUDED
+
+#include <Arduino.h>
+
+// Wheel size, a power of two
+#ifndef TASK_WHEEL_SLOTS
+#define TASK_WHEEL_SLOTS 16
+#endif
+#define TASK_TICK_SHIFT 10
+#define TASK_TICK_US (1UL << TASK_TICK_SHIFT)
+
+struct task_entry;
+
+typedef void (*task_function)(task_entry *task);
+
+struct task_entry {
+  task_function run;
+  void *context;              // For the task function
+
+  // Kept by TaskScheduler
+  unsigned long period;       // us, or 0 to run once
+  unsigned long due;          // micros() deadline of the next run
+  unsigned long runs;
+  unsigned long overruns;     // Periods skipped because the task started a whole period late
+  unsigned long maxLateness;  // Longest wait in us from deadline to start
+  unsigned long maxRunTime;   // Longest run in us
+  task_entry *next;
+  uint8_t state;
+  uint8_t slot;
+};
+
+class TaskScheduler {
+ public:
+  TaskScheduler(void);
+
+  // Run task every period, the first time after delay. Starting a task
+  // that is already scheduled moves it. The statistics carry on.
+  void every(task_entry &task, unsigned long periodMs, unsigned long delayMs = 0) {
+    everyMicros(task, periodMs * 1000, delayMs * 1000);
+  }
+  void everyMicros(task_entry &task, unsigned long periodUs, unsigned long delayUs = 0);
+  // Run task once, after delay
+  void after(task_entry &task, unsigned long delayMs) { afterMicros(task, delayMs * 1000); }
+  void afterMicros(task_entry &task, unsigned long delayUs);
+  void cancel(task_entry &task);
+  bool scheduled(const task_entry &task);
+
+  // Run the tasks that are due, earliest deadline first. Returns how many
+  // ran. Tasks started from a task function wait for the next call.
+  uint8_t poll(void);
+
+  // Per mille of the time since resetStats() spent in task functions,
+  // over up to an hour.
+  uint16_t load(void);
+  void resetStats(void);
+
+ private:
+  void insert(task_entry &task);
+
+  task_entry *wheel[TASK_WHEEL_SLOTS];
+  task_entry *ready;          // Due in this poll(), by deadline
+  unsigned long tick;         // Last slot poll() looked in, in TASK_TICK_US
+  unsigned long busy;         // us in task functions
+  unsigned long statsSince;   // millis()
+};
+
+#endif
@@ -0,0 +1,231 @@
+// Runs the MAX6675 driver against the device model on the host and reports
+// bus cost per read. Exits non-zero if any check fails.
+
+#include <stdio.h>
+#include <Arduino.h>
+#include "max6675.h"
+#include "max6675array.h"
+#include "max6675sampler.h"
+#include "max6675_model.h"
+
+static int failures;
+
+#define CHECK(cond) \
+  do { \
+    if (!(cond)) { \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      failures++; \
+    } \
+  } while (0)
+
+// Long enough for the driver to go back to the bus.
+#define WAIT_CONVERSION() delay(MAX6675_CONVERSION_MS + 1)
+
+// Simulated cycles spent in one readRaw() that goes to the bus.
+static uint64_t cycles_per_read(MAX6675 &tc) {
+  WAIT_CONVERSION();
+  uint64_t start = sim_cycles();
+  tc.readRaw();
+  return sim_cycles() - start;
+}
+
+static void bitbang(void) {
+  sim_reset();
+  MAX6675Model model(6, 5, 4);
+  sim_attach(&model);
+  MAX6675 tc(6, 5, 4);
+
+  // Before the first conversion completes the frame holds zero.
+  delay(500);
+  CHECK(tc.readRaw() == 0);
+  CHECK(tc.status() == MAX6675_OK);
+
+  model.setTemperature(401);
+  WAIT_CONVERSION();
+  CHECK(tc.readRaw() == 401);
+  CHECK(tc.readCentiCelsius() == 10025);
+  CHECK(tc.readCentiFahrenheit() == 21245);
+
+  // Back-to-back reads inside the conversion period stay off the bus.
+  uint32_t frames = model.frames;
+  tc.readCelsius();
+  tc.readFahrenheit();
+  CHECK(model.frames == frames);
+  CHECK(tc.age() < MAX6675_CONVERSION_MS);
+
+  model.setOpen(true);
+  WAIT_CONVERSION();
+  CHECK(tc.readRaw() == MAX6675_INVALID);
+  CHECK(tc.status() == MAX6675_OPEN);
+  CHECK(isnan(tc.readCelsius()));
+  model.setOpen(false);
+
+  uint64_t cycles = cycles_per_read(tc);
+  CHECK(model.aborted == 0);
+  CHECK(model.violations == 0);
+  printf("bitbang   readRaw: %8llu cycles %6.1f us  (%u conversions, %u aborted)\n",
+         (unsigned long long)cycles, cycles * 1e6 / SIM_F_CPU, model.conversions,
+         model.aborted);
+}
+
+static void hardware_spi(void) {
+  sim_reset();
+  MAX6675Model model(10);
+  sim_attach(&model);
+  MAX6675 tc(10);
+
+  model.setTemperature(1000);
+  WAIT_CONVERSION();
+  CHECK(tc.readRaw() == 1000);
+
+  uint64_t cycles = cycles_per_read(tc);
+  CHECK(model.aborted == 0);
+  printf("hw spi    readRaw: %8llu cycles %6.1f us\n",
+         (unsigned long long)cycles, cycles * 1e6 / SIM_F_CPU);
+}
+
+static void array(void) {
+  static const int8_t cs[] = { 5, 7, 8, 9 };
+  uint16_t frames[4];
+
+  sim_reset();
+  MAX6675Model m0(6, 5, 4), m1(6, 7, 4), m2(6, 8, 4);
+  sim_attach(&m0);
+  sim_attach(&m1);
+  sim_attach(&m2);
+  // Nothing answers on CS 9, so SO floats high there.
+  MAX6675Array tcs(6, 4, cs, 4);
+
+  m0.setTemperature(100);
+  m1.setTemperature(200);
+  m2.setTemperature(300);
+  WAIT_CONVERSION();
+
+  uint64_t start = sim_cycles();
+  CHECK(tcs.readAll(frames));
+  uint64_t cycles = sim_cycles() - start;
+  CHECK(!tcs.readAll(frames));
+
+  max6675_status status;
+  CHECK(MAX6675::decode(frames[0], &status) == 100 && status == MAX6675_OK);
+  CHECK(MAX6675::decode(frames[1], &status) == 200 && status == MAX6675_OK);
+  CHECK(MAX6675::decode(frames[2], &status) == 300 && status == MAX6675_OK);
+  MAX6675::decode(frames[3], &status);
+  CHECK(status == MAX6675_BUS_ERROR);
+
+  // Staggered polling reads each sensor once per conversion period.
+  uint32_t before = m0.frames + m1.frames + m2.frames;
+  unsigned long until = millis() + 10 * MAX6675_CONVERSION_MS;
+  while (millis() < until) {
+    tcs.poll(frames);
+    delay(1);
+  }
+  uint32_t polled = m0.frames + m1.frames + m2.frames - before;
+  CHECK(polled >= 27 && polled <= 33);
+
+  // A scan right after polling would cut short the conversions poll() just
+  // started; once the last of them is done it goes ahead.
+  CHECK(!tcs.readAll(frames));
+  WAIT_CONVERSION();
+  CHECK(tcs.readAll(frames));
+  CHECK(m0.aborted + m1.aborted + m2.aborted == 0);
+  CHECK(m0.violations + m1.violations + m2.violations == 0);
+  printf("array x4  readAll: %8llu cycles %6.1f us\n",
+         (unsigned long long)cycles, cycles * 1e6 / SIM_F_CPU);
+}
+
+// beginStep() holds off the first read until the power-up conversion is
+// done, instead of a fixed delay() in setup().
+static void startup(void) {
+  sim_reset();
+  MAX6675Model model(6, 5, 4);
+  sim_attach(&model);
+  model.setTemperature(401);
+  MAX6675 tc(6, 5, 4);
+
+  unsigned long start = millis();
+  CHECK(!tc.ready());
+  while (!tc.beginStep()) {
+    delay(1);
+  }
+  unsigned long took = millis() - start;
+  CHECK(took > MAX6675_CONVERSION_MS && took <= MAX6675_CONVERSION_MS + 2);
+  CHECK(tc.readRaw() == 401);
+  CHECK(model.aborted == 0);
+  CHECK(tc.ready());
+  printf("start-up: first reading after %lu ms\n", took);
+}
+
+#ifdef __AVR
+// As a sketch using the sampler has it.
+ISR(TIMER1_COMPA_vect) {
+  MAX6675Sampler::isr();
+}
+
+// Background sampling from Timer1: one frame per period, each after a full
+// conversion, and nothing for a sensor the ISR can't safely read.
+static void sampler(void) {
+  sim_reset();
+  MAX6675Model model(6, 5, 4), spiModel(10);
+  sim_attach(&model);
+  sim_attach(&spiModel);
+  model.setTemperature(401);
+  MAX6675 tc(6, 5, 4), spiTc(10);
+  WAIT_CONVERSION();
+
+  MAX6675Sampler spiSampler(spiTc);
+  CHECK(!spiSampler.begin());
+  CHECK(!(TIMSK1 & _BV(OCIE1A)));
+
+  // 220 ms is 3437.5 ticks of 64 us; a 3437 tick period would be too short.
+  MAX6675Sampler sampler(tc);
+  CHECK(sampler.begin());
+  CHECK(OCR1A == 3437);
+
+  uint8_t samples = 0;
+  unsigned long last = 0;
+  unsigned long until = millis() + 10 * MAX6675_CONVERSION_MS + 5;
+  while (millis() < until) {
+    max6675_sample sample;
+    while (sampler.read(sample)) {
+      max6675_status status;
+      CHECK(MAX6675::decode(sample.frame, &status) == 401 && status == MAX6675_OK);
+      CHECK(!samples || sample.time - last >= MAX6675_CONVERSION_MS);
+      last = sample.time;
+      samples++;
+    }
+    delay(1);
+  }
+  CHECK(samples == 10);
+  CHECK(sampler.overruns() == 0);
+  CHECK(model.aborted == 0);
+  CHECK(model.violations == 0);
+
+  // Left alone, the ring fills up and further samples are counted as lost.
+  delay((MAX6675_SAMPLER_DEPTH + 2) * (MAX6675_CONVERSION_MS + 1));
+  CHECK(sampler.available() == MAX6675_SAMPLER_DEPTH);
+  CHECK(sampler.overruns() > 0);
+
+  sampler.end();
+  uint32_t frames = model.frames;
+  delay(2 * MAX6675_CONVERSION_MS);
+  CHECK(model.frames == frames);
+  printf("sampler:  %u samples in %u ms\n", samples, 10 * MAX6675_CONVERSION_MS);
+}
+#endif
+
+int main(void) {
+  startup();
+  bitbang();
+  hardware_spi();
+  array();
+#ifdef __AVR
+  sampler();
+#endif
+
+  if (failures) {
+    fprintf(stderr, "%d check(s) failed\n", failures);
+    return 1;
+  }
+  return 0;
+}
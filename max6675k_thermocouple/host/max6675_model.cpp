@@ -0,0 +1,101 @@
+// MAX6675 device model for the host build.
+
+#include <stdio.h>
+#include <Arduino.h>
+#include "max6675_model.h"
+
+// Datasheet: tCSS, tCH, tCL and tDV are all 100 ns.
+#define T_NS 100
+
+MAX6675Model::MAX6675Model(uint8_t sclk, uint8_t cs, uint8_t so)
+  : frames(0), conversions(0), aborted(0), violations(0),
+    sclk(sclk), cs(cs), so(so), hwSpi(false), temperature(0), open(false),
+    conversionNs(220000000ULL), converting(true), conversionStart(sim_ns()),
+    result(0), selected(false), sckHigh(false), sckSeen(false), bit(-1),
+    frame(0), lastEdge(0) {
+}
+
+MAX6675Model::MAX6675Model(uint8_t cs)
+  : frames(0), conversions(0), aborted(0), violations(0),
+    sclk(0xFF), cs(cs), so(0xFF), hwSpi(true), temperature(0), open(false),
+    conversionNs(220000000ULL), converting(true), conversionStart(sim_ns()),
+    result(0), selected(false), sckHigh(false), sckSeen(false), bit(-1),
+    frame(0), lastEdge(0) {
+}
+
+void MAX6675Model::violation(const char *what) {
+  violations++;
+  fprintf(stderr, "MAX6675 model (CS %u): %s at %llu ns\n", cs, what,
+          (unsigned long long)sim_ns());
+}
+
+void MAX6675Model::update(void) {
+  if (converting && sim_ns() - conversionStart >= conversionNs) {
+    result = (temperature << 3) | (open ? 0x4 : 0);
+    converting = false;
+    conversions++;
+  }
+}
+
+void MAX6675Model::pinChanged(uint8_t pin, uint8_t level) {
+  uint64_t now = sim_ns();
+
+  if (pin == cs) {
+    update();
+    if (!level && !selected) {
+      if (converting) {
+        aborted++;
+        converting = false;
+      }
+      selected = true;
+      sckSeen = false;
+      frame = result;
+      bit = 15;
+      lastEdge = now;
+      frames++;
+    } else if (level && selected) {
+      selected = false;
+      converting = true;
+      conversionStart = now;
+    }
+    return;
+  }
+
+  if (pin != sclk || hwSpi) {
+    return;
+  }
+  if (selected) {
+    if (now - lastEdge < T_NS) {
+      violation(level ? (sckSeen ? "SCK low < tCL" : "SCK rise < tCSS") : "SCK high < tCH");
+    }
+    if (!level && bit >= 0) {
+      bit--;
+    }
+    sckSeen = true;
+    lastEdge = now;
+  }
+  sckHigh = level;
+}
+
+int8_t MAX6675Model::pinLevel(uint8_t pin) {
+  if (pin != so || hwSpi || !selected) {
+    return -1;
+  }
+  if (!sckHigh && sim_ns() - lastEdge < T_NS) {
+    violation("SO read < tDV");
+  }
+  return bit >= 0 ? (frame >> bit) & 1 : 0;
+}
+
+int16_t MAX6675Model::spiTransfer(uint8_t mosi) {
+  if (!hwSpi || !selected) {
+    return -1;
+  }
+  if (bit < 0) {
+    return 0;
+  }
+  // bit is 15 for the first byte, 7 for the second.
+  uint8_t b = frame >> (bit - 7);
+  bit -= 8;
+  return b;
+}
@@ -0,0 +1,57 @@
+// MAX6675 device model for the host build.
+//
+// Shifts out (temperature << 3 | open << 2) MSB first, D15 as soon as CS
+// falls and the next bit on every falling SCK edge. Raising CS starts a
+// conversion; pulling CS low before it finishes aborts it, and the frame
+// then holds the previous result. Datasheet timing the driver does not
+// honor is counted in violations.
+
+#ifndef _MAX6675_MODEL_H_INCLUDED
+#define _MAX6675_MODEL_H_INCLUDED
+
+#include "sim.h"
+
+class MAX6675Model : public SimDevice {
+ public:
+  // Bit-banged: SCK, CS and SO on GPIO pins.
+  MAX6675Model(uint8_t sclk, uint8_t cs, uint8_t so);
+  // Hardware SPI: only CS is a GPIO, bytes arrive through spiTransfer().
+  MAX6675Model(uint8_t cs);
+
+  // Temperature the next conversion will measure, in quarter degrees.
+  void setTemperature(uint16_t quarterDegrees) { temperature = quarterDegrees & 0x0FFF; }
+  void setOpen(bool open) { this->open = open; }
+  void setConversionMs(uint16_t ms) { conversionNs = (uint64_t)ms * 1000000; }
+
+  uint32_t frames;        // CS low periods
+  uint32_t conversions;   // Completed conversions
+  uint32_t aborted;       // Conversions cut short by CS going low
+  uint32_t violations;    // Datasheet timing violations
+
+  void pinChanged(uint8_t pin, uint8_t level);
+  int8_t pinLevel(uint8_t pin);
+  int16_t spiTransfer(uint8_t mosi);
+
+ private:
+  void update(void);
+  void violation(const char *what);
+
+  uint8_t sclk, cs, so;
+  bool hwSpi;
+  uint16_t temperature;
+  bool open;
+  uint64_t conversionNs;
+
+  bool converting;
+  uint64_t conversionStart;
+  uint16_t result;
+
+  bool selected;
+  bool sckHigh;
+  bool sckSeen;
+  int8_t bit;
+  uint16_t frame;
+  uint64_t lastEdge;
+};
+
+#endif
@@ -8,12 +8,17 @@
 #endif
 #include <util/delay.h>
 #include <stdlib.h>
+#include <SPI.h>
 #include "max6675.h"
 
 MAX6675::MAX6675(int8_t SCLK, int8_t CS, int8_t MISO) {
   sclk = SCLK;
   cs = CS;
   miso = MISO;
+  frameValid = false;
+  started = false;
+  up = false;
+  lastStatus = MAX6675_OK;
 
   //define pin modes
   pinMode(cs, OUTPUT);
@@ -21,27 +26,89 @@ MAX6675::MAX6675(int8_t SCLK, int8_t CS, int8_t MISO) {
   pinMode(miso, INPUT);
 
   digitalWrite(cs, HIGH);
+
+#ifdef __AVR
+  sclkPort = portOutputRegister(digitalPinToPort(sclk));
+  sclkMask = digitalPinToBitMask(sclk);
+  csPort = portOutputRegister(digitalPinToPort(cs));
+  csMask = digitalPinToBitMask(cs);
+  misoPin = portInputRegister(digitalPinToPort(miso));
+  misoMask = digitalPinToBitMask(miso);
+#endif
 }
-double MAX6675::readCelsius(void) {
 
-  uint16_t v;
+MAX6675::MAX6675(int8_t CS) {
+  sclk = -1;
+  cs = CS;
+  miso = -1;
+  frameValid = false;
+  started = false;
+  up = false;
+  lastStatus = MAX6675_OK;
 
-  digitalWrite(cs, LOW);
-  _delay_ms(1);
+  pinMode(cs, OUTPUT);
+  digitalWrite(cs, HIGH);
 
-  v = spiread();
-  v <<= 8;
-  v |= spiread();
+  SPI.begin();
+}
 
-  digitalWrite(cs, HIGH);
+bool MAX6675::beginStep(void) {
+  if (!started) {
+    started = true;
+    startTime = millis();
+  }
+  return ready();
+}
+
+bool MAX6675::ready(void) {
+  // Latched, so that millis() wrapping round can't take it back
+  if (!up && started && millis() - startTime > MAX6675_CONVERSION_MS) {
+    up = true;
+  }
+  return up;
+}
+
+uint16_t MAX6675::readFrame(void) {
+  // The conversion starts when CS goes high at the end of the read, so take
+  // the time after it; millis() truncates, hence the strict comparison.
+  if (!frameValid || millis() - frameTime > MAX6675_CONVERSION_MS) {
+    frame = readBus();
+    frameTime = millis();
+    frameValid = true;
+  }
 
-  if (v & 0x4) {
+  return frame;
+}
+
+unsigned long MAX6675::age(void) {
+  return millis() - frameTime;
+}
+
+int16_t MAX6675::decode(uint16_t frame, max6675_status *status) {
+  if (frame & 0x8002) {
+    *status = MAX6675_BUS_ERROR;
+    return MAX6675_INVALID;
+  }
+  if (frame & 0x4) {
     // uh oh, no thermocouple attached!
-    return NAN; 
-    //return -100;
+    *status = MAX6675_OPEN;
+    return MAX6675_INVALID;
   }
+  *status = MAX6675_OK;
+  return frame >> 3;
+}
 
-  v >>= 3;
+int16_t MAX6675::readRaw(void) {
+  return decode(readFrame(), &lastStatus);
+}
+
+double MAX6675::readCelsius(void) {
+
+  int16_t v = readRaw();
+
+  if (v == MAX6675_INVALID) {
+    return NAN;
+  }
 
   return v*0.25;
 }
@@ -50,22 +117,49 @@ double MAX6675::readFahrenheit(void) {
   return readCelsius() * 9.0/5.0 + 32;
 }
 
-byte MAX6675::spiread(void) { 
-  int i;
-  byte d = 0;
-
-  for (i=7; i>=0; i--)
-  {
-    digitalWrite(sclk, LOW);
-    _delay_ms(1);
-    if (digitalRead(miso)) {
-      //set the bit to 0 no matter what
-      d |= (1 << i);
-    }
-
-    digitalWrite(sclk, HIGH);
-    _delay_ms(1);
+uint16_t MAX6675::readBus(void) {
+  uint16_t v;
+
+  if (sclk == -1) {
+    // 4 MHz is within the 4.3 MHz max SCK; SO changes on the falling edge.
+    SPI.beginTransaction(SPISettings(4000000, MSBFIRST, SPI_MODE0));
+    digitalWrite(cs, LOW);
+    v = SPI.transfer16(0);
+    digitalWrite(cs, HIGH);
+    SPI.endTransaction();
+    return v;
   }
 
-  return d;
+  return spiread16();
 }
+
+#ifdef __AVR
+uint16_t MAX6675::spiread16(void) {
+  uint16_t v;
+
+  // The port writes are read-modify-write, so keep interrupt handlers
+  // touching the same ports out for the ~10 us the frame takes.
+  uint8_t oldSREG = SREG;
+  cli();
+
+  *sclkPort &= ~sclkMask;
+  *csPort &= ~csMask;
+  v = max6675_shift16(sclkPort, sclkMask, misoPin, misoMask);
+  *csPort |= csMask;
+
+  SREG = oldSREG;
+
+  return v;
+}
+#else
+uint16_t MAX6675::spiread16(void) {
+  uint16_t v;
+
+  digitalWrite(sclk, LOW);
+  digitalWrite(cs, LOW);
+  v = max6675_shift16(sclk, miso);
+  digitalWrite(cs, HIGH);
+
+  return v;
+}
+#endif
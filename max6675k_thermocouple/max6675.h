@@ -1,21 +1,130 @@
 // this library is public domain. enjoy!
 // www.ladyada.net/learn/sensors/thermocouple
 
+#ifndef _MAX6675_H_INCLUDED
+#define _MAX6675_H_INCLUDED
+
 #if ARDUINO >= 100
  #include "Arduino.h"
 #else
  #include "WProgram.h"
 #endif
 
+// Worst case conversion time. CS going high starts a conversion and pulling
+// it low again aborts it, so there is no new data to read any sooner.
+#define MAX6675_CONVERSION_MS 220
+
+// Returned by the integer read functions when the reading is not usable;
+// status() tells why.
+#define MAX6675_INVALID (-32767 - 1)
+#define MAX6675_INVALID_CENTI (-2147483647L - 1)
+
+enum max6675_status {
+  MAX6675_OK = 0,
+  MAX6675_OPEN,       // No thermocouple attached
+  MAX6675_BUS_ERROR   // Dummy sign bit or device ID bit set: SO floating or shorted
+};
+
+#ifdef __AVR
+#include <util/delay.h>
+
+// Datasheet timing: SO is valid 100 ns after CS or SCK falls, SCK must stay
+// high and low for at least 100 ns, and SCK may run at up to 4.3 MHz.
+#define MAX6675_T_NS_DELAY() _delay_us(0.1)
+
+// Clock one 16-bit frame out of a MAX6675 whose CS is already low. SCK idles
+// low and SO shifts on each falling edge. Call with interrupts disabled.
+static inline uint16_t max6675_shift16(volatile uint8_t *sclkPort, uint8_t sclkMask,
+                                       volatile uint8_t *misoPin, uint8_t misoMask) {
+  uint16_t v = 0;
+
+  MAX6675_T_NS_DELAY();
+  for (uint8_t i = 16; i; i--) {
+    v <<= 1;
+    if (*misoPin & misoMask) {
+      v |= 1;
+    }
+    *sclkPort |= sclkMask;
+    MAX6675_T_NS_DELAY();
+    *sclkPort &= ~sclkMask;
+    MAX6675_T_NS_DELAY();
+  }
+  return v;
+}
+#else
+// As above, for pins only reachable through digitalWrite(), which on its own
+// is slower than the 100 ns the MAX6675 needs.
+static inline uint16_t max6675_shift16(int8_t sclk, int8_t miso) {
+  uint16_t v = 0;
+
+  for (uint8_t i = 16; i; i--) {
+    v <<= 1;
+    if (digitalRead(miso)) {
+      v |= 1;
+    }
+    digitalWrite(sclk, HIGH);
+    digitalWrite(sclk, LOW);
+  }
+  return v;
+}
+#endif
+
 class MAX6675 {
  public:
   MAX6675(int8_t SCLK, int8_t CS, int8_t MISO);
+  // Hardware SPI: SO on MISO, SCK on SCK, chip select on any pin.
+  MAX6675(int8_t CS);
+
+  // Start-up without waiting. The first conversion after power up takes
+  // MAX6675_CONVERSION_MS, and reading before then aborts it. The first
+  // call marks power up, so make it once the MAX6675 has power, then call
+  // it from loop() until it returns true.
+  bool beginStep(void);
+  bool ready(void);
+
+  // The 16-bit frame from the sensor. Within MAX6675_CONVERSION_MS of the
+  // previous read this returns the cached frame without touching the bus.
+  uint16_t readFrame(void);
+  // Milliseconds since the frame returned by readFrame() was read.
+  unsigned long age(void);
+
+  // Temperature in quarter degrees Celsius, or MAX6675_INVALID.
+  int16_t readRaw(void);
+  // Temperature in hundredths of a degree, or MAX6675_INVALID_CENTI.
+  int32_t readCentiCelsius(void) { return centiCelsius(readRaw()); }
+  int32_t readCentiFahrenheit(void) { return centiFahrenheit(readRaw()); }
+  // Status of the frame behind the last read.
+  max6675_status status(void) { return lastStatus; }
+
+  // Split a frame into quarter degrees (or MAX6675_INVALID) and a status.
+  static int16_t decode(uint16_t frame, max6675_status *status);
+  static int32_t centiCelsius(int16_t quarterDegrees) {
+    return quarterDegrees == MAX6675_INVALID ? MAX6675_INVALID_CENTI : (int32_t)quarterDegrees * 25;
+  }
+  static int32_t centiFahrenheit(int16_t quarterDegrees) {
+    return quarterDegrees == MAX6675_INVALID ? MAX6675_INVALID_CENTI : (int32_t)quarterDegrees * 45 + 3200;
+  }
 
   double readCelsius(void);
   double readFahrenheit(void);
   // For compatibility with older versions:
   double readFarenheit(void) { return readFahrenheit(); }
  private:
+  friend class MAX6675Sampler;
   int8_t sclk, miso, cs;
-  uint8_t spiread(void);
+  uint16_t frame;
+  unsigned long frameTime;
+  bool frameValid;
+  bool started, up;
+  unsigned long startTime;
+  max6675_status lastStatus;
+#ifdef __AVR
+  // Bit-bang pins resolved to port registers once, in the constructor.
+  volatile uint8_t *sclkPort, *csPort, *misoPin;
+  uint8_t sclkMask, csMask, misoMask;
+#endif
+  uint16_t readBus(void);
+  uint16_t spiread16(void);
 };
+
+#endif
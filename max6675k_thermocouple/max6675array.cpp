@@ -0,0 +1,105 @@
+// Several MAX6675 thermocouple amplifiers sharing SCK and SO, each with its
+// own chip select.
+
+#include "max6675array.h"
+
+MAX6675Array::MAX6675Array(int8_t SCLK, int8_t MISO, const int8_t *CS, uint8_t n) {
+  sclk = SCLK;
+  miso = MISO;
+  this->n = n > MAX6675_ARRAY_MAX ? MAX6675_ARRAY_MAX : n;
+  polled = false;
+
+  pinMode(sclk, OUTPUT);
+  digitalWrite(sclk, LOW);
+  pinMode(miso, INPUT);
+
+#ifdef __AVR
+  sclkPort = portOutputRegister(digitalPinToPort(sclk));
+  sclkMask = digitalPinToBitMask(sclk);
+  misoPin = portInputRegister(digitalPinToPort(miso));
+  misoMask = digitalPinToBitMask(miso);
+#endif
+
+  for (uint8_t i = 0; i < this->n; i++) {
+    cs[i] = CS[i];
+    pinMode(cs[i], OUTPUT);
+    digitalWrite(cs[i], HIGH);
+#ifdef __AVR
+    csPort[i] = portOutputRegister(digitalPinToPort(cs[i]));
+    csMask[i] = digitalPinToBitMask(cs[i]);
+#endif
+  }
+}
+
+#ifdef __AVR
+uint16_t MAX6675Array::readOne(uint8_t i) {
+  uint16_t v;
+  uint8_t oldSREG = SREG;
+  cli();
+
+  *csPort[i] &= ~csMask[i];
+  v = max6675_shift16(sclkPort, sclkMask, misoPin, misoMask);
+  *csPort[i] |= csMask[i];
+
+  SREG = oldSREG;
+  return v;
+}
+#else
+uint16_t MAX6675Array::readOne(uint8_t i) {
+  uint16_t v;
+
+  digitalWrite(cs[i], LOW);
+  v = max6675_shift16(sclk, miso);
+  digitalWrite(cs[i], HIGH);
+
+  return v;
+}
+#endif
+
+bool MAX6675Array::readAll(uint16_t *frames) {
+  // Conversions start as each CS goes high; as in MAX6675::readFrame(),
+  // time them from the end of the read and compare strictly.
+  if (polled) {
+    unsigned long now = millis();
+    for (uint8_t i = 0; i < n; i++) {
+      if (now - started[i] <= MAX6675_CONVERSION_MS) {
+        return false;
+      }
+    }
+  }
+
+  for (uint8_t i = 0; i < n; i++) {
+    frames[i] = readOne(i);
+  }
+
+  unsigned long scanTime = millis();
+  for (uint8_t i = 0; i < n; i++) {
+    started[i] = scanTime;
+  }
+  polled = true;
+
+  return true;
+}
+
+int8_t MAX6675Array::poll(uint16_t *frames) {
+  unsigned long now = millis();
+
+  if (!polled) {
+    // Pretend the sensors were started one slot apart so the first pass
+    // already comes out staggered.
+    for (uint8_t i = 0; i < n; i++) {
+      started[i] = now - MAX6675_CONVERSION_MS - 1 + (unsigned long)i * MAX6675_CONVERSION_MS / n;
+    }
+    polled = true;
+  }
+
+  for (uint8_t i = 0; i < n; i++) {
+    if (now - started[i] > MAX6675_CONVERSION_MS) {
+      frames[i] = readOne(i);
+      started[i] = millis();
+      return i;
+    }
+  }
+
+  return -1;
+}
@@ -0,0 +1,51 @@
+// Several MAX6675 thermocouple amplifiers sharing SCK and SO, each with its
+// own chip select.
+
+#ifndef _MAX6675ARRAY_H_INCLUDED
+#define _MAX6675ARRAY_H_INCLUDED
+
+#include "max6675.h"
+
+#ifndef MAX6675_ARRAY_MAX
+#define MAX6675_ARRAY_MAX 8
+#endif
+
+class MAX6675Array {
+ public:
+  // CS holds n chip select pins, at most MAX6675_ARRAY_MAX.
+  MAX6675Array(int8_t SCLK, int8_t MISO, const int8_t *CS, uint8_t n);
+
+  uint8_t count(void) { return n; }
+
+  // Frames are raw; MAX6675::decode() turns them into quarter degrees.
+
+  // Read every sensor back to back into frames[0..count()-1]. Returns false
+  // and leaves frames alone while any sensor was read, by readAll() or
+  // poll(), less than MAX6675_CONVERSION_MS ago, as reading then would
+  // only abort its conversion.
+  bool readAll(uint16_t *frames);
+
+  // Staggered mode: call from loop(). Reads at most one sensor per call,
+  // spacing the sensors evenly over the conversion period so each is read
+  // as soon as its own conversion is done. Returns the index written to
+  // frames, or -1 when no sensor is due yet.
+  int8_t poll(uint16_t *frames);
+
+ private:
+  int8_t sclk, miso;
+  uint8_t n;
+  int8_t cs[MAX6675_ARRAY_MAX];
+  // When each sensor's conversion started, i.e. its CS last went high.
+  // Only valid once either mode has run.
+  unsigned long started[MAX6675_ARRAY_MAX];
+  bool polled;
+#ifdef __AVR
+  volatile uint8_t *sclkPort, *misoPin;
+  uint8_t sclkMask, misoMask;
+  volatile uint8_t *csPort[MAX6675_ARRAY_MAX];
+  uint8_t csMask[MAX6675_ARRAY_MAX];
+#endif
+  uint16_t readOne(uint8_t i);
+};
+
+#endif
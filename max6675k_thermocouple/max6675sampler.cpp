@@ -0,0 +1,61 @@
+// Background MAX6675 sampling from the Timer1 compare interrupt.
+
+#include "max6675sampler.h"
+
+#ifdef __AVR
+
+MAX6675Sampler *MAX6675Sampler::active = 0;
+
+MAX6675Sampler::MAX6675Sampler(MAX6675 &sensor) : sensor(sensor) {
+  dropped = 0;
+}
+
+bool MAX6675Sampler::begin(unsigned int periodMs) {
+  if (sensor.sclk == -1) {
+    return false;
+  }
+
+  // CTC mode, clk/1024: 15.625 kHz at 16 MHz, so up to ~4.1 s per period.
+  // Round up, a period even one tick short of the conversion time aborts it.
+  uint32_t ticks = ((uint32_t)(F_CPU / 1000) * periodMs + 1023) / 1024;
+  if (ticks > 0x10000) {
+    ticks = 0x10000;
+  }
+
+  uint8_t oldSREG = SREG;
+  cli();
+  active = this;
+  TCCR1A = 0;
+  TCCR1B = _BV(WGM12) | _BV(CS12) | _BV(CS10);
+  TCNT1 = 0;
+  OCR1A = ticks - 1;
+  TIFR1 = _BV(OCF1A);
+  TIMSK1 |= _BV(OCIE1A);
+  SREG = oldSREG;
+  return true;
+}
+
+void MAX6675Sampler::end(void) {
+  uint8_t oldSREG = SREG;
+  cli();
+  TIMSK1 &= ~_BV(OCIE1A);
+  TCCR1B = 0;
+  active = 0;
+  SREG = oldSREG;
+}
+
+void MAX6675Sampler::isr(void) {
+  MAX6675Sampler *s = active;
+  max6675_sample sample;
+
+  if (!s) {
+    return;
+  }
+  sample.frame = s->sensor.readBus();
+  sample.time = millis();
+  if (!s->ring.push(sample)) {
+    s->dropped++;
+  }
+}
+
+#endif
@@ -0,0 +1,62 @@
+// Background MAX6675 sampling from the Timer1 compare interrupt.
+//
+// Every period the ISR clocks one frame out of the sensor and pushes it,
+// with its millis() timestamp, into a ring that loop() drains with read().
+// The sensor must use the bit-bang constructor; the frame takes ~10 us of
+// ISR time. This claims Timer1, so it cannot be combined with Servo or
+// other Timer1 users, and it is only available on the AVR.
+//
+// The library leaves the Timer1 vector alone so that sketches which don't
+// sample keep it. A sketch that does hands the interrupt over itself:
+//
+//   ISR(TIMER1_COMPA_vect) {
+//     MAX6675Sampler::isr();
+//   }
+
+#ifndef _MAX6675SAMPLER_H_INCLUDED
+#define _MAX6675SAMPLER_H_INCLUDED
+
+#ifdef __AVR
+
+#include "max6675.h"
+#include "spscring.h"
+
+#ifndef MAX6675_SAMPLER_DEPTH
+#define MAX6675_SAMPLER_DEPTH 16
+#endif
+
+struct max6675_sample {
+  unsigned long time;   // millis() when the frame was read
+  uint16_t frame;       // Raw frame, see MAX6675::decode()
+};
+
+class MAX6675Sampler {
+ public:
+  MAX6675Sampler(MAX6675 &sensor);
+
+  // Start sampling every periodMs, rounded up to whole timer ticks. The
+  // period should not be shorter than the conversion time. Returns false,
+  // and leaves Timer1 alone, for a hardware SPI sensor: the ISR would take
+  // the bus in the middle of someone else's transaction.
+  bool begin(unsigned int periodMs = MAX6675_CONVERSION_MS);
+  void end(void);
+
+  // Take the oldest sample. Returns false when there is none.
+  bool read(max6675_sample &sample) { return ring.pop(sample); }
+  uint8_t available(void) { return ring.available(); }
+  // Samples dropped because loop() did not drain the ring in time.
+  uint16_t overruns(void) { return dropped; }
+
+  // Call from the sketch's Timer1 compare A ISR.
+  static void isr(void);
+
+ private:
+  MAX6675 &sensor;
+  SPSCRing<max6675_sample, MAX6675_SAMPLER_DEPTH> ring;
+  volatile uint16_t dropped;
+  static MAX6675Sampler *active;
+};
+
+#endif
+
+#endif
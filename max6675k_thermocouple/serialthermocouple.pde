@@ -2,15 +2,40 @@
 // www.ladyada.net/learn/sensors/thermocouple
 
 #include "max6675.h"
+#include <tasks.h>
 
 int thermoDO = 4;
 int thermoCS = 5;
 int thermoCLK = 6;
 
 MAX6675 thermocouple(thermoCLK, thermoCS, thermoDO);
+// Or, with SO on MISO and CLK on SCK, use the hardware SPI port:
+// MAX6675 thermocouple(thermoCS);
 int vccPin = 3;
 int gndPin = 2;
-  
+
+TaskScheduler scheduler;
+
+void printTemperature(task_entry *task) {
+  // basic readout test, just print the current temp
+  Serial.print("C = ");
+  Serial.println(thermocouple.readCelsius());
+  Serial.print("F = ");
+  Serial.println(thermocouple.readFahrenheit());
+}
+
+task_entry readout = { printTemperature };
+
+// wait for the first conversion, then print once a second
+void startThermocouple(task_entry *task) {
+  if (thermocouple.beginStep()) {
+    scheduler.cancel(*task);
+    scheduler.every(readout, 1000);
+  }
+}
+
+task_entry start = { startThermocouple };
+
 void setup() {
   Serial.begin(9600);
   // use Arduino pins 
@@ -18,17 +43,11 @@ void setup() {
   pinMode(gndPin, OUTPUT); digitalWrite(gndPin, LOW);
   
   Serial.println("MAX6675 test");
-  // wait for MAX chip to stabilize
-  delay(500);
+  // the MAX chip has power from here
+  thermocouple.beginStep();
+  scheduler.every(start, 10);
 }
 
 void loop() {
-  // basic readout test, just print the current temp
-  
-   Serial.print("C = "); 
-   Serial.println(thermocouple.readCelsius());
-   Serial.print("F = ");
-   Serial.println(thermocouple.readFahrenheit());
- 
-   delay(1000);
+  scheduler.poll();
 }
@@ -0,0 +1,51 @@
+// Lock-free single-producer/single-consumer ring buffer.
+//
+// One side (typically an ISR) only calls push(), the other (loop()) only
+// calls pop(). Each index is written by one side only and is a single byte,
+// so on AVR neither side ever needs to disable interrupts.
+
+#ifndef _SPSCRING_H_INCLUDED
+#define _SPSCRING_H_INCLUDED
+
+#include <stdint.h>
+
+// N must be a power of two no larger than 128.
+template <typename T, uint8_t N>
+class SPSCRing {
+ public:
+  SPSCRing() : head(0), tail(0) {}
+
+  // Producer side. Returns false, dropping v, when the ring is full.
+  bool push(const T &v) {
+    uint8_t h = head;
+    if ((uint8_t)(h - tail) == N) {
+      return false;
+    }
+    buf[h & (N - 1)] = v;
+    // The slot must be written before the consumer can see it.
+    asm volatile("" ::: "memory");
+    head = h + 1;
+    return true;
+  }
+
+  // Consumer side. Returns false when the ring is empty.
+  bool pop(T &v) {
+    uint8_t t = tail;
+    if (t == head) {
+      return false;
+    }
+    asm volatile("" ::: "memory");
+    v = buf[t & (N - 1)];
+    asm volatile("" ::: "memory");
+    tail = t + 1;
+    return true;
+  }
+
+  uint8_t available(void) const { return (uint8_t)(head - tail); }
+
+ private:
+  T buf[N];
+  volatile uint8_t head, tail;
+};
+
+#endif
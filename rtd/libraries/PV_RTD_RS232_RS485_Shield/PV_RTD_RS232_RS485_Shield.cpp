@@ -4,9 +4,25 @@
 #include <math.h>
 
 
+#define FACTORY_RESET_MS  500     ///< Time the shield takes to restart after a factory reset, in milliseconds
+#define BEGIN_RETRY_MS    100     ///< Time between attempts to reach a shield that does not answer, in milliseconds
+
+/// Bring up steps, see Begin_Step().
+enum {
+  BEGIN_IDLE,                   ///< Begin() has not been called
+  BEGIN_START,                  ///< Reset the shield, or check that it answers
+  BEGIN_RETRY,                  ///< The shield did not answer, wait to try again
+  BEGIN_RESTARTING,             ///< Wait for the factory reset to complete
+  BEGIN_CONFIGURE,              ///< Call the configuration function
+  BEGIN_SETTLING,               ///< Wait for the first reading
+  BEGIN_READY                   ///< Ready for readings
+};
+
+
 PV_RTD_RS232_RS485::PV_RTD_RS232_RS485( byte i2c_address, float R0 ) {
   m_i2c_address = i2c_address;              // Set the I2C address
   m_R0 = R0;
+  m_begin_state = BEGIN_IDLE;
 }
 
 
@@ -1037,7 +1053,71 @@ void PV_RTD_RS232_RS485::Reset() {
 
 void PV_RTD_RS232_RS485::Factory_Reset() {
   Write_Register( RESET_ADDRESS, 0xFF );
-  delay( 500 );
+  delay( FACTORY_RESET_MS );
+}
+
+
+
+void PV_RTD_RS232_RS485::Begin( boolean factory_reset, void (*configure)( PV_RTD_RS232_RS485 &rtds ), unsigned long settle_ms ) {
+  m_begin_factory_reset = factory_reset;
+  m_begin_configure = configure;
+  m_settle_ms = settle_ms;
+  m_begin_state = BEGIN_START;
+}
+
+
+
+boolean PV_RTD_RS232_RS485::Begin_Step() {
+  unsigned long now = millis();
+  int status;
+
+  switch( m_begin_state ) {
+    case BEGIN_START:
+      // A shield that isn't there (yet) doesn't acknowledge its address
+      if( m_begin_factory_reset ) {
+        status = Write_Register( RESET_ADDRESS, 0xFF );
+      } else {
+        status = Set_Register( SIGNATURE_ADDRESS );
+      }
+      m_begin_time = now;
+      if( status != 0 ) {
+        m_begin_state = BEGIN_RETRY;
+      } else if( m_begin_factory_reset ) {
+        m_begin_state = BEGIN_RESTARTING;
+      } else {
+        m_begin_state = BEGIN_CONFIGURE;
+      }
+      break;
+    case BEGIN_RETRY:
+      if( now - m_begin_time >= BEGIN_RETRY_MS ) {
+        m_begin_state = BEGIN_START;
+      }
+      break;
+    case BEGIN_RESTARTING:
+      if( now - m_begin_time >= FACTORY_RESET_MS ) {
+        m_begin_state = BEGIN_CONFIGURE;
+      }
+      break;
+    case BEGIN_CONFIGURE:
+      if( m_begin_configure ) {
+        m_begin_configure( *this );
+      }
+      m_begin_time = millis();              // Configuration takes a few transactions
+      m_begin_state = BEGIN_SETTLING;
+      break;
+    case BEGIN_SETTLING:
+      if( now - m_begin_time >= m_settle_ms ) {
+        m_begin_state = BEGIN_READY;
+      }
+      break;
+  }
+  return Ready();
+}
+
+
+
+boolean PV_RTD_RS232_RS485::Ready() {
+  return m_begin_state == BEGIN_READY;
 }
 
 
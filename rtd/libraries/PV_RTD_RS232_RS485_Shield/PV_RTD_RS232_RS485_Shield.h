@@ -386,8 +386,34 @@ class PV_RTD_RS232_RS485 : public Print {
     void Reset();
     
     /// Perform a factory reset on the shield.
+    /** Waits the 500 ms the shield takes to restart before returning. Begin() does the same without blocking.
+    */
     void Factory_Reset();
     
+    /// Start bringing the shield up without blocking.
+    /** Use this instead of Factory_Reset(), the configuration and a delay() in setup() when other devices start at the 
+        same time. Call Begin_Step() from loop() until Ready() returns true: it does the factory reset if asked for, 
+        waits for the shield to restart, calls configure to enable the channels and set the SPS, Idac and PGA, then waits 
+        settle_ms for the self-calibration and the first reading. A shield that does not acknowledge its address is tried 
+        again every 100 ms.
+        \param factory_reset True to start from the factory settings.
+        \param configure Called once the shield is up to configure it, or NULL.
+        \param settle_ms The time from configuration to the first valid reading: 2500 at 16 samples-per-second, 10000 at 5.
+        \sa Begin_Step(), Ready()
+    */
+    void Begin( boolean factory_reset, void (*configure)( PV_RTD_RS232_RS485 &rtds ), unsigned long settle_ms );
+    
+    /// Take the next step of the bring up started by Begin().
+    /** Returns straight away, at most one I2C transaction later.
+        \return True once the shield is ready, as Ready().
+    */
+    boolean Begin_Step();
+    
+    /// Checks whether the bring up started by Begin() is complete.
+    /** \return True once the shield is configured and has taken its first reading.
+    */
+    boolean Ready();
+    
     /// Returns the amperage output on the digital to analog converter output in units of amperes.
     /** The ADS1248 has two current sourcing digital-to-alalog converters.  The output current can not be independently 
         controlled, but the output connections of the DACs can be independently controlled.  This function returns the 
@@ -1104,6 +1130,21 @@ class PV_RTD_RS232_RS485 : public Print {
     
     /// True if print operations should be output on the RS485 port.
     boolean m_print_to_rs485;
+    
+    /// The step Begin_Step() takes next.
+    byte m_begin_state;
+    
+    /// True if Begin() was asked for a factory reset.
+    boolean m_begin_factory_reset;
+    
+    /// The configuration function passed to Begin().
+    void (*m_begin_configure)( PV_RTD_RS232_RS485 &rtds );
+    
+    /// The time to wait after configuration, from Begin().
+    unsigned long m_settle_ms;
+    
+    /// When the current bring up step started, in milliseconds.
+    unsigned long m_begin_time;
 };
 
 
@@ -1,5 +1,6 @@
 #include <Wire.h>
 #include <PV_RTD_RS232_RS485_Shield.h>
+#include <tasks.h>
 // Create an object to talk to the RTD shield.
 // 82 is the I2C (Wire) interface address.
 // 100.0 is the type of RTD sensor being used (100.0 for Pt-100)
@@ -8,19 +9,12 @@ PV_RTD_RS232_RS485 my_rtds( 82, 100.0 );
 
 int d = 2500;
 
-void setup() {
-  Serial.begin( 115200 );
-  Serial.println( "t,RT1," );
-  
-  // This calls Wire1.begin() for Due and Wire.begin() for other Arduinos
-  I2C_RTD_PORTNAME.begin();
-  
-  // This will put us in a "fresh" state at startup, though you probably
-  // wouldn't want to do a factory reset every time you power up.
-  my_rtds.Factory_Reset();
+TaskScheduler scheduler;
+
+void configure_rtds( PV_RTD_RS232_RS485 &rtds ) {
   // Next, we enable the channels which we want to read
-  my_rtds.Disable_All_RTD_Channels();
-  my_rtds.Enable_RTD_Channel( 3, 1 );
+  rtds.Disable_All_RTD_Channels();
+  rtds.Enable_RTD_Channel( 3, 1 );
   
   // Now, the next three commands configure the shield to maximize stability
   // The following settings are particular to 3-wire Pt-100 RTDs.  If you 
@@ -34,12 +28,12 @@ void setup() {
   // You can reduce this value to as low as 5, but you will have to wait
   // about 6.6 seconds for each new reading.  The slower you go, the less
   // noise there will be in the measurements.
-  my_rtds.Set_RTD_SPS(16);
+  rtds.Set_RTD_SPS(16);
   
   // Set the RTD drive current to 250uA.  This is typically the best setting.
   // Higher settings will provide common-mode errors to the shield.  Lower
   // values will be more susceptible to noise.
-  my_rtds.Set_RTD_Idac( 3, 1, 0.000250 );
+  rtds.Set_RTD_Idac( 3, 1, 0.000250 );
   
   // Set the programmable gain amplifier to 64.  This will limit readings to
   // 89.1 deg C (192.4 deg F).
@@ -47,23 +41,50 @@ void setup() {
   // but the noise rejection is not as good as it is at 64.
   // A PGA value of 16 will allow measurements up to the limit of the RTD 
   // sensor but the noise rejection is not as good as it is at 64 or 32.
-  my_rtds.Set_RTD_PGA( 3, 1, 32 );
-  
-  // A short delay so that the first reading can be taken.  If you request
-  // a reading before the shield has taken its first reading you will get a 
-  // bogus number.  The shield also performs a self-calibration that we have
-  // to allow to complete.
-  // Set this delay to 10000 if using 5 samples-per-second above.
-  delay(d);
+  rtds.Set_RTD_PGA( 3, 1, 32 );
 }
-void loop() {
+
+void read_rtds( task_entry *task ) {
   Serial.print(millis());
   Serial.print(",");
   Serial.print(my_rtds.Get_RTD_Temperature_degC( 3, 1 ));
   Serial.println("C," );
+}
+
+task_entry reading_task = { read_rtds };
+
+// Wait for the shield to restart, take the configuration and settle, then
+// read it every d milliseconds, which allows the shield to take a new
+// measurement each time.  Set d to 6600 if using 5 samples-per-second.
+void start_rtds( task_entry *task ) {
+  if( my_rtds.Begin_Step() ) {
+    scheduler.cancel( *task );
+    scheduler.every( reading_task, d );
+  }
+}
+
+task_entry start_task = { start_rtds };
+
+void setup() {
+  Serial.begin( 115200 );
+  Serial.println( "t,RT1," );
+  
+  // This calls Wire1.begin() for Due and Wire.begin() for other Arduinos
+  I2C_RTD_PORTNAME.begin();
   
-  // Add a delay to allow the shield to take a new measurement.
-  // Set this delay to 6600 if using 5 samples-per-second
-  delay(d);
+  // Start the shield with a factory reset, which puts us in a "fresh" state
+  // at startup, though you probably wouldn't want to do a factory reset
+  // every time you power up.  configure_rtds() above is called once the
+  // shield has restarted, then d milliseconds are allowed for the first
+  // reading.  If you request a reading before the shield has taken its
+  // first reading you will get a bogus number.  The shield also performs a
+  // self-calibration that we have to allow to complete.
+  // Set d to 10000 if using 5 samples-per-second above.
+  // Nothing here waits: start_rtds() carries the start-up on.
+  my_rtds.Begin( true, configure_rtds, d );
+  scheduler.every( start_task, 10 );
 }
 
+void loop() {
+  scheduler.poll();
+}